@@ -0,0 +1,93 @@
+#include "beacon.hpp"
+#include "dnscache.hpp"
+#include "logging.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+
+BeaconListener::BeaconListener(const std::string& ip, uint16_t port, const std::shared_ptr<Protocol>& protocol, IocStartedCb& cb)
+    : m_protocol(protocol)
+    , m_iocStartedCb(cb)
+    , m_batch(1024, 0)
+    , m_learnUntil(std::chrono::steady_clock::now() + LEARNING_PERIOD)
+    , m_lastExpire(std::chrono::steady_clock::now())
+{
+    m_udpReceive = true;
+    m_sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_sock < 0) {
+        throw SocketException("failed to create socket - {errno}");
+    }
+
+    int enable = 1;
+    if (::setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(enable)) != 0) {
+        throw SocketException("can't set reuse address option - {errno}");
+    }
+
+    if (::fcntl(m_sock, F_SETFL, fcntl(m_sock, F_GETFL, 0) | O_NONBLOCK) == -1) {
+        throw SocketException("failed to set socket non-blocking", errno);
+    }
+
+    m_addr = {}; // avoid using memset()
+    m_addr.sin_family = AF_INET;
+    m_addr.sin_port = ::htons(port);
+    if (ip.empty()) {
+        m_addr.sin_addr.s_addr = INADDR_ANY;
+    } else if (::inet_aton(ip.c_str(), reinterpret_cast<in_addr*>(&m_addr.sin_addr.s_addr)) == 0) {
+        throw SocketException("invalid IP address - {errno}");
+    }
+
+    if (::bind(m_sock, reinterpret_cast<sockaddr *>(&m_addr), sizeof(m_addr)) < 0 )  {
+        throw SocketException("failed to bind to address - {errno}");
+    }
+}
+
+void BeaconListener::processIncoming()
+{
+    auto now = std::chrono::steady_clock::now();
+    m_batch.receive(m_sock, [&](const unsigned char* buffer, size_t recvd, const sockaddr_in& remoteAddr) {
+        char srcIp[20] = {0};
+        ::inet_ntop(AF_INET, &remoteAddr.sin_addr, srcIp, sizeof(srcIp)-1);
+
+        auto beacons = m_protocol->parseBeacons(srcIp, {buffer, buffer + recvd});
+        for (auto& [iocIp, iocPort, beaconId]: beacons) {
+            auto it = m_iocs.find(std::make_pair(iocIp, iocPort));
+            if (it == m_iocs.end()) {
+                m_iocs[std::make_pair(iocIp, iocPort)] = {beaconId, now};
+                if (now > m_learnUntil) {
+                    LOG_VERBOSE("Received first beacon from IOC ", DnsCache::resolveIP(iocIp), ":", iocPort);
+                    m_iocStartedCb(iocIp, iocPort);
+                }
+                continue;
+            }
+
+            // Beacon IDs start from 0 when IOC starts, they only go back after
+            // a restart or after wrapping around
+            auto restarted = (beaconId < it->second.beaconId && (it->second.beaconId - beaconId) < UINT32_MAX/2);
+            it->second = {beaconId, now};
+            if (restarted) {
+                LOG_VERBOSE("Beacon ID of IOC ", DnsCache::resolveIP(iocIp), ":", iocPort, " was reset, IOC restarted");
+                m_iocStartedCb(iocIp, iocPort);
+            }
+        }
+    });
+}
+
+void BeaconListener::processOutgoing()
+{
+    auto now = std::chrono::steady_clock::now();
+    if ((now - m_lastExpire) < EXPIRE_CHECK) {
+        wakeupAt(m_lastExpire + EXPIRE_CHECK);
+        return;
+    }
+    m_lastExpire = now;
+    wakeupAt(now + EXPIRE_CHECK);
+
+    for (auto it = m_iocs.begin(); it != m_iocs.end(); ) {
+        if ((now - it->second.lastSeen) > EXPIRE_PERIOD) {
+            LOG_DEBUG("Forgetting IOC ", DnsCache::resolveIP(it->first.first), ":", it->first.second, ", no beacons for ", EXPIRE_PERIOD.count(), " seconds");
+            it = m_iocs.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
@@ -0,0 +1,103 @@
+/**
+ * @file beacon.hpp
+ * @brief Detects IOCs starting up from their beacons.
+ */
+
+#pragma once
+
+#include "connection.hpp"
+#include "proto.hpp"
+#include "udpbatch.hpp"
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+/**
+ * @class BeaconListener
+ * @brief UDP listener for beacons periodically broadcasted by IOCs.
+ *
+ * Every IOC announces itself with beacons carrying an incrementing beacon ID.
+ * A beacon from an IOC that wasn't heard from before, or a beacon ID going
+ * backwards, means that an IOC was (re)started and any PVs still being searched
+ * for may now be available.
+ *
+ * IOCs heard during the initial learning period are assumed to have been running
+ * before. Entries of IOCs silent for a long time are forgotten, so an IOC coming
+ * back after a long outage is detected as a new one.
+ */
+class BeaconListener : public Connection {
+    public:
+        /**
+         * @brief Callback invoked when a new or restarted IOC is detected.
+         * @param iocIp The IP address of the IOC.
+         * @param iocPort The TCP port of the IOC.
+         */
+        typedef std::function<void(const std::string& iocIp, uint16_t iocPort)> IocStartedCb;
+
+        /**
+         * @brief Time after start during which all IOCs are just being learned.
+         * Default CA beacon period is 15 seconds.
+         */
+        static constexpr std::chrono::seconds LEARNING_PERIOD{20};
+
+        /**
+         * @brief Time after which a silent IOC is forgotten.
+         */
+        static constexpr std::chrono::seconds EXPIRE_PERIOD{120};
+
+        /**
+         * @brief How often silent IOCs are looked for.
+         */
+        static constexpr std::chrono::seconds EXPIRE_CHECK{10};
+
+    private:
+        typedef std::pair<std::string, uint16_t> Address;
+
+        /**
+         * @struct IocBeacon
+         * @brief Last beacon received from an IOC.
+         */
+        struct IocBeacon {
+            uint32_t beaconId;                              ///< ID of the last beacon.
+            std::chrono::steady_clock::time_point lastSeen; ///< Time of the last beacon.
+        };
+
+        std::shared_ptr<Protocol> m_protocol;
+        IocStartedCb m_iocStartedCb;
+        UdpBatch m_batch;
+        std::map<Address, IocBeacon> m_iocs;
+        std::chrono::steady_clock::time_point m_learnUntil;
+        std::chrono::steady_clock::time_point m_lastExpire;
+
+    public:
+        /**
+         * @brief Constructs a BeaconListener.
+         *
+         * Beacon port is typically shared with the CA repeater running on the same
+         * host, socket is bound with address reuse enabled.
+         *
+         * @param ip The local IP address to bind to.
+         * @param port The local UDP port to bind to, CA beacons are sent to port 5065.
+         * @param protocol Shared pointer to the protocol implementation (CA).
+         * @param cb Callback invoked for every new or restarted IOC.
+         */
+        BeaconListener(const std::string& ip, uint16_t port, const std::shared_ptr<Protocol>& protocol, IocStartedCb& cb);
+
+        /**
+         * @brief Processes received beacons.
+         *
+         * Compares every beacon with the IOC's previous one and invokes
+         * the callback when the IOC appears to have (re)started.
+         */
+        void processIncoming();
+
+        /**
+         * @brief Forgets IOCs that haven't sent beacons for a long time.
+         *
+         * Runs every EXPIRE_CHECK, invocations in between only reschedule.
+         */
+        void processOutgoing();
+};
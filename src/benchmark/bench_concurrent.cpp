@@ -0,0 +1,132 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "unittest/catch.hpp"
+
+#include "concurrentcache.hpp"
+#include "pvcache.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static constexpr size_t N_PVS = 100000;
+static constexpr size_t LOOKUPS_PER_THREAD = 100000;
+
+static std::vector<std::string> generateNames(size_t n, const std::string& prefix)
+{
+    std::vector<std::string> names;
+    names.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        names.emplace_back(prefix + ":SUBSYS" + std::to_string(i % 97) + ":DEVICE" + std::to_string(i) + ":VAL");
+    }
+    return names;
+}
+
+/**
+ * Runs readers doing a fixed number of lookups each, while a writer keeps
+ * adding and removing PVs until the readers are done, like IOCs connecting
+ * and disconnecting. Returns number of lookups that found the PV.
+ */
+template <typename Lookup, typename Write>
+static size_t runThreads(unsigned nReaders, bool withWriter, const std::vector<std::string>& names, Lookup&& lookup, Write&& write)
+{
+    std::atomic<unsigned> nRunning{nReaders};
+    std::atomic<size_t> nFound{0};
+    std::vector<std::thread> threads;
+    for (unsigned t = 0; t < nReaders; t++) {
+        threads.emplace_back([&, t]() {
+            Protocol::Bytes reply;
+            size_t found = 0;
+            for (size_t i = 0; i < LOOKUPS_PER_THREAD; i++) {
+                found += lookup(names[(i * 7 + t * 13) % names.size()], reply);
+            }
+            nFound += found;
+            nRunning--;
+        });
+    }
+    if (withWriter) {
+        threads.emplace_back([&]() {
+            for (size_t i = 0; nRunning > 0; i++) {
+                write(i);
+            }
+        });
+    }
+    for (auto& thread: threads) {
+        thread.join();
+    }
+    return nFound;
+}
+
+static void benchmarkConcurrent(unsigned nReaders, bool withWriter)
+{
+    Protocol::Bytes response(24, 0);
+    auto names = generateNames(N_PVS, "CACHED");
+    auto churn = generateNames(10000, "CHURN");
+    auto label = std::to_string(nReaders) + " readers" + (withWriter ? " + writer" : "") + ", " + std::to_string(LOOKUPS_PER_THREAD) + " lookups each";
+
+    {
+        ConcurrentPvCache cache;
+        for (auto& pvname: names) {
+            cache.insert(pvname, response);
+        }
+        BENCHMARK("ConcurrentPvCache, " + label) {
+            return runThreads(nReaders, withWriter, names,
+                [&cache](const std::string& pvname, Protocol::Bytes& reply) {
+                    return cache.find(pvname, reply);
+                },
+                [&cache, &churn, &response](size_t i) {
+                    auto& pvname = churn[i % churn.size()];
+                    if ((i / churn.size()) % 2 == 0) {
+                        cache.insert(pvname, response);
+                    } else {
+                        cache.erase(pvname);
+                    }
+                });
+        };
+    }
+
+    // Baseline, single cache guarded by a readers-writer lock
+    {
+        PvCache cache;
+        std::shared_mutex mutex;
+        auto ioc = cache.addIoc(nullptr);
+        cache.getIoc(ioc).reply = response;
+        for (auto& pvname: names) {
+            cache.setIoc(cache.insert(pvname), ioc);
+        }
+        BENCHMARK("PvCache with shared_mutex, " + label) {
+            return runThreads(nReaders, withWriter, names,
+                [&cache, &mutex](const std::string& pvname, Protocol::Bytes& reply) {
+                    std::shared_lock<std::shared_mutex> lock(mutex);
+                    auto pv = cache.peek(pvname);
+                    if (pv == nullptr) {
+                        return false;
+                    }
+                    auto& iocReply = cache.getIoc(pv->ioc).reply;
+                    reply.assign(iocReply.begin(), iocReply.end());
+                    return true;
+                },
+                [&cache, &mutex, &churn, ioc](size_t i) {
+                    auto& pvname = churn[i % churn.size()];
+                    std::unique_lock<std::shared_mutex> lock(mutex);
+                    if ((i / churn.size()) % 2 == 0) {
+                        cache.setIoc(cache.insert(pvname), ioc);
+                    } else {
+                        cache.erase(pvname);
+                    }
+                });
+        };
+    }
+}
+
+TEST_CASE("Concurrent PV cache lookups, 1 reader", "[concurrent]") {
+    benchmarkConcurrent(1, false);
+    benchmarkConcurrent(1, true);
+}
+
+TEST_CASE("Concurrent PV cache lookups, 4 readers", "[concurrent]") {
+    benchmarkConcurrent(4, false);
+    benchmarkConcurrent(4, true);
+}
@@ -0,0 +1,88 @@
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "unittest/catch.hpp"
+
+#include "pvcache.hpp"
+
+#include <map>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> generateNames(size_t n, const std::string& prefix)
+{
+    std::vector<std::string> names;
+    names.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        names.emplace_back(prefix + ":SUBSYS" + std::to_string(i % 97) + ":DEVICE" + std::to_string(i) + ":VAL");
+    }
+    return names;
+}
+
+static void benchmarkLookups(size_t n, const std::string& label)
+{
+    // CA search reply is a 24 bytes header
+    Protocol::Bytes response(24, 0);
+    auto cached = generateNames(n, "CACHED");
+    auto missing = generateNames(std::min<size_t>(n, 1000000), "MISSING");
+
+    {
+        // Spread PVs over a few IOCs
+        PvCache cache;
+        std::vector<uint32_t> iocs;
+        for (size_t i = 0; i < 100; i++) {
+            iocs.push_back(cache.addIoc(nullptr));
+            cache.getIoc(iocs.back()).reply = response;
+        }
+        for (size_t i = 0; i < n; i++) {
+            cache.setIoc(cache.insert(cached[i]), iocs[i % iocs.size()]);
+        }
+        REQUIRE(cache.size() == n);
+
+        size_t i = 0;
+        BENCHMARK("PvCache hit, " + label) {
+            return cache.getIoc(cache.find(cached[i++ % n])->ioc).reply.size();
+        };
+        i = 0;
+        BENCHMARK("PvCache miss, " + label) {
+            return cache.find(missing[i++ % missing.size()]);
+        };
+    }
+
+    // Baseline, what the Dispatcher used before
+    {
+        struct PvInfo {
+            std::shared_ptr<IocGuard> ioc;
+            Protocol::Bytes response;
+            uint16_t udpPort = 0;
+            bool unverified = false;
+        };
+        std::map<std::string, PvInfo> cache;
+        for (auto& pvname: cached) {
+            cache[pvname].response = response;
+        }
+
+        size_t i = 0;
+        BENCHMARK("std::map hit, " + label) {
+            return cache.at(cached[i++ % n]).response;
+        };
+        i = 0;
+        BENCHMARK("std::map miss, " + label) {
+            try {
+                return cache.at(missing[i++ % missing.size()]).response;
+            } catch (std::out_of_range&) {
+                return Protocol::Bytes();
+            }
+        };
+    }
+}
+
+TEST_CASE("PV cache lookups with 100k PVs", "[pvcache]") {
+    benchmarkLookups(100000, "100k PVs");
+}
+
+TEST_CASE("PV cache lookups with 1M PVs", "[pvcache]") {
+    benchmarkLookups(1000000, "1M PVs");
+}
+
+TEST_CASE("PV cache lookups with 10M PVs", "[pvcache]") {
+    benchmarkLookups(10000000, "10M PVs");
+}
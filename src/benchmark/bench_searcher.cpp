@@ -0,0 +1,56 @@
+#define CATCH_CONFIG_MAIN  // This tells Catch to provide a main() - only do this in one cpp file
+#define CATCH_CONFIG_ENABLE_BENCHMARKING
+#include "unittest/catch.hpp"
+
+#include "proto_ca.hpp"
+#include "searcher.hpp"
+
+#include <string>
+#include <vector>
+
+static std::vector<std::string> generateNames(size_t n, const std::string& prefix)
+{
+    std::vector<std::string> names;
+    names.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        names.emplace_back(prefix + ":SUBSYS" + std::to_string(i % 97) + ":DEVICE" + std::to_string(i) + ":VAL");
+    }
+    return names;
+}
+
+TEST_CASE("Searcher with 1M pending PVs", "[searcher]") {
+    static const size_t N = 1000000;
+    Searcher::PvFoundCb cb = [](const std::string &, const std::string &, uint16_t, uint16_t, const Protocol::Bytes &) {};
+    Searcher searcher({{"127.0.0.1", 5064, 1500}}, {1, 5, 10, 30, 60, 300}, std::make_shared<ChannelAccess>(), cb);
+
+    auto pending = generateNames(N, "PENDING");
+    auto fresh = generateNames(N, "FRESH");
+
+    for (auto& pvname: pending) {
+        searcher.addPV(pvname);
+    }
+    REQUIRE(searcher.size() == N);
+
+    size_t i = 0;
+    BENCHMARK("addPV() touching a pending PV") {
+        return searcher.addPV(pending[i++ % N]);
+    };
+
+    i = 0;
+    BENCHMARK("addPV() + removePV() of a new PV") {
+        auto& pvname = fresh[i++ % N];
+        searcher.addPV(pvname);
+        searcher.removePV(pvname);
+    };
+
+    i = 0;
+    BENCHMARK("removePV() of an unknown PV") {
+        searcher.removePV(fresh[i++ % N]);
+    };
+
+    BENCHMARK("purgeStep() of 10000 slots") {
+        return searcher.purgeStep(600, 10000);
+    };
+
+    REQUIRE(searcher.size() == N);
+}
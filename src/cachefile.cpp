@@ -0,0 +1,374 @@
+#include "cachefile.hpp"
+#include "logging.hpp"
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+static uint32_t const SNAPSHOT_MAGIC   = 0x504d4353; // "PMCS"
+static uint32_t const SNAPSHOT_VERSION = 1;
+
+static uint8_t const JOURNAL_ADD    = 1;
+static uint8_t const JOURNAL_REMOVE = 2;
+
+// Files are only read by the same host, all fields are in host byte order
+// except IP addresses. Magic number detects any mismatch.
+struct SnapshotHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t count;
+    uint32_t reserved;
+    uint64_t dataSize;
+};
+
+struct SnapshotRecord {
+    uint64_t offset;        // Offset of the name in the data area, response follows the name
+    uint32_t iocIp;
+    uint16_t iocPort;
+    uint16_t udpPort;
+    uint16_t nameLen;
+    uint16_t responseLen;
+    uint32_t reserved;
+};
+
+struct JournalRecord {
+    uint32_t checksum;      // Covers the rest of the record, name and response
+    uint8_t op;
+    uint8_t reserved;
+    uint16_t nameLen;
+    uint16_t responseLen;
+    uint16_t iocPort;
+    uint16_t udpPort;
+    uint16_t reserved2;
+    uint32_t iocIp;
+};
+
+static uint32_t checksum(const unsigned char* data, size_t len, uint32_t hash = 2166136261u)
+{
+    // FNV-1a
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static std::string ipToString(uint32_t ip)
+{
+    char buf[20] = {0};
+    ::inet_ntop(AF_INET, &ip, buf, sizeof(buf)-1);
+    return buf;
+}
+
+static uint32_t ipFromString(const std::string& ip)
+{
+    in_addr addr = {};
+    ::inet_aton(ip.c_str(), &addr);
+    return addr.s_addr;
+}
+
+CacheFile::CacheFile(const std::string& path)
+    : m_path(path)
+    , m_journalPath(path + ".journal")
+    , m_newJournalPath(path + ".journal.new")
+{
+    // Snapshot was not completed last time, keep appending to the journal replayed last
+    m_rotated = (::access(m_newJournalPath.c_str(), F_OK) == 0);
+}
+
+CacheFile::~CacheFile()
+{
+    waitSnapshot();
+    if (m_journal) {
+        ::fclose(m_journal);
+    }
+    if (m_snapshot) {
+        ::fclose(m_snapshot);
+        ::unlink((m_path + ".tmp").c_str());
+    }
+}
+
+size_t CacheFile::load(const LoadCb& cb)
+{
+    auto nEntries = loadSnapshot(cb);
+    auto nRecords = loadJournal(m_journalPath, cb) + loadJournal(m_newJournalPath, cb);
+    LOG_INFO("Loaded ", nEntries, " PVs from cache snapshot ", m_path, " and ", nRecords, " changes from journal");
+    return nEntries + nRecords;
+}
+
+size_t CacheFile::loadSnapshot(const LoadCb& cb)
+{
+    int fd = ::open(m_path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            LOG_ERROR("Failed to open cache snapshot ", m_path, " - ", strerror(errno));
+        }
+        return 0;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SnapshotHeader)) {
+        ::close(fd);
+        return 0;
+    }
+    size_t size = static_cast<size_t>(st.st_size);
+    auto map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        LOG_ERROR("Failed to map cache snapshot ", m_path, " - ", strerror(errno));
+        return 0;
+    }
+
+    size_t nEntries = 0;
+    auto base = static_cast<const unsigned char*>(map);
+    auto hdr = reinterpret_cast<const SnapshotHeader*>(base);
+    size_t tableSize = static_cast<size_t>(hdr->count) * sizeof(SnapshotRecord);
+    if (hdr->magic != SNAPSHOT_MAGIC || hdr->version != SNAPSHOT_VERSION || (sizeof(SnapshotHeader) + tableSize + hdr->dataSize) != size) {
+        LOG_ERROR("Ignoring invalid cache snapshot ", m_path);
+    } else {
+        auto records = reinterpret_cast<const SnapshotRecord*>(base + sizeof(SnapshotHeader));
+        auto data = base + sizeof(SnapshotHeader) + tableSize;
+        Entry entry;
+        for (uint32_t i = 0; i < hdr->count; i++) {
+            auto& rec = records[i];
+            if (rec.offset > hdr->dataSize || (hdr->dataSize - rec.offset) < (size_t(rec.nameLen) + rec.responseLen)) {
+                continue;
+            }
+            auto name = reinterpret_cast<const char*>(data + rec.offset);
+            entry.pvname.assign(name, rec.nameLen);
+            entry.iocIp = ipToString(rec.iocIp);
+            entry.iocPort = rec.iocPort;
+            entry.udpPort = rec.udpPort;
+            entry.response.assign(data + rec.offset + rec.nameLen, rec.responseLen);
+            cb(entry);
+            nEntries++;
+        }
+    }
+
+    ::munmap(map, size);
+    return nEntries;
+}
+
+size_t CacheFile::loadJournal(const std::string& path, const LoadCb& cb)
+{
+    auto file = ::fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return 0;
+    }
+
+    Protocol::Bytes journal;
+    unsigned char buffer[4096];
+    size_t n;
+    while ((n = ::fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        journal.append(buffer, n);
+    }
+    ::fclose(file);
+
+    size_t nRecords = 0;
+    size_t offset = 0;
+    Entry entry;
+    while ((offset + sizeof(JournalRecord)) <= journal.size()) {
+        JournalRecord rec;
+        ::memcpy(&rec, journal.data() + offset, sizeof(rec));
+        size_t len = sizeof(rec) + rec.nameLen + rec.responseLen;
+        if ((offset + len) > journal.size()) {
+            break;
+        }
+        auto data = journal.data() + offset;
+        if (checksum(data + sizeof(rec.checksum), len - sizeof(rec.checksum)) != rec.checksum) {
+            break;
+        }
+
+        entry.pvname.assign(reinterpret_cast<const char*>(data + sizeof(rec)), rec.nameLen);
+        entry.iocIp = ipToString(rec.iocIp);
+        entry.iocPort = rec.iocPort;
+        entry.udpPort = rec.udpPort;
+        entry.response.clear();
+        if (rec.op == JOURNAL_ADD) {
+            entry.response.assign(data + sizeof(rec) + rec.nameLen, rec.responseLen);
+        }
+        cb(entry);
+        nRecords++;
+        offset += len;
+    }
+
+    if (offset != journal.size()) {
+        LOG_ERROR("Cache journal ", path, " is truncated or corrupted, ignored ", journal.size() - offset, " bytes");
+    }
+    return nRecords;
+}
+
+void CacheFile::appendJournal(uint8_t op, const Entry& entry)
+{
+    if (m_journal == nullptr) {
+        auto& path = (m_rotated ? m_newJournalPath : m_journalPath);
+        m_journal = ::fopen(path.c_str(), "ab");
+        if (m_journal == nullptr) {
+            LOG_ERROR("Failed to open cache journal ", path, " - ", strerror(errno));
+            return;
+        }
+    }
+
+    JournalRecord rec = {};
+    rec.op = op;
+    rec.nameLen = static_cast<uint16_t>(std::min<size_t>(entry.pvname.size(), UINT16_MAX));
+    rec.responseLen = static_cast<uint16_t>(std::min<size_t>(entry.response.size(), UINT16_MAX));
+    rec.iocPort = entry.iocPort;
+    rec.udpPort = entry.udpPort;
+    rec.iocIp = ipFromString(entry.iocIp);
+
+    auto hdr = reinterpret_cast<const unsigned char*>(&rec);
+    auto name = reinterpret_cast<const unsigned char*>(entry.pvname.data());
+    auto hash = checksum(hdr + sizeof(rec.checksum), sizeof(rec) - sizeof(rec.checksum));
+    hash = checksum(name, rec.nameLen, hash);
+    rec.checksum = checksum(entry.response.data(), rec.responseLen, hash);
+
+    ::fwrite(&rec, sizeof(rec), 1, m_journal);
+    ::fwrite(name, 1, rec.nameLen, m_journal);
+    ::fwrite(entry.response.data(), 1, rec.responseLen, m_journal);
+    m_dirty = true;
+}
+
+void CacheFile::add(const Entry& entry)
+{
+    appendJournal(JOURNAL_ADD, entry);
+}
+
+void CacheFile::remove(const std::string& pvname)
+{
+    appendJournal(JOURNAL_REMOVE, {pvname, "0.0.0.0", 0, 0, {}});
+}
+
+void CacheFile::flush()
+{
+    if (m_dirty && m_journal) {
+        ::fflush(m_journal);
+        m_dirty = false;
+    }
+}
+
+bool CacheFile::beginSnapshot()
+{
+    if (isCommitting()) {
+        LOG_ERROR("Previous cache snapshot ", m_path, " is still being written, not starting a new one");
+        return false;
+    }
+    if (m_snapshot) {
+        ::fclose(m_snapshot);
+    }
+    m_snapshot = ::fopen((m_path + ".tmp").c_str(), "wb");
+    if (m_snapshot == nullptr) {
+        LOG_ERROR("Failed to create cache snapshot ", m_path, ".tmp - ", strerror(errno));
+        return false;
+    }
+    m_snapshotRecords.clear();
+    m_snapshotData.clear();
+
+    // Snapshot may miss changes made while it's being filled, the new journal has them.
+    // After a failed snapshot it's already in use and keeps growing.
+    if (m_rotated == false) {
+        if (m_journal) {
+            ::fclose(m_journal);
+            m_journal = nullptr;
+        }
+        m_dirty = false;
+        m_rotated = true;
+    }
+    return true;
+}
+
+void CacheFile::addToSnapshot(const Entry& entry)
+{
+    if (m_snapshot == nullptr) {
+        return;
+    }
+
+    SnapshotRecord rec = {};
+    rec.offset = m_snapshotData.size();
+    rec.iocIp = ipFromString(entry.iocIp);
+    rec.iocPort = entry.iocPort;
+    rec.udpPort = entry.udpPort;
+    rec.nameLen = static_cast<uint16_t>(std::min<size_t>(entry.pvname.size(), UINT16_MAX));
+    rec.responseLen = static_cast<uint16_t>(std::min<size_t>(entry.response.size(), UINT16_MAX));
+
+    m_snapshotRecords.append(reinterpret_cast<const unsigned char*>(&rec), sizeof(rec));
+    m_snapshotData.append(reinterpret_cast<const unsigned char*>(entry.pvname.data()), rec.nameLen);
+    m_snapshotData.append(entry.response.data(), rec.responseLen);
+}
+
+bool CacheFile::commitSnapshot()
+{
+    if (m_snapshot == nullptr) {
+        return false;
+    }
+
+    // Syncing a large file takes long, don't hold up the caller
+    m_writing = true;
+    m_writer = std::thread([this, file = m_snapshot, records = std::move(m_snapshotRecords), data = std::move(m_snapshotData)]() {
+        m_written = writeSnapshot(file, m_path, records, data);
+        m_writing.store(false, std::memory_order_release);
+    });
+    m_snapshot = nullptr;
+    m_snapshotRecords = Protocol::Bytes();
+    m_snapshotData = Protocol::Bytes();
+    return true;
+}
+
+bool CacheFile::writeSnapshot(FILE* file, const std::string& path, const Protocol::Bytes& records, const Protocol::Bytes& data)
+{
+    SnapshotHeader hdr = {};
+    hdr.magic = SNAPSHOT_MAGIC;
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.count = static_cast<uint32_t>(records.size() / sizeof(SnapshotRecord));
+    hdr.dataSize = data.size();
+
+    bool ok = (::fwrite(&hdr, sizeof(hdr), 1, file) == 1);
+    ok = ok && (::fwrite(records.data(), 1, records.size(), file) == records.size());
+    ok = ok && (::fwrite(data.data(), 1, data.size(), file) == data.size());
+    ok = ok && (::fflush(file) == 0) && (::fsync(::fileno(file)) == 0);
+    ok = (::fclose(file) == 0) && ok;
+
+    auto tmpPath = path + ".tmp";
+    if (ok == false || ::rename(tmpPath.c_str(), path.c_str()) != 0) {
+        LOG_ERROR("Failed to write cache snapshot ", path, " - ", strerror(errno));
+        ::unlink(tmpPath.c_str());
+        return false;
+    }
+    LOG_VERBOSE("Saved ", hdr.count, " PVs to cache snapshot ", path);
+    return true;
+}
+
+bool CacheFile::isCommitting()
+{
+    if (m_writer.joinable() && m_writing.load(std::memory_order_acquire) == false) {
+        finishSnapshot();
+    }
+    return m_writer.joinable();
+}
+
+bool CacheFile::waitSnapshot()
+{
+    if (m_writer.joinable()) {
+        finishSnapshot();
+    }
+    return m_written;
+}
+
+void CacheFile::finishSnapshot()
+{
+    m_writer.join();
+    if (m_written == false) {
+        return;
+    }
+
+    // Everything in the old journal is now in the snapshot, open journal moves along with the rename
+    if (::rename(m_newJournalPath.c_str(), m_journalPath.c_str()) != 0) {
+        ::unlink(m_journalPath.c_str());
+    }
+    m_rotated = false;
+}
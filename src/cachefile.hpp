@@ -0,0 +1,168 @@
+/**
+ * @file cachefile.hpp
+ * @brief Persistent storage of the PV cache across restarts.
+ */
+
+#pragma once
+
+#include "proto.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+
+/**
+ * @class CacheFile
+ * @brief Saves found PVs to disk and loads them back at startup.
+ *
+ * The cache is stored in two files. The snapshot contains all cached PVs at
+ * the time it was written, a fixed size header is followed by a table of fixed
+ * size records and a data area with PV names and responses. The file is
+ * memory-mapped when loaded and records are validated against the file size.
+ * Snapshot is written to a temporary file and renamed over the old one, so it's
+ * always complete. Writing and syncing the file is done in a background thread.
+ *
+ * Changes between snapshots are appended to a journal. Journal records carry
+ * a checksum, replaying stops at the first incomplete or corrupted record.
+ * PVs are added to the snapshot while the cache keeps changing, so changes
+ * since the snapshot was started go to a new journal, replayed after the old
+ * one. Once the snapshot is written, the new journal replaces the old one.
+ */
+class CacheFile {
+    public:
+        /**
+         * @struct Entry
+         * @brief Single cached PV.
+         */
+        struct Entry {
+            std::string pvname;         ///< Name of the PV.
+            std::string iocIp;          ///< IP address of the IOC hosting the PV.
+            uint16_t iocPort;           ///< TCP port of the IOC.
+            uint16_t udpPort;           ///< UDP port where the IOC accepts searches.
+            Protocol::Bytes response;   ///< Search response returned to the clients.
+        };
+
+        /**
+         * @brief Callback invoked for every loaded PV, or PV removal when the response is empty.
+         */
+        typedef std::function<void(const Entry& entry)> LoadCb;
+
+    private:
+        std::string m_path;
+        std::string m_journalPath;
+        std::string m_newJournalPath;
+        FILE* m_journal = nullptr;
+        FILE* m_snapshot = nullptr;
+        Protocol::Bytes m_snapshotRecords;  ///< Record table of the snapshot being written.
+        Protocol::Bytes m_snapshotData;     ///< Data area of the snapshot being written.
+        bool m_dirty = false;               ///< Journal has unflushed records.
+        bool m_rotated = false;             ///< Changes go to the new journal.
+        std::thread m_writer;               ///< Writes the committed snapshot.
+        std::atomic<bool> m_writing{false};
+        bool m_written = false;             ///< Result of the last write, valid once m_writer is done.
+
+        /**
+         * @brief Appends a record to the journal, opening it if needed.
+         */
+        void appendJournal(uint8_t op, const Entry& entry);
+
+        /**
+         * @brief Writes the snapshot to the temporary file and renames it over the old one.
+         *
+         * Runs in the writer thread, touches nothing but its arguments.
+         */
+        static bool writeSnapshot(FILE* file, const std::string& path, const Protocol::Bytes& records, const Protocol::Bytes& data);
+
+        /**
+         * @brief Waits for the writer thread and replaces the old journal when the snapshot was written.
+         */
+        void finishSnapshot();
+
+        /**
+         * @brief Loads all entries from the snapshot file.
+         * @return Number of loaded entries.
+         */
+        size_t loadSnapshot(const LoadCb& cb);
+
+        /**
+         * @brief Replays the journal.
+         * @return Number of replayed records.
+         */
+        size_t loadJournal(const std::string& path, const LoadCb& cb);
+
+    public:
+        /**
+         * @brief Constructs a CacheFile, no files are touched yet.
+         * @param path Path to the snapshot file, journal is stored next to it.
+         */
+        CacheFile(const std::string& path);
+
+        ~CacheFile();
+
+        /**
+         * @brief Loads the snapshot and replays the journal on top of it.
+         *
+         * Missing files are not an error, the cache simply starts empty.
+         *
+         * @param cb Callback invoked for each loaded entry, entries with empty
+         *           response are PVs removed from the cache.
+         * @return Number of entries and journal records processed.
+         */
+        size_t load(const LoadCb& cb);
+
+        /**
+         * @brief Records a found PV in the journal.
+         */
+        void add(const Entry& entry);
+
+        /**
+         * @brief Records a removed PV in the journal.
+         */
+        void remove(const std::string& pvname);
+
+        /**
+         * @brief Writes out buffered journal records, if any.
+         */
+        void flush();
+
+        /**
+         * @brief Starts writing a new snapshot to a temporary file.
+         *
+         * Further changes are journaled separately, until the snapshot is written.
+         *
+         * @return False if the file could not be created or the previous snapshot is still being written.
+         */
+        bool beginSnapshot();
+
+        /**
+         * @brief Adds a PV to the snapshot being written.
+         */
+        void addToSnapshot(const Entry& entry);
+
+        /**
+         * @brief Completes the snapshot, it's written in the background.
+         *
+         * Once written, the snapshot replaces the old one and the journal only
+         * keeps changes since beginSnapshot(). When it could not be written, old
+         * snapshot and both journals are kept.
+         *
+         * @return False if no snapshot was started.
+         */
+        bool commitSnapshot();
+
+        /**
+         * @brief Checks whether the committed snapshot is still being written.
+         *
+         * Finishes the snapshot when writing is done, should be called periodically.
+         */
+        bool isCommitting();
+
+        /**
+         * @brief Waits until the committed snapshot is written.
+         * @return False if the snapshot could not be written.
+         */
+        bool waitSnapshot();
+};
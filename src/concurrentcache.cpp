@@ -0,0 +1,183 @@
+#include "concurrentcache.hpp"
+
+#include <chrono>
+#include <functional>
+
+ConcurrentPvCache::Node ConcurrentPvCache::s_tombstone;
+
+ConcurrentPvCache::Table::Table(size_t nBuckets)
+    : mask(nBuckets - 1)
+    , buckets(new std::atomic<Node*>[nBuckets])
+{
+    for (size_t i = 0; i < nBuckets; i++) {
+        buckets[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ConcurrentPvCache::ConcurrentPvCache()
+{
+    for (auto& shard: m_shards) {
+        shard.table.store(new Table(MIN_BUCKETS));
+    }
+}
+
+ConcurrentPvCache::~ConcurrentPvCache()
+{
+    for (auto& shard: m_shards) {
+        auto table = shard.table.load();
+        for (size_t i = 0; i <= table->mask; i++) {
+            auto node = table->buckets[i].load();
+            if (node != nullptr && node != &s_tombstone) {
+                delete node;
+            }
+        }
+        delete table;
+    }
+}
+
+uint64_t ConcurrentPvCache::hash(std::string_view pvname)
+{
+    // Shard is selected by the upper bits, spread them even where std::hash doesn't
+    return std::hash<std::string_view>()(pvname) * 0x9e3779b97f4a7c15ull;
+}
+
+size_t ConcurrentPvCache::findBucket(const Table* table, std::string_view pvname, uint64_t h)
+{
+    for (size_t pos = (h & table->mask); ; pos = ((pos + 1) & table->mask)) {
+        auto node = table->buckets[pos].load(std::memory_order_relaxed);
+        if (node == nullptr) {
+            return table->mask + 1;
+        }
+        if (node != &s_tombstone && node->hash == h && node->pvname == pvname) {
+            return pos;
+        }
+    }
+}
+
+void ConcurrentPvCache::rehash(Shard& shard, size_t nBuckets)
+{
+    // Nodes are shared by both tables, readers of the old one still find them
+    auto oldTable = shard.table.load(std::memory_order_relaxed);
+    auto newTable = new Table(nBuckets);
+    for (size_t i = 0; i <= oldTable->mask; i++) {
+        auto node = oldTable->buckets[i].load(std::memory_order_relaxed);
+        if (node == nullptr || node == &s_tombstone) {
+            continue;
+        }
+        auto pos = (node->hash & newTable->mask);
+        while (newTable->buckets[pos].load(std::memory_order_relaxed) != nullptr) {
+            pos = ((pos + 1) & newTable->mask);
+        }
+        newTable->buckets[pos].store(node, std::memory_order_relaxed);
+    }
+    shard.table.store(newTable, std::memory_order_release);
+    shard.deleted = 0;
+    m_epoch.retire(oldTable);
+}
+
+void ConcurrentPvCache::insert(const std::string& pvname, const Protocol::Bytes& reply, std::atomic<bool>* referenced, std::atomic<uint32_t>* lastLookup)
+{
+    auto h = hash(pvname);
+    auto& shard = shardOf(h);
+    auto node = new Node{h, pvname, reply, referenced, lastLookup};
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto table = shard.table.load(std::memory_order_relaxed);
+    auto pos = findBucket(table, pvname, h);
+    if (pos <= table->mask) {
+        auto oldNode = table->buckets[pos].load(std::memory_order_relaxed);
+        table->buckets[pos].store(node, std::memory_order_release);
+        m_epoch.retire(oldNode);
+        return;
+    }
+
+    // Probe sequences get long when buckets, including tombstones, are over 3/4 full
+    auto size = shard.size.load(std::memory_order_relaxed);
+    if (4 * (size + shard.deleted + 1) > 3 * (table->mask + 1)) {
+        auto nBuckets = table->mask + 1;
+        while (2 * (size + 1) > nBuckets) {
+            nBuckets <<= 1;
+        }
+        rehash(shard, nBuckets);
+        table = shard.table.load(std::memory_order_relaxed);
+    }
+
+    // Reuse the first tombstone on the way
+    pos = (h & table->mask);
+    while (true) {
+        auto bucket = table->buckets[pos].load(std::memory_order_relaxed);
+        if (bucket == nullptr) {
+            break;
+        }
+        if (bucket == &s_tombstone) {
+            shard.deleted--;
+            break;
+        }
+        pos = ((pos + 1) & table->mask);
+    }
+    table->buckets[pos].store(node, std::memory_order_release);
+    shard.size.store(size + 1, std::memory_order_relaxed);
+}
+
+bool ConcurrentPvCache::erase(std::string_view pvname)
+{
+    auto h = hash(pvname);
+    auto& shard = shardOf(h);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+
+    auto table = shard.table.load(std::memory_order_relaxed);
+    auto pos = findBucket(table, pvname, h);
+    if (pos > table->mask) {
+        return false;
+    }
+    auto node = table->buckets[pos].load(std::memory_order_relaxed);
+
+    // Tombstone is not needed when the next bucket ends the probing anyway
+    if (table->buckets[(pos + 1) & table->mask].load(std::memory_order_relaxed) == nullptr) {
+        table->buckets[pos].store(nullptr, std::memory_order_release);
+    } else {
+        table->buckets[pos].store(&s_tombstone, std::memory_order_release);
+        shard.deleted++;
+    }
+    shard.size.fetch_sub(1, std::memory_order_relaxed);
+    m_epoch.retire(node);
+    return true;
+}
+
+bool ConcurrentPvCache::find(std::string_view pvname, Protocol::Bytes& reply) const
+{
+    auto h = hash(pvname);
+    auto& shard = shardOf(h);
+    EpochDomain::Guard guard(m_epoch);
+
+    auto table = shard.table.load(std::memory_order_acquire);
+    for (size_t pos = (h & table->mask); ; pos = ((pos + 1) & table->mask)) {
+        auto node = table->buckets[pos].load(std::memory_order_acquire);
+        if (node == nullptr) {
+            return false;
+        }
+        if (node != &s_tombstone && node->hash == h && node->pvname == pvname) {
+            reply.assign(node->reply.begin(), node->reply.end());
+            if (node->referenced != nullptr) {
+                node->referenced->store(true, std::memory_order_relaxed);
+            }
+            if (node->lastLookup != nullptr) {
+                // Shared with the main thread, written once a second at most
+                auto now = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+                if (node->lastLookup->load(std::memory_order_relaxed) != now) {
+                    node->lastLookup->store(now, std::memory_order_relaxed);
+                }
+            }
+            return true;
+        }
+    }
+}
+
+size_t ConcurrentPvCache::size() const
+{
+    size_t size = 0;
+    for (auto& shard: m_shards) {
+        size += shard.size.load(std::memory_order_relaxed);
+    }
+    return size;
+}
@@ -0,0 +1,143 @@
+/**
+ * @file concurrentcache.hpp
+ * @brief Cache of search replies that can be read from many threads without locking.
+ */
+
+#pragma once
+
+#include "epoch.hpp"
+#include "proto.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+
+/**
+ * @class ConcurrentPvCache
+ * @brief Sharded hash table mapping PV names to search replies, with lock-free lookups.
+ *
+ * PVs are spread over shards by the upper bits of their hash. Every shard is
+ * an open-addressed table with linear probing, buckets point to immutable
+ * nodes. Writers serialize on the shard mutex, so writers to different shards
+ * don't block each other. Readers never lock: they load the table and node
+ * pointers atomically and the nodes they may be reading are only freed once
+ * they are done, through epoch based reclamation. Replacing a PV publishes a
+ * new node, growing a shard publishes a new table with the same nodes.
+ */
+class ConcurrentPvCache {
+    private:
+        static constexpr unsigned SHARD_BITS = 6;
+        static constexpr size_t SHARDS = (1 << SHARD_BITS);
+        static constexpr size_t MIN_BUCKETS = 16;
+
+        /**
+         * @struct Node
+         * @brief Cached PV, never modified once published.
+         */
+        struct Node {
+            uint64_t hash;
+            std::string pvname;
+            Protocol::Bytes reply;
+            std::atomic<bool>* referenced;  ///< Flag set by every lookup, owned by the caller, or nullptr.
+            std::atomic<uint32_t>* lastLookup;  ///< Time of the last lookup, owned by the caller, or nullptr.
+        };
+
+        /**
+         * @struct Table
+         * @brief Power of 2 array of node pointers, nullptr for empty buckets.
+         */
+        struct Table {
+            size_t mask;
+            std::unique_ptr<std::atomic<Node*>[]> buckets;
+
+            Table(size_t nBuckets);
+        };
+
+        /**
+         * @struct Shard
+         * @brief Independently locked part of the cache, one per cache line.
+         */
+        struct alignas(64) Shard {
+            std::mutex mutex;               ///< Serializes writers.
+            std::atomic<Table*> table;
+            std::atomic<size_t> size{0};    ///< Number of PVs, read without locking.
+            size_t deleted = 0;             ///< Number of tombstones, guarded by mutex.
+        };
+
+        static Node s_tombstone;            ///< Marks removed nodes, doesn't end probing.
+
+        Shard m_shards[SHARDS];
+        mutable EpochDomain m_epoch;
+
+        /**
+         * @brief Calculates the hash of the PV name.
+         */
+        static uint64_t hash(std::string_view pvname);
+
+        /**
+         * @brief Returns the shard of the hash.
+         */
+        Shard& shardOf(uint64_t h) { return m_shards[h >> (64 - SHARD_BITS)]; }
+        const Shard& shardOf(uint64_t h) const { return m_shards[h >> (64 - SHARD_BITS)]; }
+
+        /**
+         * @brief Finds the bucket pointing to the PV, shard must be locked.
+         * @return Bucket position, or table size when not found.
+         */
+        static size_t findBucket(const Table* table, std::string_view pvname, uint64_t h);
+
+        /**
+         * @brief Publishes a new table of the given size without tombstones, shard must be locked.
+         */
+        void rehash(Shard& shard, size_t nBuckets);
+
+    public:
+        ConcurrentPvCache();
+
+        /**
+         * @brief Frees all nodes, there must be no readers left.
+         */
+        ~ConcurrentPvCache();
+
+        /**
+         * @brief Adds the PV or replaces its reply.
+         *
+         * @param pvname The name of the PV.
+         * @param reply Search reply returned by find().
+         * @param referenced Flag to set on every lookup of the PV, ie. to feed eviction of the caller's cache.
+         *                   Must stay valid as long as the PV is cached.
+         * @param lastLookup Set to the time of every lookup in steady clock seconds, like PvCache::lookupTime().
+         *                   Must stay valid as long as the PV is cached.
+         */
+        void insert(const std::string& pvname, const Protocol::Bytes& reply, std::atomic<bool>* referenced = nullptr, std::atomic<uint32_t>* lastLookup = nullptr);
+
+        /**
+         * @brief Removes the PV from the cache.
+         * @return True if the PV was cached.
+         */
+        bool erase(std::string_view pvname);
+
+        /**
+         * @brief Looks up the PV, can be called from any thread without locking.
+         *
+         * @param pvname The name of the PV.
+         * @param reply Filled with the search reply when found.
+         * @return True when the PV was found.
+         */
+        bool find(std::string_view pvname, Protocol::Bytes& reply) const;
+
+        /**
+         * @brief Returns number of cached PVs.
+         */
+        size_t size() const;
+
+        /**
+         * @brief Frees removed PVs no reader can be using anymore.
+         *
+         * Happens during writes too, needs to be called only when writes stop.
+         */
+        void reclaim() { m_epoch.reclaim(); }
+};
@@ -49,7 +49,31 @@ void Config::parseFile(const std::string& path)
     std::regex reSearchInt   ("^[ \t]*SEARCH_INTERVALS[= \t]+([0-9, ]+)[ \t]*(#.*)?$");
     std::regex rePurgeDelay  ("^[ \t]*PURGE_DELAY[= \t]+([0-9]+)[ \t]*(#.*)?$");
     std::regex reCaListenAddr("^[ \t]*CA_LISTEN_ADDRESS[= \t]+([0-9]{1,3}(\\.[0-9]{1,3}){3})(:([0-9]{1,5}))?");
-    std::regex reCaSearchAddr("^[ \t]*CA_SEARCH_ADDRESS[= \t]+([0-9]{1,3}(\\.[0-9]{1,3}){3})(:([0-9]{1,5}))?");
+    std::regex reCaSearchAddr("^[ \t]*CA_SEARCH_ADDRESS[= \t]+([0-9]{1,3}(\\.[0-9]{1,3}){3})(:([0-9]{1,5}))?([ \t]+MTU=([0-9]+))?");
+    std::regex reCaBeaconAddr("^[ \t]*CA_BEACON_ADDRESS[= \t]+([0-9]{1,3}(\\.[0-9]{1,3}){3})(:([0-9]{1,5}))?");
+    std::regex reCaBeaconNone("^[ \t]*CA_BEACON_ADDRESS[= \t]+none[ \t]*(#.*)?$");
+    std::regex reBeaconHoldoff("^[ \t]*BEACON_HOLDOFF[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reCacheFile   ("^[ \t]*CACHE_FILE[= \t]+([^# \t]*)[ \t]*(#.*)?$");
+    std::regex reCacheSave   ("^[ \t]*CACHE_SAVE_INTERVAL[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reNegCacheSize("^[ \t]*NEGATIVE_CACHE_SIZE[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reNegCacheTtl ("^[ \t]*NEGATIVE_CACHE_TTL[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reMaxCached   ("^[ \t]*MAX_CACHED_PVS[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reMaxSearched ("^[ \t]*MAX_SEARCHED_PVS[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reUdpBatch    ("^[ \t]*UDP_BATCH_SIZE[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reSearchMtu   ("^[ \t]*SEARCH_MTU[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reSearchPkts  ("^[ \t]*SEARCH_RATE_PACKETS[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reSearchBytes ("^[ \t]*SEARCH_RATE_BYTES[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reListenThr   ("^[ \t]*LISTEN_THREADS[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reListenCpus  ("^[ \t]*LISTEN_CPUS[= \t]+([0-9, ]+)[ \t]*(#.*)?$");
+    std::regex reIoBackend   ("^[ \t]*IO_BACKEND[= \t]+([^# \t]*)[ \t]*(#.*)?$");
+    std::regex reIocLiveness ("^[ \t]*IOC_LIVENESS[= \t]+([^# \t]*)[ \t]*(#.*)?$");
+    std::regex reEchoInterval("^[ \t]*IOC_ECHO_INTERVAL[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reEchoMissed  ("^[ \t]*IOC_ECHO_MAX_MISSED[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reConnLimit   ("^[ \t]*IOC_CONNECT_LIMIT[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reConnRate    ("^[ \t]*IOC_CONNECT_RATE[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reConnBackoff ("^[ \t]*IOC_CONNECT_BACKOFF[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reGracePeriod ("^[ \t]*IOC_GRACE_PERIOD[= \t]+([0-9]+)[ \t]*(#.*)?$");
+    std::regex reOrphanSearch("^[ \t]*ORPHAN_SEARCH[= \t]+([^# \t]*)[ \t]*(#.*)?$");
 
     auto toLower = [](const std::string& s) {
         std::string o;
@@ -127,12 +151,130 @@ void Config::parseFile(const std::string& path)
             auto tmp = std::atol(tokens[4].str().c_str());
             if (tmp > 0 && tmp < 65535) {
                 ca_search_addresses.emplace_back(addr, tmp);
+                if (tokens[6].matched) {
+                    auto mtu = std::atol(tokens[6].str().c_str());
+                    if (mtu >= 576 && mtu <= 65535) { ca_search_mtus[ca_search_addresses.back()] = static_cast<unsigned>(mtu); }
+                    else { fprintf(stderr, "ERROR: Invalid config value CA_SEARCH_ADDRESS MTU=%s\n", tokens[6].str().c_str()); }
+                }
             }
 
+        } else if (std::regex_match(line, tokens, reCacheFile)) {
+            cache_file = tokens[1].str();
+
+        } else if (std::regex_match(line, tokens, reCacheSave)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp > 0) { cache_save_interval = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value CACHE_SAVE_INTERVAL=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reNegCacheSize)) {
+            negative_cache_size = static_cast<unsigned>(std::atol(tokens[1].str().c_str()));
+
+        } else if (std::regex_match(line, tokens, reNegCacheTtl)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp > 0) { negative_cache_ttl = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value NEGATIVE_CACHE_TTL=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reMaxCached)) {
+            max_cached_pvs = std::strtoul(tokens[1].str().c_str(), nullptr, 10);
+
+        } else if (std::regex_match(line, tokens, reMaxSearched)) {
+            max_searched_pvs = std::strtoul(tokens[1].str().c_str(), nullptr, 10);
+
+        } else if (std::regex_match(line, tokens, reCaBeaconNone)) {
+            ca_beacons_enabled = false;
+
+        } else if (std::regex_match(line, tokens, reCaBeaconAddr)) {
+            auto addr = tokens[1].str();
+            auto tmp = std::atol(tokens[4].str().c_str());
+            if (tmp > 0 && tmp < 65535) {
+                ca_beacon_addresses.emplace_back(addr, tmp);
+            }
+
+        } else if (std::regex_match(line, tokens, reBeaconHoldoff)) {
+            beacon_holdoff = static_cast<unsigned>(std::atol(tokens[1].str().c_str()));
+
+        } else if (std::regex_match(line, tokens, reUdpBatch)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp >= 0 && tmp <= 1024) { udp_batch_size = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value UDP_BATCH_SIZE=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reSearchMtu)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp >= 576 && tmp <= 65535) { search_mtu = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value SEARCH_MTU=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reSearchPkts)) {
+            search_rate_packets = std::strtoul(tokens[1].str().c_str(), nullptr, 10);
+
+        } else if (std::regex_match(line, tokens, reSearchBytes)) {
+            search_rate_bytes = std::strtoul(tokens[1].str().c_str(), nullptr, 10);
+
+        } else if (std::regex_match(line, tokens, reListenThr)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp >= 0 && tmp <= 256) { listen_threads = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value LISTEN_THREADS=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reListenCpus)) {
+            listen_cpus = parseListUnsigned(tokens[1].str());
+            if (listen_cpus.empty()) {
+                fprintf(stderr, "ERROR: Invalid config value LISTEN_CPUS=%s\n", tokens[1].str().c_str());
+            }
+
+        } else if (std::regex_match(line, tokens, reIoBackend)) {
+            if      (toLower(tokens[1].str()) == "epoll")    { io_uring = false; }
+            else if (toLower(tokens[1].str()) == "io_uring") { io_uring = true; }
+            else { fprintf(stderr, "ERROR: Invalid config value IO_BACKEND=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reIocLiveness)) {
+            if      (toLower(tokens[1].str()) == "tcp") { ioc_echo = false; }
+            else if (toLower(tokens[1].str()) == "udp") { ioc_echo = true; }
+            else { fprintf(stderr, "ERROR: Invalid config value IOC_LIVENESS=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reEchoInterval)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp >= 1 && tmp <= 3600) { ioc_echo_interval = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value IOC_ECHO_INTERVAL=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reEchoMissed)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp >= 1 && tmp <= 100) { ioc_echo_max_missed = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value IOC_ECHO_MAX_MISSED=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reConnLimit)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp >= 0 && tmp <= 100000) { ioc_connect_limit = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value IOC_CONNECT_LIMIT=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reConnRate)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp >= 0 && tmp <= 100000) { ioc_connect_rate = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value IOC_CONNECT_RATE=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reConnBackoff)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp >= 10 && tmp <= 86400) { ioc_connect_backoff = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value IOC_CONNECT_BACKOFF=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reGracePeriod)) {
+            auto tmp = std::atol(tokens[1].str().c_str());
+            if (tmp >= 0 && tmp <= 3600) { ioc_grace_period = static_cast<unsigned>(tmp); }
+            else { fprintf(stderr, "ERROR: Invalid config value IOC_GRACE_PERIOD=%s\n", tokens[1].str().c_str()); }
+
+        } else if (std::regex_match(line, tokens, reOrphanSearch)) {
+            if      (toLower(tokens[1].str()) == "none")       { orphan_search = OrphanSearch::None; }
+            else if (toLower(tokens[1].str()) == "all")        { orphan_search = OrphanSearch::All; }
+            else if (toLower(tokens[1].str()) == "referenced") { orphan_search = OrphanSearch::Referenced; }
+            else { fprintf(stderr, "ERROR: Invalid config value ORPHAN_SEARCH=%s\n", tokens[1].str().c_str()); }
+
         }
     }
 
     if (ca_listen_addresses.empty()) {
         ca_listen_addresses.emplace_back("0.0.0.0", 5053);
     }
+    if (ca_beacons_enabled == false) {
+        ca_beacon_addresses.clear();
+    } else if (ca_beacon_addresses.empty()) {
+        ca_beacon_addresses.emplace_back("0.0.0.0", 5065);
+    }
 }
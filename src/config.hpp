@@ -8,6 +8,7 @@
 #include "logging.hpp"
 
 #include <cstdint>
+#include <map>
 #include <regex>
 #include <string>
 #include <vector>
@@ -75,9 +76,104 @@ class Config {
         std::vector<unsigned>   search_intervals = {1, 5, 10, 30, 60, 300};
         
         unsigned purge_delay = 600; ///< Time in seconds before purging an unreferenced PV from the search list.
+
+        /**
+         * @brief Path to the file where found PVs are persisted across restarts, empty disables it.
+         * Changes are journaled to the file with .journal suffix in between snapshots.
+         */
+        std::string cache_file;
+        unsigned cache_save_interval = 300; ///< Time in seconds between two cache snapshots.
+
+        /**
+         * @brief Number of PV names not found in a full search schedule to remember, 0 disables it.
+         * Such PVs are searched for at the longest interval when requested again.
+         */
+        unsigned negative_cache_size = 100000;
+        unsigned negative_cache_ttl = 3600; ///< Time in seconds to remember PVs that were not found.
+
+        /**
+         * @brief Max number of PVs in the cache and in the search list, 0 for unlimited.
+         * When full, PVs not requested by clients recently are dropped first.
+         */
+        unsigned long max_cached_pvs = 0;
+        unsigned long max_searched_pvs = 0;
         
         std::vector<Address>    ca_listen_addresses; ///< List of interfaces/ports to listen on for CA client requests.
+
+        /**
+         * @brief Number of threads answering client searches, 0 answers them in the main thread.
+         * Every thread binds its own socket to each listen address with SO_REUSEPORT.
+         */
+        unsigned listen_threads = 0;
+        std::vector<unsigned> listen_cpus; ///< CPUs to pin listener threads to, round-robin, empty for no pinning.
+
         std::vector<Address>    ca_search_addresses; ///< List of destination addresses to forward CA searches to (IOCs).
+        std::vector<Address>    ca_beacon_addresses; ///< List of interfaces/ports to receive IOC beacons on.
+        bool ca_beacons_enabled = true;              ///< Listening to beacons was not disabled with CA_BEACON_ADDRESS=none.
+
+        /**
+         * @brief Minimum time in seconds between two expedited searches triggered by new IOCs.
+         */
+        unsigned beacon_holdoff = 10;
+
+        /**
+         * @brief MTU of the networks where searches are sent to.
+         * Search packets are filled with as many PVs as fit in a single frame.
+         */
+        unsigned search_mtu = 1500;
+        std::map<Address, unsigned> ca_search_mtus; ///< Per search address MTU, overrides search_mtu.
+
+        /**
+         * @brief Number of UDP packets sent or received in a single syscall.
+         * Value of 0 or 1 disables batching and falls back to a syscall per packet.
+         */
+        unsigned udp_batch_size = 32;
+
+        /**
+         * @brief Wait for socket events and receive and send UDP packets with io_uring instead of epoll and syscalls.
+         * Falls back to epoll when the kernel doesn't support it.
+         */
+        bool io_uring = false;
+
+        /**
+         * @brief Monitor IOCs with UDP echo probes over a single socket instead of a TCP connection each.
+         * IOC is considered lost after the given number of consecutive probes without response.
+         */
+        bool ioc_echo = false;
+        unsigned ioc_echo_interval = 10;    ///< Time in seconds between two probes of the same IOC.
+        unsigned ioc_echo_max_missed = 3;
+
+        /**
+         * @brief Pacing of TCP connections to newly found IOCs.
+         * At most the given number of connections is in progress and started per second, 0 means unlimited.
+         * Unreachable IOCs are retried after a delay doubling up to ioc_connect_backoff seconds.
+         */
+        unsigned ioc_connect_limit = 50;
+        unsigned ioc_connect_rate = 100;
+        unsigned ioc_connect_backoff = 300;
+
+        /**
+         * @brief Time in seconds PVs of a disconnected IOC are kept while it's reconnected.
+         * PVs are not returned to clients meanwhile, 0 removes them right away.
+         */
+        unsigned ioc_grace_period = 0;
+
+        /**
+         * @brief Which PVs of a removed IOC are searched for again right away.
+         */
+        enum class OrphanSearch {
+            None,       ///< Only searched for when clients ask for them again.
+            All,        ///< All PVs of the IOC.
+            Referenced  ///< PVs looked up by clients within the purge delay.
+        };
+        OrphanSearch orphan_search = OrphanSearch::None;
+
+        /**
+         * @brief Budget of outgoing search traffic, per second.
+         * Searches exceeding the budget are deferred to next ticks, 0 means unlimited.
+         */
+        unsigned long search_rate_packets = 0;
+        unsigned long search_rate_bytes = 0;
 
         /**
          * @brief Parses configuration from a file.
@@ -1,4 +1,5 @@
 #include "connection.hpp"
+#include "connmgr.hpp"
 
 #include <cstring>
 
@@ -15,4 +16,9 @@ SocketException::SocketException(const std::string &message, int err)
     }
 }
 
-Connection::~Connection() = default;
\ No newline at end of file
+Connection::~Connection() = default;
+
+void Connection::wakeupAt(std::chrono::steady_clock::time_point when)
+{
+    ConnectionsManager::wakeup(*this, when);
+}
@@ -7,6 +7,9 @@
 
 #include <arpa/inet.h>
 
+#include <chrono>
+#include <cstdint>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
@@ -52,11 +55,35 @@ class SocketException : public std::runtime_error {
  * 
  * Manages the underlying socket file descriptor and provides an interface for
  * processing incoming and outgoing data.
+ *
+ * processOutgoing() is invoked when the connection is added, after every
+ * socket event and when the time requested through wakeupAt() comes.
+ * Connections doing periodic work must request their next wakeup each time.
  */
-class Connection {
+class Connection : public std::enable_shared_from_this<Connection> {
+    friend class ConnectionsManager;
+
+    private:
+        static constexpr size_t NOT_REGISTERED = SIZE_MAX;
+        size_t m_registration = NOT_REGISTERED; ///< Position in the ConnectionsManager, for removal in constant time.
+        std::chrono::steady_clock::time_point m_wakeup = std::chrono::steady_clock::time_point::max(); ///< Earliest requested wakeup, max when none.
+        uint64_t m_pollId = 0;                  ///< Identifier of the io_uring poll or receive request, 0 when not watched.
+
     protected:
         int m_sock = -1;            ///< The underlying socket file descriptor.
         struct sockaddr_in m_addr;  ///< Address structure for the connection.
+        bool m_udpReceive = false;  ///< UDP socket only read through UdpBatch::receive(), datagrams may be received by the manager.
+
+        /**
+         * @brief Requests processOutgoing() to be invoked at the given time.
+         *
+         * Only the earliest of the pending requests is kept, later ones are
+         * ignored until it fires. Does nothing when the connection is not
+         * registered with the ConnectionsManager.
+         *
+         * @param when Time of the wakeup, past times wake up immediately.
+         */
+        void wakeupAt(std::chrono::steady_clock::time_point when);
 
     public:
         /**
@@ -0,0 +1,108 @@
+#include "connectscheduler.hpp"
+#include "connmgr.hpp"
+#include "dnscache.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+
+ConnectScheduler::ConnectScheduler(unsigned maxConnecting, double rate, unsigned maxBackoff)
+    : m_maxConnecting(maxConnecting)
+    , m_maxBackoff(maxBackoff)
+    // Small burst spreads connections evenly over each second
+    , m_bucket(rate, std::max(1.0, rate / 10))
+{
+}
+
+void ConnectScheduler::schedule(const std::shared_ptr<IocGuard>& guard, std::chrono::steady_clock::time_point now)
+{
+    collect(now);
+    auto it = m_backoff.find(guard->getIocAddr());
+    if (it != m_backoff.end() && it->second.retryAt > now) {
+        m_delayed.emplace(it->second.retryAt, guard);
+    } else {
+        m_ready.push_back(guard);
+    }
+}
+
+void ConnectScheduler::failed(const Address& addr, std::chrono::steady_clock::time_point now)
+{
+    auto& backoff = m_backoff[addr];
+    backoff.nFailures++;
+    auto delay = std::min<std::chrono::seconds>(m_maxBackoff, INITIAL_BACKOFF * (1 << std::min(backoff.nFailures - 1, 16U)));
+    backoff.retryAt = now + delay;
+    LOG_VERBOSE("IOC ", DnsCache::resolveIP(addr.first), ":", addr.second, " unreachable ", backoff.nFailures, " times, not connecting again for ", delay.count(), " seconds");
+}
+
+void ConnectScheduler::collect(std::chrono::steady_clock::time_point now)
+{
+    for (auto it = m_connecting.begin(); it != m_connecting.end(); ) {
+        auto& guard = *it;
+        if (guard->isStopped()) {
+            // IOC was given up on, not its fault
+        } else if (guard->isEstablished()) {
+            m_backoff.erase(guard->getIocAddr());
+        } else if (guard->isConnected() == false) {
+            failed(guard->getIocAddr(), now);
+        } else {
+            it++;
+            continue;
+        }
+        it = m_connecting.erase(it);
+    }
+}
+
+void ConnectScheduler::process(std::chrono::steady_clock::time_point now)
+{
+    collect(now);
+
+    while (m_delayed.empty() == false && m_delayed.begin()->first <= now) {
+        m_ready.push_back(m_delayed.begin()->second);
+        m_delayed.erase(m_delayed.begin());
+    }
+
+    m_bucket.refill(now);
+    while (m_ready.empty() == false && (m_maxConnecting == 0 || m_connecting.size() < m_maxConnecting) && m_bucket.isAvailable()) {
+        auto guard = m_ready.front().lock();
+        m_ready.pop_front();
+        // IOC was forgotten while waiting
+        if (!guard || guard->isWaiting() == false) {
+            continue;
+        }
+
+        // Failure to start invokes the disconnect callback, which may schedule a replacement
+        m_bucket.consume(1);
+        m_connecting.push_back(guard);
+        guard->connect();
+        if (guard->isConnected()) {
+            ConnectionsManager::add(guard);
+        } else {
+            collect(now);
+        }
+    }
+}
+
+std::chrono::steady_clock::time_point ConnectScheduler::nextWakeup(std::chrono::steady_clock::time_point now) const
+{
+    auto next = std::chrono::steady_clock::time_point::max();
+    if (m_delayed.empty() == false) {
+        next = m_delayed.begin()->first;
+    }
+    if (m_ready.empty() == false && (m_maxConnecting == 0 || m_connecting.size() < m_maxConnecting)) {
+        if (m_bucket.isAvailable()) {
+            return now;
+        }
+        next = std::min(next, now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(m_bucket.getWaitTime()));
+    }
+    return next;
+}
+
+void ConnectScheduler::purge(std::chrono::steady_clock::time_point now)
+{
+    for (auto it = m_backoff.begin(); it != m_backoff.end(); ) {
+        if ((now - it->second.retryAt) >= m_maxBackoff) {
+            it = m_backoff.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
@@ -0,0 +1,135 @@
+/**
+ * @file connectscheduler.hpp
+ * @brief Pacing of TCP connections to IOCs.
+ */
+
+#pragma once
+
+#include "iocguard.hpp"
+#include "tokenbucket.hpp"
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @class ConnectScheduler
+ * @brief Starts IocGuard connections at a limited pace.
+ *
+ * When many IOCs are found at once, ie. after a network outage, connecting to
+ * all of them at the same time floods the network and the IOCs. Guards are
+ * queued instead and started at a limited rate, with a limited number of
+ * connections in progress at any time.
+ *
+ * IOCs that couldn't be connected to are remembered. Next connection to such
+ * IOC is delayed, with the delay doubling after every failure, until it
+ * connects successfully. That stops reconnecting in a loop to IOCs that are
+ * reachable over UDP but not over TCP.
+ */
+class ConnectScheduler {
+    public:
+        typedef std::pair<std::string, uint16_t> Address;
+    private:
+        static constexpr std::chrono::seconds INITIAL_BACKOFF{10};  ///< Delay after the first failure.
+
+        /**
+         * @brief Failed connection attempts to an IOC.
+         */
+        struct Backoff {
+            unsigned nFailures = 0;
+            std::chrono::steady_clock::time_point retryAt;  ///< Don't connect before this time.
+        };
+
+        unsigned m_maxConnecting;
+        std::chrono::seconds m_maxBackoff;
+        TokenBucket m_bucket;
+        std::deque<std::weak_ptr<IocGuard>> m_ready;        ///< Waiting for a free slot, in order.
+        std::multimap<std::chrono::steady_clock::time_point, std::weak_ptr<IocGuard>> m_delayed; ///< Waiting for backoff to pass.
+        std::vector<std::shared_ptr<IocGuard>> m_connecting;
+        std::map<Address, Backoff> m_backoff;
+
+        /**
+         * @brief Records a failed connection attempt and delays the next one.
+         */
+        void failed(const Address& addr, std::chrono::steady_clock::time_point now);
+
+        /**
+         * @brief Collects results of connections in progress, freeing their slots.
+         *
+         * Stopped guards are dropped without counting as failures.
+         */
+        void collect(std::chrono::steady_clock::time_point now);
+
+    public:
+        /**
+         * @brief Constructs the scheduler.
+         *
+         * @param maxConnecting Max number of connections in progress, 0 for unlimited.
+         * @param rate Max number of new connections per second, 0 for unlimited.
+         * @param maxBackoff Max delay in seconds before reconnecting to unreachable IOC.
+         */
+        ConnectScheduler(unsigned maxConnecting = 0, double rate = 0, unsigned maxBackoff = 300);
+
+        /**
+         * @brief Queues the guard to be connected.
+         *
+         * Guards of unreachable IOCs are held back until their backoff expires.
+         * Guards released by everybody else are dropped from the queue.
+         * Failures of connections in progress are recorded first, so that a
+         * guard replacing a failed one from its disconnect callback is held
+         * back too.
+         *
+         * @param guard Guard to connect.
+         * @param now Current time.
+         */
+        void schedule(const std::shared_ptr<IocGuard>& guard, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+        /**
+         * @brief Checks whether the last connection attempt to the IOC failed.
+         */
+        bool isUnreachable(const Address& addr) const { return (m_backoff.find(addr) != m_backoff.end()); }
+
+        /**
+         * @brief Collects results of connections in progress and starts new ones.
+         *
+         * Started guards are added to ConnectionsManager.
+         *
+         * @param now Current time.
+         */
+        void process(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+        /**
+         * @brief Returns when process() can start more connections.
+         *
+         * Completed connections are not accounted for, they wake up
+         * ConnectionsManager on their own.
+         *
+         * @param now Current time.
+         * @return Time of next connection, time_point::max() when none is waiting.
+         */
+        std::chrono::steady_clock::time_point nextWakeup(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) const;
+
+        /**
+         * @brief Forgets failures of IOCs that were not retried for the max backoff time.
+         * @param now Current time.
+         */
+        void purge(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+        /**
+         * @brief Returns the number of connections in progress.
+         */
+        size_t getConnecting() const { return m_connecting.size(); }
+
+        /**
+         * @brief Returns the number of guards waiting to connect.
+         */
+        size_t getWaiting() const { return (m_ready.size() + m_delayed.size()); }
+
+        /**
+         * @brief Returns the number of IOCs the last connection attempt failed to.
+         */
+        size_t getUnreachable() const { return m_backoff.size(); }
+};
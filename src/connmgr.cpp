@@ -1,58 +1,379 @@
 #include "connmgr.hpp"
+#include "iouring.hpp"
+#include "logging.hpp"
 
 #include <poll.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
 
 static ConnectionsManager g_connmgr;
 
+#ifdef __linux__
+// Writability reports completed TCP connects
+static constexpr uint32_t WATCHED_EVENTS = POLLIN | POLLOUT;
+static constexpr unsigned IO_URING_ENTRIES = 256;
+// Largest datagram read through UdpBatch, plus the header and sender address
+static constexpr unsigned IO_URING_BUFFERS = 1024;
+static constexpr size_t IO_URING_BUFFER_SIZE = 4096 + 64;
+// How soon to retry requests that didn't fit in the submission ring
+static constexpr int IO_URING_RETRY_MS = 10;
+#endif
+
+ConnectionsManager::ConnectionsManager()
+{
+#ifdef __linux__
+    m_epoll = ::epoll_create1(EPOLL_CLOEXEC);
+    m_events.resize(64);
+#endif
+}
+
+ConnectionsManager::~ConnectionsManager()
+{
+#ifdef __linux__
+    if (m_epoll != -1) {
+        ::close(m_epoll);
+    }
+#endif
+}
+
+void ConnectionsManager::watch(Connection* connection)
+{
+#ifdef __linux__
+    if (connection->getSocket() == -1) {
+        return;
+    }
+    if (g_connmgr.m_ring) {
+        connection->m_pollId = ++g_connmgr.m_lastPollId;
+        g_connmgr.m_polls[connection->m_pollId] = {connection, connection->m_udpReceive};
+        arm(connection->m_pollId);
+    } else {
+        epoll_event event = {};
+        event.events = WATCHED_EVENTS | EPOLLET;
+        event.data.ptr = connection;
+        if (::epoll_ctl(g_connmgr.m_epoll, EPOLL_CTL_ADD, connection->getSocket(), &event) != 0) {
+            LOG_ERROR("Failed to register socket ", connection->getSocket(), " for events: ", strerror(errno));
+        }
+    }
+#endif
+}
+
+void ConnectionsManager::unwatch(Connection* connection)
+{
+#ifdef __linux__
+    if (connection->m_pollId != 0) {
+        // Request holds the socket open even when closed by the connection
+        if (g_connmgr.m_ring->cancel(connection->m_pollId) == false) {
+            g_connmgr.m_uncancelled.push_back(connection->m_pollId);
+        }
+        g_connmgr.m_polls.erase(connection->m_pollId);
+        connection->m_pollId = 0;
+    } else if (connection->getSocket() != -1 && g_connmgr.m_ring == nullptr) {
+        // Closed sockets were already dropped by the kernel
+        ::epoll_ctl(g_connmgr.m_epoll, EPOLL_CTL_DEL, connection->getSocket(), nullptr);
+    }
+#endif
+}
+
+bool ConnectionsManager::setBackend(Backend backend)
+{
+#ifdef __linux__
+    if ((backend == Backend::IoUring) == (g_connmgr.m_ring != nullptr)) {
+        return true;
+    }
+
+    std::unique_ptr<IoUring> ring;
+    if (backend == Backend::IoUring) {
+        try {
+            ring.reset(new IoUring(IO_URING_ENTRIES, IO_URING_BUFFERS, IO_URING_BUFFER_SIZE));
+        } catch (SocketException& e) {
+            LOG_ERROR("Can't use io_uring, falling back to epoll: ", e.what());
+            return false;
+        }
+    }
+
+    for (auto& connection: g_connmgr.m_connections) {
+        unwatch(connection.get());
+    }
+    // Destroying the ring ends all its requests
+    g_connmgr.m_unarmed.clear();
+    g_connmgr.m_uncancelled.clear();
+    g_connmgr.m_ring = std::move(ring);
+    UdpBatch::useRing(g_connmgr.m_ring.get());
+    for (auto& connection: g_connmgr.m_connections) {
+        watch(connection.get());
+    }
+    return true;
+#else
+    return (backend == Backend::Epoll);
+#endif
+}
+
 void ConnectionsManager::add(const std::shared_ptr<Connection>& connection)
 {
+    if (connection->m_registration != Connection::NOT_REGISTERED) {
+        return;
+    }
+    connection->m_registration = g_connmgr.m_connections.size();
     g_connmgr.m_connections.emplace_back(connection);
+    watch(connection.get());
+
+    // First processOutgoing() lets the connection schedule its wakeups
+    wakeup(*connection, std::chrono::steady_clock::now());
 }
 
 void ConnectionsManager::remove(const std::shared_ptr<Connection>& connection)
 {
-    for (auto it = g_connmgr.m_connections.begin(); it != g_connmgr.m_connections.end();) {
-        if (connection->getSocket() == (*it)->getSocket()) {
-            it = g_connmgr.m_connections.erase(it);
+    auto pos = connection->m_registration;
+    if (pos == Connection::NOT_REGISTERED) {
+        return;
+    }
+
+    // Move the last connection into the gap
+    auto& connections = g_connmgr.m_connections;
+    if (pos != connections.size() - 1) {
+        connections[pos] = std::move(connections.back());
+        connections[pos]->m_registration = pos;
+    }
+    connections.pop_back();
+    connection->m_registration = Connection::NOT_REGISTERED;
+    connection->m_wakeup = std::chrono::steady_clock::time_point::max();
+
+    unwatch(connection.get());
+    g_connmgr.m_removed.push_back(connection);
+}
+
+void ConnectionsManager::wakeup(Connection& connection, std::chrono::steady_clock::time_point when)
+{
+    if (connection.m_registration == Connection::NOT_REGISTERED || when >= connection.m_wakeup) {
+        return;
+    }
+    connection.m_wakeup = when;
+    g_connmgr.m_wakeups.push({when, connection.weak_from_this()});
+}
+
+void ConnectionsManager::dropStaleWakeups()
+{
+    auto& wakeups = g_connmgr.m_wakeups;
+    while (wakeups.empty() == false) {
+        auto connection = wakeups.top().connection.lock();
+        if (connection && connection->m_registration != Connection::NOT_REGISTERED && connection->m_wakeup == wakeups.top().when) {
+            break;
+        }
+        wakeups.pop();
+    }
+}
+
+void ConnectionsManager::processOutgoing(Connection* connection)
+{
+    if (connection->m_registration == Connection::NOT_REGISTERED) {
+        return;
+    }
+    connection->processOutgoing();
+    if (connection->isConnected() == false && connection->m_registration != Connection::NOT_REGISTERED) {
+        // Copy, removal moves the vector elements
+        auto closed = g_connmgr.m_connections[connection->m_registration];
+        remove(closed);
+    }
+}
+
+#ifdef __linux__
+void ConnectionsManager::waitEpoll(int waitMs)
+{
+    auto& events = g_connmgr.m_events;
+    auto nEvents = ::epoll_wait(g_connmgr.m_epoll, events.data(), static_cast<int>(events.size()), waitMs);
+    for (int i = 0; i < nEvents; i++) {
+        // Errors are reported when reading
+        auto connection = static_cast<Connection*>(events[i].data.ptr);
+        if (connection->m_registration != Connection::NOT_REGISTERED && (events[i].events & ~EPOLLOUT) != 0) {
+            connection->processIncoming();
+        }
+        processOutgoing(connection);
+    }
+    if (nEvents == static_cast<int>(events.size())) {
+        events.resize(2 * events.size());
+    }
+}
+
+void ConnectionsManager::arm(uint64_t pollId)
+{
+    auto it = g_connmgr.m_polls.find(pollId);
+    if (it == g_connmgr.m_polls.end() || it->second.connection->getSocket() == -1) {
+        return;
+    }
+    auto sock = it->second.connection->getSocket();
+    bool queued;
+    if (it->second.receive) {
+        queued = g_connmgr.m_ring->recvMsg(sock, pollId);
+    } else {
+        queued = g_connmgr.m_ring->pollAdd(sock, WATCHED_EVENTS, pollId);
+    }
+    if (queued == false) {
+        g_connmgr.m_unarmed.push_back(pollId);
+    }
+}
+
+void ConnectionsManager::processReceived(const std::vector<io_uring_cqe>& cqes, size_t begin, size_t end)
+{
+    auto& ring = *g_connmgr.m_ring;
+    auto pollId = cqes[begin].user_data;
+    auto connection = g_connmgr.m_polls[pollId].connection;
+
+    int err = 0;
+    auto& datagrams = g_connmgr.m_datagrams;
+    datagrams.clear();
+    for (auto i = begin; i < end; i++) {
+        UdpBatch::Datagram datagram;
+        if (ring.getDatagram(cqes[i], datagram.data, datagram.len, datagram.remoteAddr)) {
+            datagrams.push_back(datagram);
+        } else if (cqes[i].res < 0) {
+            err = -cqes[i].res;
+        }
+    }
+    if (datagrams.empty() == false) {
+        UdpBatch::deliver(connection->getSocket(), &datagrams);
+        connection->processIncoming();
+        UdpBatch::deliver(-1, nullptr);
+    }
+    for (auto i = begin; i < end; i++) {
+        ring.releaseBuffer(cqes[i]);
+    }
+
+    // Kernel stops receiving on errors and when out of buffers, processing may have removed the connection
+    auto it = g_connmgr.m_polls.find(pollId);
+    if (it != g_connmgr.m_polls.end() && (cqes[end - 1].flags & IORING_CQE_F_MORE) == 0 && connection->getSocket() != -1) {
+        if (err == EINVAL) {
+            LOG_VERBOSE("Kernel can't receive datagrams with io_uring, polling socket ", connection->getSocket(), " instead");
+            it->second.receive = false;
+            arm(pollId);
+        } else if (err == 0 || err == ENOBUFS || err == ECONNREFUSED || err == EHOSTUNREACH || err == ENETUNREACH || err == EINTR) {
+            arm(pollId);
         } else {
-            it++;
+            LOG_ERROR("Failed to receive from socket ", connection->getSocket(), ": ", strerror(err));
+            g_connmgr.m_polls.erase(it);
+            connection->m_pollId = 0;
         }
     }
+    processOutgoing(connection);
 }
 
+void ConnectionsManager::waitIoUring(int waitMs)
+{
+    // Retry requests that didn't fit in the submission ring last time
+    auto unarmed = std::move(g_connmgr.m_unarmed);
+    g_connmgr.m_unarmed.clear();
+    for (auto pollId: unarmed) {
+        arm(pollId);
+    }
+    auto uncancelled = std::move(g_connmgr.m_uncancelled);
+    g_connmgr.m_uncancelled.clear();
+    for (auto pollId: uncancelled) {
+        if (g_connmgr.m_ring->cancel(pollId) == false) {
+            g_connmgr.m_uncancelled.push_back(pollId);
+        }
+    }
+    if (g_connmgr.m_unarmed.empty() == false || g_connmgr.m_uncancelled.empty() == false) {
+        waitMs = (waitMs < 0 ? IO_URING_RETRY_MS : std::min(waitMs, IO_URING_RETRY_MS));
+    }
+
+    auto& cqes = g_connmgr.m_ring->wait(waitMs);
+    for (size_t i = 0; i < cqes.size(); i++) {
+        auto& cqe = cqes[i];
+        auto it = g_connmgr.m_polls.find(cqe.user_data);
+        if (it == g_connmgr.m_polls.end()) {
+            // Removed connection or completed cancellation, datagrams received meanwhile are dropped
+            g_connmgr.m_ring->releaseBuffer(cqe);
+            continue;
+        }
+        if (it->second.receive) {
+            // Datagrams received in a row are processed together, like from recvmmsg()
+            auto end = i + 1;
+            while (end < cqes.size() && cqes[end].user_data == cqe.user_data) {
+                end++;
+            }
+            processReceived(cqes, i, end);
+            i = end - 1;
+            continue;
+        }
+        auto connection = it->second.connection;
+        if (cqe.res < 0) {
+            LOG_ERROR("Failed to poll socket ", connection->getSocket(), " for events: ", strerror(-cqe.res));
+            g_connmgr.m_polls.erase(it);
+            connection->m_pollId = 0;
+            continue;
+        }
+        if ((cqe.flags & IORING_CQE_F_MORE) == 0 && connection->getSocket() != -1) {
+            // Kernel stopped the multishot poll, renew it
+            arm(connection->m_pollId);
+        }
+        if ((cqe.res & ~POLLOUT) != 0) {
+            connection->processIncoming();
+        }
+        processOutgoing(connection);
+    }
+}
+#endif
+
 void ConnectionsManager::run(double timeout) {
+    auto& wakeups = g_connmgr.m_wakeups;
+
+    // Sleep until the earliest wakeup, rounded up so we don't wake up early
+    int waitMs = (timeout < 0 ? -1 : static_cast<int>(std::ceil(timeout * 1000)));
+    dropStaleWakeups();
+    if (wakeups.empty() == false) {
+        auto until = std::chrono::ceil<std::chrono::milliseconds>(wakeups.top().when - std::chrono::steady_clock::now()).count();
+        until = std::max<decltype(until)>(0, std::min<decltype(until)>(until, INT_MAX));
+        if (waitMs < 0 || until < waitMs) {
+            waitMs = static_cast<int>(until);
+        }
+    }
+
+#ifdef __linux__
+    if (g_connmgr.m_ring) {
+        waitIoUring(waitMs);
+    } else {
+        waitEpoll(waitMs);
+    }
+#else
     size_t nFds = g_connmgr.m_connections.size();
-    auto fds = std::shared_ptr<pollfd[]>(new pollfd[nFds]);
-    for (size_t i = 0; i < g_connmgr.m_connections.size(); i++) {
+    std::vector<pollfd> fds(nFds);
+    for (size_t i = 0; i < nFds; i++) {
         fds[i].fd = g_connmgr.m_connections[i]->getSocket();
         fds[i].events = POLLIN;
         fds[i].revents = 0;
     }
 
-    if (timeout <= 0) {
-        timeout = 0.0;
-    } else if (timeout < 0.001) {
-        timeout = 0.001;
-    }
-
     // Use poll to process all connections with incoming packets
-    if (::poll(fds.get(), nFds, static_cast<int>(timeout*1000)) > 0) {
-        for (size_t i = 0; i < nFds; i++) {
+    if (::poll(fds.data(), nFds, waitMs) > 0) {
+        for (size_t i = 0; i < nFds && i < g_connmgr.m_connections.size(); i++) {
             if (fds[i].revents & POLLIN) {
                 g_connmgr.m_connections[i]->processIncoming();
             }
         }
     }
 
-    // Trigger each connection to send out any packets
-    // And drop closed connections
-    for (auto it = g_connmgr.m_connections.begin(); it != g_connmgr.m_connections.end();) {
-        (*it)->processOutgoing();
+    // Without readiness notifications, every connection gets a chance to send
+    auto connections = g_connmgr.m_connections;
+    for (auto& connection: connections) {
+        processOutgoing(connection.get());
+    }
+#endif
 
-        if ((*it)->isConnected() == false) {
-            it = g_connmgr.m_connections.erase(it);
-        } else {
-            it++;
-        }
+    // Wakeups requested while processing them are left for the next run
+    auto now = std::chrono::steady_clock::now();
+    std::vector<std::shared_ptr<Connection>> due;
+    for (dropStaleWakeups(); wakeups.empty() == false && wakeups.top().when <= now; dropStaleWakeups()) {
+        auto connection = wakeups.top().connection.lock();
+        connection->m_wakeup = std::chrono::steady_clock::time_point::max();
+        wakeups.pop();
+        due.emplace_back(std::move(connection));
+    }
+    for (auto& connection: due) {
+        processOutgoing(connection.get());
     }
+
+    g_connmgr.m_removed.clear();
 }
@@ -6,23 +6,151 @@
 #pragma once
 
 #include "connection.hpp"
+#include "udpbatch.hpp"
 
+#include <chrono>
+#include <functional>
 #include <memory>
+#include <queue>
+#include <unordered_map>
 #include <vector>
 
+#ifdef __linux__
+#include <sys/epoll.h>
+
+class IoUring;
+struct io_uring_cqe;
+#endif
+
 /**
  * @class ConnectionsManager
  * @brief Manages the lifecycle and IO processing of multiple Connection objects.
- * 
+ *
  * This class acts as a reactor/dispatcher. It maintains a list of active connections
- * and uses `select` (or equivalent) to poll them for incoming data, invoking
- * their processing methods when ready.
+ * and polls them for incoming data, invoking their processing methods when ready.
+ *
+ * On Linux, connections are registered with epoll once when added, so waiting
+ * for events doesn't depend on the number of idle connections. Readiness is
+ * edge-triggered, connections must read all pending data when notified.
+ * Elsewhere, poll() is used with the list of all connections.
+ *
+ * Alternatively on Linux, io_uring is used. Datagrams of UDP connections are
+ * received by the kernel on their behalf and handed to their UdpBatch, other
+ * sockets are polled. Registering and removing sockets, receiving and sending
+ * datagrams and waiting are then all batched into a single syscall per loop
+ * iteration.
+ *
+ * Connections schedule their own wakeups for periodic work, the manager keeps
+ * them in a min-heap and sleeps exactly until the earliest one is due, or
+ * indefinitely when nothing is scheduled.
  */
 class ConnectionsManager {
+    public:
+        /**
+         * @enum Backend
+         * @brief Mechanism used to wait for socket events.
+         */
+        enum class Backend {
+            Epoll,      ///< epoll on Linux, poll() elsewhere.
+            IoUring,    ///< io_uring, Linux 5.19+ only, 6.0+ to receive datagrams with it.
+        };
+
     private:
+        /**
+         * @brief Wakeup requested by a connection.
+         *
+         * Entries are invalidated lazily, they're ignored when the connection
+         * is gone or has since requested an earlier wakeup.
+         */
+        struct Wakeup {
+            std::chrono::steady_clock::time_point when;
+            std::weak_ptr<Connection> connection;
+            bool operator>(const Wakeup& other) const { return (when > other.when); }
+        };
+
         std::vector<std::shared_ptr<Connection>> m_connections;
+        std::vector<std::shared_ptr<Connection>> m_removed;     ///< Kept alive until run() finishes, pending events may refer to them.
+        std::priority_queue<Wakeup, std::vector<Wakeup>, std::greater<Wakeup>> m_wakeups;
+#ifdef __linux__
+        int m_epoll = -1;
+        std::vector<epoll_event> m_events;                      ///< Events received in one wait, grows when full.
+        /**
+         * @brief Request watching a connection with io_uring.
+         */
+        struct Poll {
+            Connection* connection;
+            bool receive;           ///< Multishot receive of datagrams rather than poll.
+        };
+
+        std::unique_ptr<IoUring> m_ring;                        ///< Used instead of epoll when set.
+        std::unordered_map<uint64_t, Poll> m_polls;             ///< Connections by their io_uring request id.
+        uint64_t m_lastPollId = 0;
+        std::vector<uint64_t> m_unarmed;                        ///< Requests that didn't fit in the submission ring, queued again before waiting.
+        std::vector<uint64_t> m_uncancelled;                    ///< Cancellations that didn't fit in the submission ring.
+        std::vector<UdpBatch::Datagram> m_datagrams;            ///< Received for the connection being processed.
+#endif
+
+        /**
+         * @brief Lets the connection send out data, drops it when closed.
+         */
+        static void processOutgoing(Connection* connection);
+
+        /**
+         * @brief Removes invalidated wakeups from the top of the heap.
+         */
+        static void dropStaleWakeups();
+
+        /**
+         * @brief Starts watching the connection's socket for events with the current backend.
+         */
+        static void watch(Connection* connection);
+
+        /**
+         * @brief Stops watching the connection's socket for events.
+         */
+        static void unwatch(Connection* connection);
+
+#ifdef __linux__
+        /**
+         * @brief Waits for and processes events with epoll.
+         */
+        static void waitEpoll(int waitMs);
+
+        /**
+         * @brief Waits for and processes completed polls and receives from io_uring.
+         */
+        static void waitIoUring(int waitMs);
+
+        /**
+         * @brief Queues the poll or receive request of a watched connection.
+         *
+         * Requests that can't be queued are remembered and tried again before
+         * next wait.
+         */
+        static void arm(uint64_t pollId);
+
+        /**
+         * @brief Processes datagrams received for a connection in completions [begin, end).
+         */
+        static void processReceived(const std::vector<io_uring_cqe>& cqes, size_t begin, size_t end);
+#endif
 
     public:
+        ConnectionsManager();
+        ~ConnectionsManager();
+
+        /**
+         * @brief Selects the mechanism for waiting on socket events.
+         *
+         * Already registered connections are moved to the new backend.
+         * When io_uring is not supported, an error is logged and epoll is
+         * used instead.
+         *
+         * @param backend Requested backend.
+         * @return true when the requested backend is in use.
+         */
+        static bool setBackend(Backend backend);
+
         /**
          * @brief Registers a connection with the manager.
          * @param connection Shared pointer to the connection instance.
@@ -30,17 +158,30 @@ class ConnectionsManager {
         static void add(const std::shared_ptr<Connection>& connection);
 
         /**
-         * @brief Unregisters a connection.
+         * @brief Unregisters a connection, in constant time.
          * @param connection Shared pointer to the connection instance to remove.
          */
         static void remove(const std::shared_ptr<Connection>& connection);
 
+        /**
+         * @brief Schedules processOutgoing() of a registered connection.
+         *
+         * Used through Connection::wakeupAt().
+         *
+         * @param connection Connection to wake up.
+         * @param when Time of the wakeup.
+         */
+        static void wakeup(Connection& connection, std::chrono::steady_clock::time_point when);
+
         /**
          * @brief Runs the main IO loop for a single iteration/slice.
-         * 
-         * Polls all registered connections for read/write readiness.
-         * 
-         * @param timeout Maximum time to wait for IO events in seconds (default 0.1s).
+         *
+         * Waits for IO events or the next scheduled wakeup, whichever comes
+         * first. Connections with events or due wakeups are processed and
+         * dropped when closed.
+         *
+         * @param timeout Maximum time to wait in seconds, negative to wait
+         *                only for events and wakeups.
          */
-        static void run(double timeout = 0.1);
-};
\ No newline at end of file
+        static void run(double timeout = -1.0);
+};
@@ -2,12 +2,25 @@
 #include "dnscache.hpp"
 #include "connmgr.hpp"
 
+#include <algorithm>
+#include <tuple>
+
 Dispatcher::Dispatcher(const Config& config)
     : m_config(config)
     , m_lastPurge(std::chrono::steady_clock::now())
     , m_caProto(new ChannelAccess)
+    , m_connectScheduler(config.ioc_connect_limit, config.ioc_connect_rate, config.ioc_connect_backoff)
 {
+    UdpBatch::setBatchSize(config.udp_batch_size);
+    if (config.io_uring && ConnectionsManager::setBackend(ConnectionsManager::Backend::IoUring)) {
+        LOG_INFO("Using io_uring for socket events and UDP packets");
+    }
+
+    // Threads are started once everything else is set up
     for (auto& addr: config.ca_listen_addresses) {
+        if (config.listen_threads > 0) {
+            break;
+        }
         try {
             addListener(addr.first, addr.second, Dispatcher::Proto::CHANNEL_ACCESS);
         } catch (SocketException& e) {
@@ -16,77 +29,358 @@ Dispatcher::Dispatcher(const Config& config)
         }
     }
 
+    std::vector<Searcher::SearchAddress> addresses;
     for (auto& addr: config.ca_search_addresses) {
+        auto mtu = config.ca_search_mtus.find(addr);
+        addresses.push_back({addr.first, addr.second, (mtu != config.ca_search_mtus.end() ? mtu->second : config.search_mtu)});
+    }
+    try {
+        addSearcher(addresses, Dispatcher::Proto::CHANNEL_ACCESS, config.search_intervals);
+        if (m_caSearcher) {
+            m_caSearcher->setRateLimit(config.search_rate_packets, config.search_rate_bytes);
+            m_caSearcher->setExpediteHoldoff(config.beacon_holdoff);
+            m_caSearcher->setNegativeCache(config.negative_cache_size, config.negative_cache_ttl);
+            m_caSearcher->setCapacity(config.max_searched_pvs);
+        }
+    } catch (SocketException& e) {
+        fprintf(stderr, "Failed to initilize Searcher: %s\n", e.what());
+        return;
+    }
+
+    // IOCs are monitored over TCP when probing is not available
+    if (config.ioc_echo) {
+        try {
+            m_echoProber.reset(new EchoProber(m_caProto, config.ioc_echo_interval, config.ioc_echo_max_missed));
+            ConnectionsManager::add(m_echoProber);
+        } catch (SocketException& e) {
+            fprintf(stderr, "Failed to initialize EchoProber: %s\n", e.what());
+            m_echoProber.reset();
+        }
+    }
+
+    m_connectedPVs.setCapacity(config.max_cached_pvs, [this](const PvCache::Entry& pv) {
+        LOG_VERBOSE("Removed ", pv.pvname, " from cache to make space for new PVs");
+        unservePV(pv.pvname);
+        if (m_cacheFile) {
+            m_cacheFile->remove(pv.pvname);
+        }
+    });
+
+    if (config.cache_file.empty() == false) {
+        m_cacheFile.reset(new CacheFile(config.cache_file));
+        loadCache();
+    }
+
+    // Beacons only speed up discovery of new IOCs, not fatal when not available
+    for (auto& addr: config.ca_beacon_addresses) {
         try {
-            addSearcher(addr.first, addr.second, Dispatcher::Proto::CHANNEL_ACCESS, config.search_intervals);
+            addBeaconListener(addr.first, addr.second, Dispatcher::Proto::CHANNEL_ACCESS);
         } catch (SocketException& e) {
-            fprintf(stderr, "Failed to initilize Searcher(%s, %u): %s\n", addr.first.c_str(), addr.second, e.what());
+            fprintf(stderr, "Failed to initialize BeaconListener(%s, %u): %s\n", addr.first.c_str(), addr.second, e.what());
+        }
+    }
+
+    if (config.listen_threads > 0) {
+        try {
+            addListenerThreads(config.listen_threads, config.listen_cpus, Dispatcher::Proto::CHANNEL_ACCESS);
+        } catch (SocketException& e) {
+            fprintf(stderr, "Failed to initilize listener threads: %s\n", e.what());
+            m_listenerThreads.clear();
             return;
         }
     }
 }
 
+void Dispatcher::caIocStarted(const std::string& iocIP, uint16_t iocPort)
+{
+    if (m_caSearcher && m_caSearcher->size() > 0) {
+        LOG_VERBOSE("IOC ", DnsCache::resolveIP(iocIP), ":", iocPort, " started, expediting search for ", m_caSearcher->size(), " PVs");
+        m_caSearcher->expedite();
+    }
+}
+
 void Dispatcher::iocDisconnected(const std::string& iocIP, uint16_t iocPort)
+{
+    auto addr = std::make_pair(iocIP, iocPort);
+    auto it = m_iocs.find(addr);
+    if (it == m_iocs.end()) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    auto suspect = m_suspects.find(addr);
+    if (m_config.ioc_grace_period > 0 && (suspect == m_suspects.end() || suspect->second > now)) {
+        auto& iocRecord = m_connectedPVs.getIoc(it->second);
+        auto guard = createGuard(iocIP, iocPort, iocRecord.udpPort);
+        if (guard) {
+            if (suspect == m_suspects.end()) {
+                m_connectedPVs.forEachOnIoc(it->second, [this](PvCache::Entry& pv) {
+                    pv.unverified = true;
+                    unservePV(pv.pvname);
+                });
+                m_suspects[addr] = now + std::chrono::seconds(m_config.ioc_grace_period);
+                LOG_INFO("IOC ", DnsCache::resolveIP(iocIP), ":", iocPort, " disconnected, keeping its ", iocRecord.nPvs, " PVs for ", m_config.ioc_grace_period, " seconds while reconnecting");
+            }
+            // Old guard is still running the callback, the caller keeps it alive
+            iocRecord.guard = guard;
+            return;
+        }
+    }
+
+    auto nPvs = removeIoc(it);
+    LOG_INFO("IOC ", DnsCache::resolveIP(iocIP), ":", iocPort, " disconnected, removed its ", nPvs, " PVs from cache");
+}
+
+size_t Dispatcher::removeIoc(std::map<Address, uint32_t>::iterator it)
+{
+    // Orphaned PVs are searched for before clients ask again, IOC is probed first
+    // in case it restarted at the same address
+    const auto& [iocIP, iocPort] = it->first;
+    auto udpPort = m_connectedPVs.getIoc(it->second).udpPort;
+    auto search = (m_caSearcher ? m_config.orphan_search : Config::OrphanSearch::None);
+    // PVs no client asked for within the purge delay would be purged from the search list right away
+    auto now = PvCache::lookupTime();
+    auto recentSince = (now > m_config.purge_delay ? now - m_config.purge_delay : 0);
+    size_t nSearched = 0;
+    auto nPvs = m_connectedPVs.eraseIoc(it->second, [&](const PvCache::Entry& pv) {
+        unservePV(pv.pvname);
+        if (m_cacheFile) {
+            m_cacheFile->remove(pv.pvname);
+        }
+        auto lastLookup = pv.lastLookup.load(std::memory_order_relaxed);
+        bool wanted = (search == Config::OrphanSearch::All ||
+                      (search == Config::OrphanSearch::Referenced && lastLookup != 0 && lastLookup >= recentSince));
+        if (wanted && m_caSearcher->addPV(pv.pvname, iocIP, udpPort)) {
+            nSearched++;
+        }
+    });
+    if (nSearched > 0) {
+        LOG_VERBOSE("Searching again for ", nSearched, " PVs of IOC ", DnsCache::resolveIP(iocIP), ":", iocPort);
+    }
+    m_connectedPVs.unlistIoc(it->second);
+    m_suspects.erase(it->first);
+    m_iocs.erase(it);
+    return nPvs;
+}
+
+void Dispatcher::checkSuspects()
+{
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = m_suspects.begin(); it != m_suspects.end(); ) {
+        auto [iocIP, iocPort] = it->first;
+        auto ioc = m_iocs.find(it->first);
+        if (ioc == m_iocs.end()) {
+            it = m_suspects.erase(it);
+            continue;
+        }
+
+        auto guard = m_connectedPVs.getIoc(ioc->second).guard;
+        if (guard->isEstablished()) {
+            // IOC is back at the same address, its PVs are valid again
+            m_connectedPVs.forEachOnIoc(ioc->second, [this](PvCache::Entry& pv) {
+                pv.unverified = false;
+                servePV(pv);
+            });
+            LOG_INFO("IOC ", DnsCache::resolveIP(iocIP), ":", iocPort, " reconnected, restored its ", m_connectedPVs.getIoc(ioc->second).nPvs, " PVs");
+            it = m_suspects.erase(it);
+        } else if (it->second <= now) {
+            it++;
+            ConnectionsManager::remove(guard);
+            guard->stop();
+            auto nPvs = removeIoc(ioc);
+            LOG_INFO("IOC ", DnsCache::resolveIP(iocIP), ":", iocPort, " didn't reconnect in ", m_config.ioc_grace_period, " seconds, removed its ", nPvs, " PVs from cache");
+        } else {
+            it++;
+        }
+    }
+}
+
+uint32_t Dispatcher::getIoc(const std::string& iocIP, uint16_t iocPort, uint16_t udpPort)
 {
     auto it = m_iocs.find(std::make_pair(iocIP, iocPort));
     if (it != m_iocs.end()) {
-        m_iocs.erase(it);
+        return it->second;
+    }
+
+    auto iocGuard = createGuard(iocIP, iocPort, udpPort);
+    if (!iocGuard) {
+        return PvCache::NO_IOC;
     }
+    auto ioc = m_connectedPVs.addIoc(iocGuard);
+    m_iocs[std::make_pair(iocIP, iocPort)] = ioc;
+    return ioc;
 }
 
-void Dispatcher::caPvFound(const std::string& pvname, const std::string& iocIP, uint16_t iocPort, const Protocol::Bytes& response)
+std::shared_ptr<IocGuard> Dispatcher::createGuard(const std::string& iocIP, uint16_t iocPort, uint16_t udpPort)
 {
+    using namespace std::placeholders;
+    IocGuard::DisconnectCb disconnectCb = std::bind(&Dispatcher::iocDisconnected, this, _1, _2);
     std::shared_ptr<IocGuard> iocGuard;
-    auto it = m_iocs.find(std::make_pair(iocIP, iocPort));
-    if (it != m_iocs.end()) {
-        iocGuard = it->second;
-    } else {
-        using namespace std::placeholders;
-        IocGuard::DisconnectCb disconnectCb = std::bind(&Dispatcher::iocDisconnected, this, _1, _2);
-        try {
-            iocGuard.reset(new IocGuard(iocIP, iocPort, m_caProto, disconnectCb));
-        } catch (SocketException& e) {
-            LOG_ERROR("Failed to create IOC ", DnsCache::resolveIP(iocIP), ":", iocPort, " monitoring connection: ", e.what());
-            return;
+    try {
+        if (m_echoProber && udpPort != 0) {
+            iocGuard.reset(new IocGuard(iocIP, iocPort, m_caProto, disconnectCb, false));
+            if (m_echoProber->add(iocGuard, udpPort)) {
+                return iocGuard;
+            }
+            LOG_VERBOSE("IOC ", DnsCache::resolveIP(iocIP), ":", iocPort, " shares UDP port ", udpPort, " with another IOC, monitoring it over TCP");
         }
-        m_iocs[std::make_pair(iocIP, iocPort)] = iocGuard;
-        ConnectionsManager::add(iocGuard);
+        iocGuard.reset(new IocGuard(iocIP, iocPort, m_caProto, disconnectCb));
+    } catch (SocketException& e) {
+        LOG_ERROR("Failed to create IOC ", DnsCache::resolveIP(iocIP), ":", iocPort, " monitoring connection: ", e.what());
+        return nullptr;
+    }
+    m_connectScheduler.schedule(iocGuard);
+    return iocGuard;
+}
+
+void Dispatcher::caPvFound(const std::string& pvname, const std::string& iocIP, uint16_t iocPort, uint16_t udpPort, const Protocol::Bytes& response)
+{
+    auto ioc = getIoc(iocIP, iocPort, udpPort);
+    if (ioc == PvCache::NO_IOC) {
+        return;
     }
 
-    for (auto& searcher: m_caSearchers) {
-        searcher->removePV(pvname);
+    if (m_caSearcher) {
+        m_caSearcher->removePV(pvname);
     }
 
-    auto& pv = m_connectedPVs[pvname];
-    pv.ioc = iocGuard;
-    pv.response = response;
+    // Reply only depends on the IOC, the latest one is used for all its PVs
+    auto& iocRecord = m_connectedPVs.getIoc(ioc);
+    iocRecord.reply = response;
+    iocRecord.udpPort = udpPort;
+
+    // PVs of IOCs that failed to connect before wait until the IOC connects
+    auto& pv = m_connectedPVs.insert(pvname);
+    m_connectedPVs.setIoc(pv, ioc);
+    pv.unverified = (iocRecord.guard->isEstablished() == false && m_connectScheduler.isUnreachable(std::make_pair(iocIP, iocPort)));
+    servePV(pv);
+
+    if (m_cacheFile) {
+        m_cacheFile->add({pvname, iocIP, iocPort, udpPort, response});
+    }
 }
 
-Protocol::Bytes Dispatcher::caPvSearched(const std::string &pvname, const std::string &clientIP, uint16_t clientPort)
+void Dispatcher::loadCache()
 {
-    try {
-        auto pv = m_connectedPVs.at(pvname);
-        if (pv.ioc && pv.ioc->isConnected()) {
-            const auto [iocIp, iocPort] = pv.ioc->getIocAddr();
+    std::map<std::string, CacheFile::Entry> entries;
+    m_cacheFile->load([&entries](const CacheFile::Entry& entry) {
+        if (entry.response.empty()) {
+            entries.erase(entry.pvname);
+        } else {
+            entries[entry.pvname] = entry;
+        }
+    });
+
+    m_connectedPVs.reserve(entries.size());
+    for (auto& [pvname, entry]: entries) {
+        auto ioc = getIoc(entry.iocIp, entry.iocPort, entry.udpPort);
+        if (ioc != PvCache::NO_IOC) {
+            auto& iocRecord = m_connectedPVs.getIoc(ioc);
+            iocRecord.reply = entry.response;
+            iocRecord.udpPort = entry.udpPort;
+
+            auto& pv = m_connectedPVs.insert(pvname);
+            m_connectedPVs.setIoc(pv, ioc);
+            pv.unverified = true;
+        }
+    }
+
+    // Start with a compact snapshot and empty journal, filled over the first runs
+    saveCache();
+}
+
+void Dispatcher::saveCache()
+{
+    m_lastCacheSave = std::chrono::steady_clock::now();
+    m_saveCursor = 0;
+    m_saving = m_cacheFile->beginSnapshot();
+}
+
+void Dispatcher::saveCacheStep()
+{
+    // Changes to PVs already visited are journaled by the cache file meanwhile
+    bool done = m_connectedPVs.forEachStep(m_saveCursor, SAVE_STEP, [this](const PvCache::Entry& pv) {
+        if (pv.ioc != PvCache::NO_IOC) {
+            auto& ioc = m_connectedPVs.getIoc(pv.ioc);
+            const auto [iocIp, iocPort] = ioc.guard->getIocAddr();
+            m_cacheFile->addToSnapshot({pv.pvname, iocIp, iocPort, ioc.udpPort, ioc.reply});
+        }
+    });
+    if (done) {
+        m_cacheFile->commitSnapshot();
+        m_saving = false;
+    }
+}
+
+Protocol::BytesView Dispatcher::caPvSearched(const std::string &pvname, const std::string &clientIP, uint16_t clientPort)
+{
+    auto pv = m_connectedPVs.find(pvname);
+    if (pv != nullptr && pv->ioc != PvCache::NO_IOC) {
+        auto& iocRecord = m_connectedPVs.getIoc(pv->ioc);
+        auto& ioc = iocRecord.guard;
+        if (pv->unverified && ioc->isConnected()) {
+            if (ioc->isEstablished() == false) {
+                LOG_INFO("Client ", DnsCache::resolveIP(clientIP), ":", clientPort, " searched for ", pvname, ": not verified yet, waiting for IOC to connect");
+                return Protocol::BytesView();
+            }
+            pv->unverified = false;
+            servePV(*pv);
+        }
+        if (ioc->isConnected()) {
+            const auto [iocIp, iocPort] = ioc->getIocAddr();
             LOG_INFO("Client ", DnsCache::resolveIP(clientIP), ":", clientPort, " searched for ", pvname, ": found in cache, redirecting to IOC ", DnsCache::resolveIP(iocIp), ":", iocPort);
-            return pv.response;
+            return iocRecord.reply;
         }
-        // The IOC must got disconnected
+        // The IOC must got disconnected, most likely it's restarting at the same address.
+        // IOC record may be released together with the PV.
+        auto guard = ioc;
+        auto udpPort = iocRecord.udpPort;
         m_connectedPVs.erase(pvname);
-    } catch (std::out_of_range&) {}
-
-    bool added = false;
-    for (auto& searcher: m_caSearchers) {
-        if (searcher->addPV(pvname) && !added) {
-            added = true;
+        unservePV(pvname);
+        if (m_cacheFile) {
+            m_cacheFile->remove(pvname);
+        }
+        if (m_caSearcher) {
+            const auto [iocIp, iocPort] = guard->getIocAddr();
+            if (m_caSearcher->addPV(pvname, iocIp, udpPort)) {
+                LOG_INFO("Client ", DnsCache::resolveIP(clientIP), ":", clientPort, " searched for ", pvname, ": IOC disconnected, probing IOC ", DnsCache::resolveIP(iocIp), " first");
+                return Protocol::BytesView();
+            }
         }
     }
-    if (added) {
+
+    if (m_caSearcher && m_caSearcher->addPV(pvname)) {
         LOG_INFO("Client ", DnsCache::resolveIP(clientIP), ":", clientPort, " searched for ", pvname, ": not in cache, started the search");
     } else {
         LOG_INFO("Client ", DnsCache::resolveIP(clientIP), ":", clientPort, " searched for ", pvname, ": not in cache, search in progress");
     }
-    return Protocol::Bytes();
+    return Protocol::BytesView();
+}
+
+bool Dispatcher::caPvLookup(const std::string &pvname, const std::string &clientIP, uint16_t clientPort, Protocol::Bytes& reply)
+{
+    // PVs of disconnected IOCs are withdrawn right away, IOC status is not checked here
+    if (m_servedPVs.find(pvname, reply) == false) {
+        return false;
+    }
+    // Listener threads don't wait for DnsCache, client is logged by IP
+    LOG_INFO("Client ", clientIP, ":", clientPort, " searched for ", pvname, ": found in cache, answered by listener thread");
+    return true;
+}
+
+void Dispatcher::servePV(const PvCache::Entry& pv)
+{
+    // IOC reply changes rarely, PVs keep the one they were found with until found again
+    if (m_config.listen_threads > 0 && pv.ioc != PvCache::NO_IOC && pv.unverified == false) {
+        m_servedPVs.insert(pv.pvname, m_connectedPVs.getIoc(pv.ioc).reply, &pv.referenced, &pv.lastLookup);
+    }
+}
+
+void Dispatcher::unservePV(const std::string& pvname)
+{
+    if (m_config.listen_threads > 0) {
+        m_servedPVs.erase(pvname);
+    }
 }
 
 void Dispatcher::addListener(const std::string& ip, uint16_t port, Dispatcher::Proto proto)
@@ -104,35 +398,137 @@ void Dispatcher::addListener(const std::string& ip, uint16_t port, Dispatcher::P
     }
 }
 
-void Dispatcher::addSearcher(const std::string& ip, uint16_t port, Dispatcher::Proto proto, const std::vector<uint32_t>& searchIntervals)
+void Dispatcher::addListenerThreads(unsigned nThreads, const std::vector<unsigned>& cpus, Dispatcher::Proto proto)
+{
+    using namespace std::placeholders;
+
+    if (proto == Proto::CHANNEL_ACCESS) {
+        // Reply from the main thread is not needed, client gets it from the cache on its next search
+        m_missQueue.reset(new MissQueue([this](const std::string& pvname, const std::string& clientIP, uint16_t clientPort) {
+            caPvSearched(pvname, clientIP, clientPort);
+        }));
+        ConnectionsManager::add(m_missQueue);
+
+        ListenerThread::LookupCb lookupCb = std::bind(&Dispatcher::caPvLookup, this, _1, _2, _3, _4);
+        ListenerThread::MissCb missCb = std::bind(&MissQueue::push, m_missQueue.get(), _1, _2, _3);
+        for (unsigned i = 0; i < nThreads; i++) {
+            int cpu = (cpus.empty() ? -1 : static_cast<int>(cpus[i % cpus.size()]));
+            m_listenerThreads.emplace_back(new ListenerThread(m_config.ca_listen_addresses, m_config.access_control, m_caProto, lookupCb, missCb, cpu));
+        }
+    }
+    for (auto& thread: m_listenerThreads) {
+        thread->start();
+    }
+}
+
+void Dispatcher::addBeaconListener(const std::string& ip, uint16_t port, Dispatcher::Proto proto)
+{
+    using namespace std::placeholders;
+    std::shared_ptr<BeaconListener> listener;
+
+    if (proto == Proto::CHANNEL_ACCESS) {
+        BeaconListener::IocStartedCb iocStartedCb = std::bind(&Dispatcher::caIocStarted, this, _1, _2);
+        listener.reset(new BeaconListener(ip, port, m_caProto, iocStartedCb));
+    }
+    if (listener) {
+        m_caBeaconListeners.emplace_back(listener);
+        ConnectionsManager::add(listener);
+    }
+}
+
+void Dispatcher::addSearcher(const std::vector<Searcher::SearchAddress>& addresses, Dispatcher::Proto proto, const std::vector<uint32_t>& searchIntervals)
 {
     using namespace std::placeholders;
     std::shared_ptr<Searcher> searcher;
 
     if (proto == Proto::CHANNEL_ACCESS) {
-        Searcher::PvFoundCb pvFoundCb = std::bind(&Dispatcher::caPvFound, this, _1, _2, _3, _4);
-        searcher.reset(new Searcher(ip, port, searchIntervals, m_caProto, pvFoundCb));
+        Searcher::PvFoundCb pvFoundCb = std::bind(&Dispatcher::caPvFound, this, _1, _2, _3, _4, _5);
+        searcher.reset(new Searcher(addresses, searchIntervals, m_caProto, pvFoundCb));
     }
     if (searcher) {
-        m_caSearchers.emplace_back(searcher);
+        m_caSearcher = searcher;
         ConnectionsManager::add(searcher);
     }
 }
 
-void Dispatcher::run(double timeout)
+void Dispatcher::run()
 {
-    ConnectionsManager::run(timeout);
-    auto diff = (std::chrono::steady_clock::now() - m_lastPurge);
-    auto duration = std::chrono::duration_cast<std::chrono::seconds>(diff).count();
-    if (duration > m_config.purge_delay) {
+    // Sleep until the next maintenance task, connections schedule their own wakeups
+    auto nextTask = m_lastPurge + std::chrono::seconds(m_config.purge_delay);
+    if (m_cacheFile) {
+        nextTask = std::min(nextTask, m_lastCacheSave + std::chrono::seconds(m_config.cache_save_interval));
+    }
+    nextTask = std::min(nextTask, m_connectScheduler.nextWakeup());
+    for (auto& suspect: m_suspects) {
+        nextTask = std::min(nextTask, suspect.second);
+    }
+    std::chrono::duration<double> timeout = nextTask - std::chrono::steady_clock::now();
+    ConnectionsManager::run((m_purging || m_saving) ? 0.0 : std::max(0.0, timeout.count()));
+    m_connectScheduler.process();
+    checkSuspects();
+
+    if (m_cacheFile) {
+        m_cacheFile->flush();
+        // Finishes the snapshot once written in the background
+        m_cacheFile->isCommitting();
+        if (m_saving == false && (std::chrono::steady_clock::now() - m_lastCacheSave) >= std::chrono::seconds(m_config.cache_save_interval)) {
+            saveCache();
+        }
+        if (m_saving) {
+            saveCacheStep();
+        }
+    }
+    if ((std::chrono::steady_clock::now() - m_lastPurge) >= std::chrono::seconds(m_config.purge_delay)) {
+        m_purging = true;
+    }
+    if (m_purging && m_caSearcher && m_caSearcher->purgeStep(m_config.purge_delay, PURGE_STEP) == false) {
+        // Continue in the next run
+        return;
+    }
+    if (m_purging) {
+        m_purging = false;
         uint32_t nPurged = 0;
         uint32_t nRemain = 0;
-        for (auto& searcher: m_caSearchers) {
-            auto [p, r] = searcher->purgePVs(m_config.purge_delay);
-            nPurged += p;
-            nRemain += r;
+        Searcher::Stats stats;
+        size_t backlog = 0;
+        if (m_caSearcher) {
+            std::tie(nPurged, nRemain) = m_caSearcher->getPurgeResult();
+            stats = m_caSearcher->getTotalStats();
+            backlog = m_caSearcher->getBacklog();
         }
         m_lastPurge = std::chrono::steady_clock::now();
-        LOG_INFO("Purged ", nPurged, " PVs, still searching for ", nRemain, " PVs, ", m_connectedPVs.size(), " PVs are connected");
+        m_servedPVs.reclaim();
+        m_connectScheduler.purge();
+        LOG_INFO("Purged ", nPurged, " PVs, still searching for ", nRemain, " PVs, ", m_connectedPVs.size(), " PVs are connected on ", m_iocs.size(), " IOCs");
+        for (auto& [addr, ioc]: m_iocs) {
+            LOG_VERBOSE("IOC ", DnsCache::resolveIP(addr.first), ":", addr.second, " has ", m_connectedPVs.getIoc(ioc).nPvs, " PVs in cache");
+        }
+        if (m_connectScheduler.getWaiting() > 0 || m_connectScheduler.getUnreachable() > 0) {
+            LOG_INFO(m_connectScheduler.getWaiting(), " IOCs waiting to connect, ", m_connectScheduler.getConnecting(), " connecting, ", m_connectScheduler.getUnreachable(), " unreachable");
+        }
+        LOG_INFO("Sent ", stats.packets, " search packets (", stats.bytes, " bytes) since start");
+        auto& cacheStats = m_connectedPVs.getStats();
+        LOG_INFO("Cache had ", cacheStats.hits, " hits, ", cacheStats.misses, " misses and ", cacheStats.evictions, " evictions since start");
+        if (m_listenerThreads.empty() == false) {
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+            for (size_t i = 0; i < m_listenerThreads.size(); i++) {
+                hits += m_listenerThreads[i]->getHits();
+                misses += m_listenerThreads[i]->getMisses();
+                LOG_VERBOSE("Listener thread ", i, " answered ", m_listenerThreads[i]->getHits(), " searches from cache and passed on ", m_listenerThreads[i]->getMisses(), " since start");
+            }
+            LOG_INFO("Listener threads answered ", hits, " searches from cache and passed on ", misses, " since start");
+        }
+        if (m_caSearcher && m_caSearcher->getEvictions() > 0) {
+            LOG_INFO("Dropped ", m_caSearcher->getEvictions(), " PVs from the search list to make space since start");
+        }
+        if (stats.deferred > 0) {
+            LOG_INFO("Search budget deferred ", stats.deferred, " searches by a tick since start, ", backlog, " searches waiting");
+        }
+        if (m_caSearcher && m_caSearcher->getNegativeCache().isEnabled()) {
+            auto& negCache = m_caSearcher->getNegativeCache();
+            auto& negStats = negCache.getStats();
+            LOG_INFO("Negative cache has ", negCache.size(), " PVs, ", negStats.hits, " hits, ", negStats.filterHits, " filter-only hits, ", negStats.misses, " misses, ", negStats.evictions, " evictions since start");
+        }
     }
 }
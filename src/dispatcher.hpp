@@ -5,9 +5,17 @@
 
 #pragma once
 
+#include "beacon.hpp"
+#include "cachefile.hpp"
+#include "concurrentcache.hpp"
+#include "connectscheduler.hpp"
+#include "echoprober.hpp"
 #include "proto_ca.hpp"
 #include "iocguard.hpp"
 #include "listener.hpp"
+#include "listenerthread.hpp"
+#include "missqueue.hpp"
+#include "pvcache.hpp"
 #include "searcher.hpp"
 
 #include <memory>
@@ -21,30 +29,18 @@
  * It handles the flow of logic:
  * 1. Client asks for PV (via Listener callback `caPvSearched`).
  * 2. Dispatcher checks cache.
- * 3. If missing, it adds PV to Searchers (`addPV`).
+ * 3. If missing, it adds PV to the Searcher (`addPV`).
  * 4. When Searcher finding a PV (`caPvFound`), Dispatcher updates cache.
+ *
+ * With listener threads, client searches are received by the threads instead.
+ * They look up PVs in a concurrent copy of verified cached PVs (`caPvLookup`)
+ * and hand the rest over to the main thread, which handles them like above.
+ * Everything else runs in the main thread, which keeps the copy up to date.
  */
 class Dispatcher {
-    private:
+    protected:
         typedef std::pair<std::string, uint16_t> Address;
 
-        /**
-         * @struct PvInfo
-         * @brief Internal record for a cached/known PV.
-         */
-        struct PvInfo {
-            /** 
-             * Pointer to the IOC structure (may be empty) to determine IOC status.
-             * This is shared by all PVs residing on the same IOC and allows for quick
-             * determination if the PV is valid or not. When IOC disconnects, its
-             * status will change.
-             */
-            std::shared_ptr<IocGuard> ioc;
-
-            /** Raw packet response from the IOC, returned to the client */
-            Protocol::Bytes response;
-        };
-
         /**
          * @brief Supported protocol types.
          */
@@ -52,13 +48,104 @@ class Dispatcher {
             CHANNEL_ACCESS,
         };
 
+        /**
+         * Max number of search slots checked for purging in a single run(),
+         * so that client requests are not delayed by purging a long search list.
+         */
+        static constexpr size_t PURGE_STEP = 10000;
+
+        /**
+         * Max number of cache slots added to the snapshot in a single run(),
+         * for the same reason.
+         */
+        static constexpr size_t SAVE_STEP = 10000;
+
         const Config& m_config;
         std::chrono::steady_clock::time_point m_lastPurge;
+        bool m_purging = false;
         std::shared_ptr<ChannelAccess> m_caProto;
-        std::map<Address, std::shared_ptr<IocGuard>> m_iocs;
-        std::vector<std::shared_ptr<Searcher>> m_caSearchers;
+        std::map<Address, uint32_t> m_iocs;     ///< Ids of connected IOCs in m_connectedPVs.
+        std::shared_ptr<Searcher> m_caSearcher;
         std::vector<std::shared_ptr<Listener>> m_caListeners;
-        std::map<std::string, PvInfo> m_connectedPVs;
+        std::vector<std::shared_ptr<BeaconListener>> m_caBeaconListeners;
+        PvCache m_connectedPVs;
+        ConcurrentPvCache m_servedPVs;          ///< PVs listener threads reply to, only kept with threads.
+        std::unique_ptr<CacheFile> m_cacheFile;
+        std::chrono::steady_clock::time_point m_lastCacheSave;
+        bool m_saving = false;                  ///< Snapshot is being filled by saveCacheStep().
+        size_t m_saveCursor = 0;                ///< Next cache slot to add to the snapshot.
+        std::shared_ptr<MissQueue> m_missQueue;
+        std::shared_ptr<EchoProber> m_echoProber;  ///< Monitors IOCs instead of TCP connections when set.
+        ConnectScheduler m_connectScheduler;        ///< Paces TCP connections to IOCs.
+        std::map<Address, std::chrono::steady_clock::time_point> m_suspects; ///< Disconnected IOCs being reconnected, until their grace period ends.
+        std::vector<std::unique_ptr<ListenerThread>> m_listenerThreads; ///< Last, stopped before the rest is destroyed.
+
+        /**
+         * @brief Returns the id of the IOC, creating its guard and record if needed.
+         *
+         * New IOCs are monitored with UDP echo probes when enabled and their UDP
+         * port is known and not shared with another probed IOC, otherwise with
+         * a TCP connection started by m_connectScheduler.
+         *
+         * @param iocIP IP address of the IOC.
+         * @param iocPort Port of the IOC.
+         * @param udpPort UDP port where the IOC accepts searches, 0 when not known.
+         * @return IOC id in m_connectedPVs, PvCache::NO_IOC when connection could not be created.
+         */
+        uint32_t getIoc(const std::string& iocIP, uint16_t iocPort, uint16_t udpPort);
+
+        /**
+         * @brief Creates a guard for the IOC and starts monitoring it.
+         *
+         * @param iocIP IP address of the IOC.
+         * @param iocPort Port of the IOC.
+         * @param udpPort UDP port where the IOC accepts searches, 0 when not known.
+         * @return New guard, empty when it could not be created.
+         */
+        std::shared_ptr<IocGuard> createGuard(const std::string& iocIP, uint16_t iocPort, uint16_t udpPort);
+
+        /**
+         * @brief Removes the IOC and all its PVs from the cache and the cache file.
+         *
+         * Removed PVs are searched for again as configured by orphan_search.
+         *
+         * @return Number of removed PVs.
+         */
+        size_t removeIoc(std::map<Address, uint32_t>::iterator it);
+
+        /**
+         * @brief Restores PVs of reconnected suspect IOCs and removes IOCs whose grace period passed.
+         */
+        void checkSuspects();
+
+        /**
+         * @brief Loads previously found PVs from the cache file.
+         *
+         * Loaded PVs are not returned to clients until their IOC connects.
+         */
+        void loadCache();
+
+        /**
+         * @brief Starts writing all cached PVs to a new snapshot of the cache file.
+         *
+         * PVs are added by saveCacheStep() over the next run() iterations.
+         */
+        void saveCache();
+
+        /**
+         * @brief Adds the next cached PVs to the snapshot, commits it after the last one.
+         */
+        void saveCacheStep();
+
+        /**
+         * @brief Lets listener threads reply to the PV when it's ready to be returned to clients.
+         */
+        void servePV(const PvCache::Entry& pv);
+
+        /**
+         * @brief Stops listener threads from replying to the PV.
+         */
+        void unservePV(const std::string& pvname);
 
         /**
          * @brief Adds a new listener for incoming client connections.
@@ -68,20 +155,51 @@ class Dispatcher {
          * @param proto The protocol type this listener handles.
          */
         void addListener(const std::string& ip, uint16_t port, Proto proto);
+
         /**
-         * @brief Adds a new searcher to discover IOCs.
+         * @brief Starts threads answering client searches on all listen addresses.
+         *
+         * @param nThreads Number of threads.
+         * @param cpus CPUs to pin threads to, round-robin, empty for no pinning.
+         * @param proto The protocol type the threads handle.
+         */
+        void addListenerThreads(unsigned nThreads, const std::vector<unsigned>& cpus, Proto proto);
+
+        /**
+         * @brief Creates the searcher to discover IOCs.
          * 
-         * @param ip IP address for sending search requests.
-         * @param port Port for sending search requests.
+         * @param addresses Destinations for sending search requests.
          * @param proto The protocol type this searcher handles.
          * @param searchIntervals Vector of intervals (in seconds) for search retries.
          */
-        void addSearcher(const std::string& ip, uint16_t port, Proto proto, const std::vector<uint32_t>& searchIntervals);
+        void addSearcher(const std::vector<Searcher::SearchAddress>& addresses, Proto proto, const std::vector<uint32_t>& searchIntervals);
+
+        /**
+         * @brief Adds a new listener for IOC beacons.
+         *
+         * @param ip IP address to listen on.
+         * @param port Port to listen on.
+         * @param proto The protocol type this listener handles.
+         */
+        void addBeaconListener(const std::string& ip, uint16_t port, Proto proto);
+
+        /**
+         * @brief Callback for when a new or restarted IOC is detected from its beacons.
+         *
+         * Expedites searches of all PVs that are still being searched for.
+         *
+         * @param iocIP IP address of the IOC.
+         * @param iocPort Port of the IOC.
+         */
+        void caIocStarted(const std::string& iocIP, uint16_t iocPort);
 
         /**
          * @brief Callback for when an IOC disconnects.
          * 
-         * Marks all PVs associated with this IOC as invalid.
+         * Removes all PVs associated with this IOC from the cache and the cache file.
+         * With a grace period, the IOC becomes suspect instead. Its PVs are kept
+         * but not returned to clients while a new guard reconnects to the same
+         * address, and are only removed when the grace period passes.
          * 
          * @param iocIP IP address of the disconnected IOC.
          * @param port Port of the disconnected IOC.
@@ -95,9 +213,10 @@ class Dispatcher {
          * @param pvname The name of the found PV.
          * @param iocIP IP address of the IOC hosting the PV.
          * @param iocPort Port of the IOC hosting the PV.
+         * @param udpPort UDP port the IOC responded from.
          * @param response Raw packet response from the IOC.
          */
-        void caPvFound(const std::string& pvname, const std::string& iocIP, uint16_t iocPort, const Protocol::Bytes& response);
+        void caPvFound(const std::string& pvname, const std::string& iocIP, uint16_t iocPort, uint16_t udpPort, const Protocol::Bytes& response);
         /**
          * @brief Callback for when a client searches for a Channel Access PV.
          * 
@@ -106,9 +225,23 @@ class Dispatcher {
          * @param pvname The name of the PV being searched for.
          * @param clientIP IP address of the client.
          * @param clientPort Port of the client.
-         * @return Raw packet response to be sent back to the client.
+         * @return View of the raw packet response to be sent back to the client, empty when not found.
          */
-        Protocol::Bytes caPvSearched(const std::string &pvname, const std::string &clientIP, uint16_t clientPort);
+        Protocol::BytesView caPvSearched(const std::string &pvname, const std::string &clientIP, uint16_t clientPort);
+
+        /**
+         * @brief Callback for when a client searches for a PV in a listener thread.
+         *
+         * Only PVs ready to be returned to clients are considered, everything else
+         * is handled by caPvSearched() in the main thread.
+         *
+         * @param pvname The name of the PV being searched for.
+         * @param clientIP IP address of the client.
+         * @param clientPort Port of the client.
+         * @param reply Filled with the response packet when found.
+         * @return True when the PV was found.
+         */
+        bool caPvLookup(const std::string &pvname, const std::string &clientIP, uint16_t clientPort, Protocol::Bytes& reply);
 
     public:
         /**
@@ -124,9 +257,8 @@ class Dispatcher {
          * @brief Main processing loop.
          * 
          * Drives the ConnectionsManager loop and performs periodic maintenance tasks
-         * (like purging stale PVs).
-         * 
-         * @param timeout Max wait time for the IO loop step.
+         * (like purging stale PVs). Sleeps until the next IO event, connection
+         * wakeup or maintenance task, whichever comes first.
          */
-        void run(double timeout = 0.1);
+        void run();
 };
\ No newline at end of file
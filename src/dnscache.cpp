@@ -9,6 +9,7 @@
 
 #include <chrono>
 #include <map>
+#include <mutex>
 #include <vector>
 
 struct Entry {
@@ -17,24 +18,30 @@ struct Entry {
 };
 
 static std::map<std::string, Entry> g_cache;
+static std::mutex g_mutex; ///< Listener threads log client names too.
 
 std::string DnsCache::resolveIP(const std::string &ip)
 {
     auto now = std::chrono::steady_clock::now();
-    auto it = g_cache.find(ip);
-    if (it != g_cache.end()) {
-        if (now <= it->second.expires) {
-            return it->second.host;
-        } else {
-            g_cache.erase(it);
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        auto it = g_cache.find(ip);
+        if (it != g_cache.end()) {
+            if (now <= it->second.expires) {
+                return it->second.host;
+            } else {
+                g_cache.erase(it);
+            }
         }
     }
 
+    // Don't hold the lock during lookup, other threads may resolve cached names meanwhile
     auto host = _getHost(ip);
     auto expires = now + std::chrono::seconds(_getTtl(ip));
     if (host.empty()) {
         host = ip;
     }
+    std::lock_guard<std::mutex> lock(g_mutex);
     g_cache[ip] = { host, expires };
 
     return host;
@@ -13,7 +13,7 @@
  * 
  * Used primarily for performance purposes to manually resolve IP addresses to hostnames
  * to make log outputs more readable. After initial lookup, it caches results to avoid
- * stalling the application on repeated lookups.
+ * stalling the application on repeated lookups. Can be used from several threads.
  */
 class DnsCache {
     public:
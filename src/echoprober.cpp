@@ -0,0 +1,119 @@
+#include "echoprober.hpp"
+#include "dnscache.hpp"
+#include "logging.hpp"
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+EchoProber::EchoProber(const std::shared_ptr<Protocol>& protocol, unsigned interval, unsigned maxMissed)
+    : m_request(protocol->createEchoRequest(true))
+    , m_batch(1024, 64)
+    , m_interval(interval)
+    , m_maxMissed(maxMissed)
+    , m_nextRound(std::chrono::steady_clock::now() + m_interval)
+{
+    m_udpReceive = true;
+    m_sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (m_sock < 0) {
+        throw SocketException("failed to create socket", errno);
+    }
+
+    if (::fcntl(m_sock, F_SETFL, fcntl(m_sock, F_GETFL, 0) | O_NONBLOCK) == -1) {
+        ::close(m_sock);
+        throw SocketException("failed to set socket non-blocking", errno);
+    }
+}
+
+EchoProber::~EchoProber()
+{
+    if (m_sock != -1) {
+        ::close(m_sock);
+    }
+}
+
+bool EchoProber::add(const std::shared_ptr<IocGuard>& guard, uint16_t udpPort)
+{
+    in_addr ip;
+    if (::inet_aton(guard->getIocAddr().first.c_str(), &ip) == 0) {
+        LOG_ERROR("Can't probe IOC with invalid address ", guard->getIocAddr().first);
+        return false;
+    }
+
+    // Responses from a shared address can't be told apart, only one IOC may use it.
+    // Previous guard is replaced only when its IOC was lost and found again.
+    Address addr{ip.s_addr, ::htons(udpPort)};
+    auto& target = m_targets[addr];
+    auto previous = target.guard.lock();
+    if (previous && previous != guard && previous->isConnected()) {
+        return false;
+    }
+    target = Target();
+    target.guard = guard;
+    sendProbe(addr, target);
+    wakeupAt(std::chrono::steady_clock::now());
+    return true;
+}
+
+void EchoProber::sendProbe(const Address& addr, Target& target)
+{
+    sockaddr_in remoteAddr = {};
+    remoteAddr.sin_family = AF_INET;
+    remoteAddr.sin_addr.s_addr = addr.first;
+    remoteAddr.sin_port = addr.second;
+    m_batch.send(m_sock, m_request.data(), m_request.size(), remoteAddr);
+    target.pending = true;
+}
+
+void EchoProber::probeAll()
+{
+    for (auto it = m_targets.begin(); it != m_targets.end(); ) {
+        auto guard = it->second.guard.lock();
+        if (!guard || guard->isConnected() == false) {
+            it = m_targets.erase(it);
+            continue;
+        }
+
+        auto& target = it->second;
+        if (target.pending) {
+            target.nMissed++;
+            LOG_DEBUG("IOC ", DnsCache::resolveIP(guard->getIocAddr().first), ":", guard->getIocAddr().second, " missed ", target.nMissed, " echo probes");
+        }
+        if (target.nMissed >= m_maxMissed) {
+            // Guard is kept alive by the local reference while the IOC is removed
+            it = m_targets.erase(it);
+            guard->echoLost(m_maxMissed);
+            continue;
+        }
+        sendProbe(it->first, target);
+        it++;
+    }
+}
+
+void EchoProber::processIncoming()
+{
+    m_batch.receive(m_sock, [this](const unsigned char*, size_t, const sockaddr_in& remoteAddr) {
+        // Any response from the IOC's address proves it's alive
+        auto it = m_targets.find(Address{remoteAddr.sin_addr.s_addr, remoteAddr.sin_port});
+        if (it == m_targets.end()) {
+            return;
+        }
+        it->second.nMissed = 0;
+        it->second.pending = false;
+        auto guard = it->second.guard.lock();
+        if (guard) {
+            guard->echoReceived();
+        }
+    });
+}
+
+void EchoProber::processOutgoing()
+{
+    auto now = std::chrono::steady_clock::now();
+    if (now >= m_nextRound) {
+        m_nextRound = now + m_interval;
+        probeAll();
+    }
+    m_batch.flush(m_sock);
+    wakeupAt(m_nextRound);
+}
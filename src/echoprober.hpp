@@ -0,0 +1,99 @@
+/**
+ * @file echoprober.hpp
+ * @brief IOC liveness checks with UDP echo probes.
+ */
+
+#pragma once
+
+#include "connection.hpp"
+#include "iocguard.hpp"
+#include "proto.hpp"
+#include "udpbatch.hpp"
+
+#include <chrono>
+#include <map>
+#include <memory>
+
+/**
+ * @class EchoProber
+ * @brief Monitors all IOCs through a single UDP socket.
+ *
+ * Instead of keeping a TCP connection to every IOC, echo requests are sent
+ * periodically to the UDP port where each IOC accepts searches. Probes of
+ * all IOCs go out in batches. An IOC that doesn't respond to several probes
+ * in a row is reported lost through its IocGuard, same as a closed TCP
+ * connection.
+ *
+ * IOCs are recognized by the address responses come from. IOCs sharing the
+ * same host and UDP port can't be told apart, only the first one is probed.
+ */
+class EchoProber : public Connection {
+    private:
+        typedef std::pair<uint32_t, uint16_t> Address; ///< IP and UDP port, both in network byte order.
+
+        /**
+         * @brief Probed IOC.
+         */
+        struct Target {
+            std::weak_ptr<IocGuard> guard;  ///< Released when the IOC is forgotten.
+            unsigned nMissed = 0;           ///< Consecutive probes without response.
+            bool pending = false;           ///< Response to the last probe not received yet.
+        };
+
+        std::map<Address, Target> m_targets;
+        Protocol::Bytes m_request;
+        UdpBatch m_batch;
+        std::chrono::seconds m_interval;
+        unsigned m_maxMissed;
+        std::chrono::steady_clock::time_point m_nextRound;
+
+        /**
+         * @brief Queues an echo request to the IOC.
+         */
+        void sendProbe(const Address& addr, Target& target);
+
+        /**
+         * @brief Reports IOCs that missed too many probes and probes the rest.
+         */
+        void probeAll();
+
+    public:
+        /**
+         * @brief Creates the UDP socket for probes.
+         *
+         * @param protocol Protocol handler used to create echo requests.
+         * @param interval Time between probes of the same IOC in seconds.
+         * @param maxMissed Number of consecutive unanswered probes after which IOC is lost.
+         * @throws SocketException when the socket can't be created.
+         */
+        EchoProber(const std::shared_ptr<Protocol>& protocol, unsigned interval, unsigned maxMissed);
+
+        ~EchoProber();
+
+        /**
+         * @brief Starts probing the IOC, the first probe is sent right away.
+         *
+         * IOCs sharing the UDP port with an IOC already probed are refused,
+         * they need to be monitored over TCP.
+         *
+         * @param guard Guard of the IOC, created without TCP connection.
+         * @param udpPort UDP port where the IOC accepts searches.
+         * @return False when the IOC can't be probed.
+         */
+        bool add(const std::shared_ptr<IocGuard>& guard, uint16_t udpPort);
+
+        /**
+         * @brief Returns the number of probed IOCs.
+         */
+        size_t size() const { return m_targets.size(); }
+
+        /**
+         * @brief Receives responses to probes.
+         */
+        void processIncoming();
+
+        /**
+         * @brief Sends probes every interval and flushes queued ones.
+         */
+        void processOutgoing();
+};
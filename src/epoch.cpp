@@ -0,0 +1,81 @@
+#include "epoch.hpp"
+
+#include <algorithm>
+
+EpochDomain::Guard::Guard(EpochDomain& domain)
+    : m_domain(domain)
+{
+    // Spread threads over slots, so that they rarely compete for one
+    static std::atomic<unsigned> nextHint{0};
+    static thread_local unsigned hint = nextHint++;
+
+    // Announced epoch may be older than the current one, that only delays reclamation
+    for (unsigned i = hint; ; i++) {
+        uint64_t expected = 0;
+        auto& slot = m_domain.m_slots[i % MAX_READERS];
+        if (slot.epoch.compare_exchange_strong(expected, m_domain.m_epoch.load())) {
+            m_slot = i % MAX_READERS;
+            break;
+        }
+    }
+    // Reads of shared objects must not be done before the epoch is announced
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+EpochDomain::Guard::~Guard()
+{
+    m_domain.m_slots[m_slot].epoch.store(0, std::memory_order_release);
+}
+
+EpochDomain::~EpochDomain()
+{
+    for (auto& retired: m_retired) {
+        retired.deleter(retired.ptr);
+    }
+}
+
+void EpochDomain::retire(void* ptr, void (*deleter)(void*))
+{
+    bool full;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_retired.push_back({m_epoch.fetch_add(1), ptr, deleter});
+        full = (m_retired.size() >= RECLAIM_BATCH);
+    }
+    if (full) {
+        reclaim();
+    }
+}
+
+void EpochDomain::reclaim()
+{
+    // Readers that announced a newer epoch came after the objects were unlinked.
+    // Objects retired during the scan are newer than the starting epoch.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = m_epoch.load();
+    for (auto& slot: m_slots) {
+        auto epoch = slot.epoch.load();
+        if (epoch != 0) {
+            oldest = std::min(oldest, epoch);
+        }
+    }
+
+    std::vector<Retired> expired;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = std::partition(m_retired.begin(), m_retired.end(), [oldest](const Retired& retired) {
+            return retired.epoch >= oldest;
+        });
+        expired.assign(it, m_retired.end());
+        m_retired.erase(it, m_retired.end());
+    }
+    for (auto& retired: expired) {
+        retired.deleter(retired.ptr);
+    }
+}
+
+size_t EpochDomain::pending()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_retired.size();
+}
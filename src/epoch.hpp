@@ -0,0 +1,100 @@
+/**
+ * @file epoch.hpp
+ * @brief Epoch based reclamation of memory shared with lock-free readers.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+/**
+ * @class EpochDomain
+ * @brief Defers freeing of objects until no reader can be using them.
+ *
+ * Readers wrap every access in a Guard, which announces the current epoch in
+ * a reader slot, without taking any lock. Writers first unlink an object so
+ * that new readers can't reach it, then retire it. Every retirement advances
+ * the epoch, the object is freed once all readers active at that time have
+ * left, ie. when every announced epoch is newer than the retirement.
+ */
+class EpochDomain {
+    private:
+        static constexpr unsigned MAX_READERS = 128;    ///< Concurrent readers, more wait for a free slot.
+        static constexpr size_t RECLAIM_BATCH = 64;     ///< Retired objects that trigger reclamation.
+
+        /**
+         * @struct Slot
+         * @brief Epoch announced by an active reader, 0 when free. One per cache line.
+         */
+        struct alignas(64) Slot {
+            std::atomic<uint64_t> epoch{0};
+        };
+
+        /**
+         * @struct Retired
+         * @brief Object waiting to be freed.
+         */
+        struct Retired {
+            uint64_t epoch;             ///< Epoch when retired.
+            void* ptr;
+            void (*deleter)(void*);
+        };
+
+        std::atomic<uint64_t> m_epoch{1};
+        Slot m_slots[MAX_READERS];
+        std::mutex m_mutex;             ///< Guards m_retired, writers only.
+        std::vector<Retired> m_retired;
+
+    public:
+        /**
+         * @class Guard
+         * @brief Protects objects reachable at construction time until destroyed.
+         */
+        class Guard {
+            private:
+                EpochDomain& m_domain;
+                unsigned m_slot;
+
+            public:
+                Guard(EpochDomain& domain);
+                ~Guard();
+                Guard(const Guard&) = delete;
+                Guard& operator=(const Guard&) = delete;
+        };
+
+        EpochDomain() = default;
+
+        /**
+         * @brief Frees all retired objects, there must be no readers left.
+         */
+        ~EpochDomain();
+
+        /**
+         * @brief Frees the object once no reader can be using it.
+         *
+         * Object must already be unreachable for new readers.
+         */
+        void retire(void* ptr, void (*deleter)(void*));
+
+        template <typename T>
+        void retire(T* ptr)
+        {
+            retire(ptr, [](void* p) { delete static_cast<T*>(p); });
+        }
+
+        /**
+         * @brief Frees retired objects that no reader can be using anymore.
+         *
+         * Called automatically every few retirements, calling it explicitly
+         * frees the rest when there are no more writes.
+         */
+        void reclaim();
+
+        /**
+         * @brief Returns number of objects waiting to be freed.
+         */
+        size_t pending();
+};
@@ -4,41 +4,61 @@
 
 #include <fcntl.h>
 #include <poll.h>
+#include <sys/socket.h>
 #include <unistd.h>
 
-IocGuard::IocGuard(const std::string& iocIp, uint16_t iocPort, const std::shared_ptr<Protocol>& protocol, DisconnectCb& disconnectCb)
+#include <cstring>
+
+IocGuard::IocGuard(const std::string& iocIp, uint16_t iocPort, const std::shared_ptr<Protocol>& protocol, DisconnectCb& disconnectCb, bool useTcp)
     : m_protocol(protocol)
     , m_disconnectCb(disconnectCb)
     , m_ip(iocIp)
     , m_port(iocPort)
+    , m_probed(useTcp == false)
 {
-    m_sock = ::socket(AF_INET, SOCK_STREAM, 0);
-    if (m_sock < 0) {
-        throw SocketException("create socket", errno);
+    m_started = std::chrono::steady_clock::now();
+    if (m_probed) {
+        return;
     }
 
     m_addr = {}; // avoid using memset()
     m_addr.sin_family = AF_INET;
     m_addr.sin_port = ::htons(iocPort);
     if (::inet_aton(iocIp.c_str(), reinterpret_cast<in_addr*>(&m_addr.sin_addr.s_addr)) == 0) {
-        int err = errno;
-        ::close(m_sock);
-        m_sock = -1;
-        throw SocketException("invalid IP address", err);
+        throw SocketException("invalid IP address", errno);
     }
+    m_waiting = true;
+}
 
-    if (::fcntl(m_sock, F_SETFL, fcntl(m_sock, F_GETFL, 0) | O_NONBLOCK) == -1) {
-        throw SocketException("set socket non-blocking", errno);
+void IocGuard::connect()
+{
+    if (m_waiting == false) {
+        return;
     }
+    m_waiting = false;
+    m_started = std::chrono::steady_clock::now();
 
-    if (::connect(m_sock, reinterpret_cast<sockaddr*>(&m_addr), sizeof(m_addr)) != 0 && errno != EINPROGRESS) {
-        int err = errno;
-        ::close(m_sock);
-        m_sock = -1;
-        throw SocketException("connecting ", err);
-    }
+    try {
+        m_sock = ::socket(AF_INET, SOCK_STREAM, 0);
+        if (m_sock < 0) {
+            throw SocketException("create socket", errno);
+        }
 
-    m_started = std::chrono::steady_clock::now();
+        if (::fcntl(m_sock, F_SETFL, fcntl(m_sock, F_GETFL, 0) | O_NONBLOCK) == -1) {
+            throw SocketException("set socket non-blocking", errno);
+        }
+
+        if (::connect(m_sock, reinterpret_cast<sockaddr*>(&m_addr), sizeof(m_addr)) != 0 && errno != EINPROGRESS) {
+            throw SocketException("connecting", errno);
+        }
+    } catch (SocketException& e) {
+        LOG_INFO("Failed to connect to IOC ", DnsCache::resolveIP(m_ip), ":", m_port, ": ", e.what());
+        if (m_sock != -1) {
+            ::close(m_sock);
+            m_sock = -1;
+        }
+        m_disconnectCb(m_ip, m_port);
+    }
 }
 
 IocGuard::~IocGuard()
@@ -48,15 +68,31 @@ IocGuard::~IocGuard()
     }
 }
 
-void IocGuard::processIncoming()
+void IocGuard::stop()
 {
+    m_stopped = true;
+    m_waiting = false;
+    m_lost = true;
     if (m_sock != -1) {
+        ::close(m_sock);
+        m_sock = -1;
+    }
+}
+
+void IocGuard::processIncoming()
+{
+    // Read until the socket would block, readiness is only reported on changes
+    while (m_sock != -1) {
         char buffer[4096];
         auto recvd = ::recv(m_sock, buffer, sizeof(buffer), 0);
         if (recvd > 0) {
             LOG_VERBOSE("Received heart-beat response from IOC ", DnsCache::resolveIP(m_ip), ":", m_port);
             m_lastResponse = std::chrono::steady_clock::now();
             m_initialized = true;
+        } else if (recvd < 0 && errno == EINTR) {
+            continue;
+        } else if (recvd < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            break;
         } else {
             ::close(m_sock);
             m_sock = -1;
@@ -73,11 +109,13 @@ void IocGuard::processIncoming()
 void IocGuard::processOutgoing()
 {
     if (m_sock != -1 && checkConnection() == true) {
-        auto diff = (std::chrono::steady_clock::now() - m_lastRequest);
-        auto duration = std::chrono::duration_cast<std::chrono::seconds>(diff).count();
-        if (duration > m_heartbeatInterval) {
+        auto interval = std::chrono::seconds(m_heartbeatInterval);
+        if ((std::chrono::steady_clock::now() - m_lastRequest) >= interval) {
             sendHeartBeat();
         }
+        if (m_sock != -1) {
+            wakeupAt(m_lastRequest + interval);
+        }
     }
 }
 
@@ -90,17 +128,32 @@ bool IocGuard::checkConnection()
 
         auto pollret = ::poll(&pfd, 1, 0);
         if (pollret <= 0) {
-            auto diff = (std::chrono::steady_clock::now() - m_started);
-            auto duration = std::chrono::duration_cast<std::chrono::seconds>(diff).count();
-            if (duration > 5) {
-                LOG_INFO("Failed to connect to IOC ", DnsCache::resolveIP(m_ip), ":", m_port, " in 5 seconds, giving up...");
+            if ((std::chrono::steady_clock::now() - m_started) >= CONNECT_TIMEOUT) {
+                LOG_INFO("Failed to connect to IOC ", DnsCache::resolveIP(m_ip), ":", m_port, " in ", CONNECT_TIMEOUT.count(), " seconds, giving up...");
                 ::close(m_sock);
                 m_sock = -1;
                 m_disconnectCb(m_ip, m_port);
+            } else {
+                // Completed connect wakes us up sooner
+                wakeupAt(m_started + CONNECT_TIMEOUT);
             }
             return false;
         }
 
+        // Refused connection is writable too, only no pending error means connected
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (::getsockopt(m_sock, SOL_SOCKET, SO_ERROR, &err, &len) != 0) {
+            err = errno;
+        }
+        if (err != 0) {
+            LOG_INFO("Failed to connect to IOC ", DnsCache::resolveIP(m_ip), ":", m_port, ": ", strerror(err), ", giving up...");
+            ::close(m_sock);
+            m_sock = -1;
+            m_disconnectCb(m_ip, m_port);
+            return false;
+        }
+
         // poll() returned succesfully, we must be connected
         m_connected = true;
         m_lastResponse = std::chrono::steady_clock::now();
@@ -128,3 +181,21 @@ void IocGuard::sendHeartBeat()
     m_sock = -1;
     m_disconnectCb(m_ip, m_port);
 }
+
+void IocGuard::echoReceived()
+{
+    if (m_connected == false) {
+        LOG_VERBOSE("IOC ", DnsCache::resolveIP(m_ip), ":", m_port, " responded to echo probe");
+    }
+    m_connected = true;
+    m_lastResponse = std::chrono::steady_clock::now();
+}
+
+void IocGuard::echoLost(unsigned nMissed)
+{
+    if (m_lost == false) {
+        m_lost = true;
+        LOG_INFO("IOC ", DnsCache::resolveIP(m_ip), ":", m_port, " didn't respond to ", nMissed, " echo probes, disconnecting...");
+        m_disconnectCb(m_ip, m_port);
+    }
+}
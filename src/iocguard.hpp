@@ -19,6 +19,11 @@
  * Establishes and maintains a TCP connection to the IOC. If the connection drops or 
  * fails, it triggers a callback to cleanup any associated PVs in the Dispatcher.
  * This ensures that the system doesn't advertise PVs for an IOC that has gone offline.
+ * The connection is started by connect(), usually paced by ConnectScheduler. Until
+ * then the IOC is presumed alive.
+ *
+ * Alternatively the guard doesn't connect and only tracks the IOC status, while
+ * EchoProber checks the IOC over UDP and reports the results to the guard.
  */
 class IocGuard : public Connection {
     public:
@@ -29,6 +34,8 @@ class IocGuard : public Connection {
          */
         typedef std::function<void(const std::string& iocIP, uint16_t iocPort)> DisconnectCb;
     private:
+        static constexpr std::chrono::seconds CONNECT_TIMEOUT{5};   ///< Give up connecting to IOC after this time.
+
         std::shared_ptr<Protocol> m_protocol;
         DisconnectCb m_disconnectCb;
         std::string m_ip;
@@ -39,6 +46,10 @@ class IocGuard : public Connection {
         unsigned m_heartbeatInterval = 10;
         bool m_connected = false;
         bool m_initialized = false;
+        bool m_probed = false;      ///< Monitored with UDP echo probes, without TCP connection.
+        bool m_lost = false;        ///< Probed IOC stopped responding.
+        bool m_waiting = false;     ///< TCP connection not started yet.
+        bool m_stopped = false;     ///< Monitoring was stopped by the owner.
 
         /**
          * @brief Check if non-blocking socket is connected
@@ -57,11 +68,38 @@ class IocGuard : public Connection {
          * @param iocPort Port of the IOC (usually TCP).
          * @param protocol Shared pointer to the protocol handler (used to create echo packets).
          * @param disconnectCb Callback invoked on connection failure.
+         * @param useTcp Connect to the IOC, otherwise it's probed over UDP by EchoProber.
+         * @throws SocketException when IOC address is invalid.
          */
-        IocGuard(const std::string& iocIp, uint16_t iocPort, const std::shared_ptr<Protocol>& protocol, DisconnectCb& disconnectCb);
+        IocGuard(const std::string& iocIp, uint16_t iocPort, const std::shared_ptr<Protocol>& protocol, DisconnectCb& disconnectCb, bool useTcp = true);
         
         ~IocGuard();
 
+        /**
+         * @brief Starts connecting to the IOC, only once.
+         *
+         * The connection completes in the background. Failure to start it
+         * invokes the disconnect callback right away.
+         */
+        void connect();
+
+        /**
+         * @brief Stops monitoring the IOC without invoking the disconnect callback.
+         *
+         * Guard must be removed from ConnectionsManager by the caller.
+         */
+        void stop();
+
+        /**
+         * @brief Checks whether the TCP connection still needs to be started.
+         */
+        bool isWaiting() const { return m_waiting; }
+
+        /**
+         * @brief Checks whether the guard was stopped, rather than the IOC failing.
+         */
+        bool isStopped() const { return m_stopped; }
+
         /**
          * @brief Processes incoming TCP data (Echo responses).
          * 
@@ -72,7 +110,8 @@ class IocGuard : public Connection {
         /**
          * @brief Processes outgoing TCP data.
          * 
-         * Periodically sends heartbeat packets to the IOC.
+         * Periodically sends heartbeat packets to the IOC and requests a
+         * wakeup for the next one.
          */
         void processOutgoing();
 
@@ -81,4 +120,30 @@ class IocGuard : public Connection {
          * @return std::pair<std::string, uint16_t> IOC IP and Port.
          */
         std::pair<std::string, uint16_t> getIocAddr() { return std::make_pair(m_ip, m_port); }
+
+        /**
+         * @brief Checks whether the IOC was reached.
+         * @return bool True once the IOC accepted the connection or responded to
+         *              a probe, until it disconnects.
+         */
+        bool isEstablished() { return (isConnected() && m_connected); }
+
+        /**
+         * @brief Checks whether the IOC is considered alive.
+         * @return bool False once the IOC disconnected or stopped responding to probes.
+         */
+        bool isConnected() { return (m_probed ? (m_lost == false) : (m_waiting || m_sock != -1)); }
+
+        /**
+         * @brief Records a response to a UDP echo probe.
+         *
+         * The first response establishes the probed IOC.
+         */
+        void echoReceived();
+
+        /**
+         * @brief Declares the probed IOC lost and invokes the disconnect callback.
+         * @param nMissed Number of consecutive probes without response.
+         */
+        void echoLost(unsigned nMissed);
 };
\ No newline at end of file
@@ -0,0 +1,329 @@
+#ifdef __linux__
+
+#include "iouring.hpp"
+#include "connection.hpp"
+#include "logging.hpp"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <ctime>
+
+static void* mapRing(int fd, size_t size, off_t offset)
+{
+    auto ptr = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+    return (ptr == MAP_FAILED ? nullptr : ptr);
+}
+
+IoUring::IoUring(unsigned entries, unsigned nBuffers, size_t bufferSize)
+    : m_bufferSize(bufferSize)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    // Multishot polls of all sockets may complete at once, make space for them
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = 4 * entries;
+
+    m_fd = static_cast<int>(::syscall(__NR_io_uring_setup, entries, &params));
+    if (m_fd < 0) {
+        throw SocketException("io_uring_setup", errno);
+    }
+    if ((params.features & IORING_FEAT_EXT_ARG) == 0 || (params.features & IORING_FEAT_SINGLE_MMAP) == 0) {
+        ::close(m_fd);
+        throw SocketException("io_uring lacks required features", ENOTSUP);
+    }
+
+    // Both rings share the same mapping
+    m_ringsSize = std::max(params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                           params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe));
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_rings = mapRing(m_fd, m_ringsSize, IORING_OFF_SQ_RING);
+    m_sqes = static_cast<io_uring_sqe*>(mapRing(m_fd, m_sqesSize, IORING_OFF_SQES));
+    if (m_rings == nullptr || m_sqes == nullptr) {
+        int err = errno;
+        if (m_rings) {
+            ::munmap(m_rings, m_ringsSize);
+        }
+        if (m_sqes) {
+            ::munmap(m_sqes, m_sqesSize);
+        }
+        ::close(m_fd);
+        throw SocketException("mapping io_uring", err);
+    }
+
+    auto rings = static_cast<char*>(m_rings);
+    m_sqHead = reinterpret_cast<unsigned*>(rings + params.sq_off.head);
+    m_sqTail = reinterpret_cast<unsigned*>(rings + params.sq_off.tail);
+    m_sqArray = reinterpret_cast<unsigned*>(rings + params.sq_off.array);
+    m_sqMask = *reinterpret_cast<unsigned*>(rings + params.sq_off.ring_mask);
+    m_sqEntries = params.sq_entries;
+
+    m_cqHead = reinterpret_cast<unsigned*>(rings + params.cq_off.head);
+    m_cqTail = reinterpret_cast<unsigned*>(rings + params.cq_off.tail);
+    m_cqes = reinterpret_cast<io_uring_cqe*>(rings + params.cq_off.cqes);
+    m_cqMask = *reinterpret_cast<unsigned*>(rings + params.cq_off.ring_mask);
+
+    // Kernel picks receive buffers from a ring, it must be page aligned
+    m_bufRingSize = nBuffers * sizeof(io_uring_buf);
+    auto bufRing = ::mmap(nullptr, m_bufRingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    io_uring_buf_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(bufRing);
+    reg.ring_entries = nBuffers;
+    reg.bgid = BUFFER_GROUP;
+    if (bufRing == MAP_FAILED || ::syscall(__NR_io_uring_register, m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        int err = errno;
+        if (bufRing != MAP_FAILED) {
+            ::munmap(bufRing, m_bufRingSize);
+        }
+        ::munmap(m_sqes, m_sqesSize);
+        ::munmap(m_rings, m_ringsSize);
+        ::close(m_fd);
+        throw SocketException("registering io_uring buffers", err);
+    }
+    m_bufRing = static_cast<io_uring_buf_ring*>(bufRing);
+    m_bufMask = static_cast<uint16_t>(nBuffers - 1);
+    m_buffers.resize(nBuffers * m_bufferSize);
+    for (unsigned bid = 0; bid < nBuffers; bid++) {
+        addBuffer(static_cast<uint16_t>(bid));
+    }
+
+    std::memset(&m_recvHdr, 0, sizeof(m_recvHdr));
+    m_recvHdr.msg_namelen = sizeof(sockaddr_in);
+
+    m_sendSlots.resize(entries);
+    for (unsigned i = entries; i > 0; i--) {
+        m_freeSlots.push_back(i - 1);
+    }
+}
+
+IoUring::~IoUring()
+{
+    // Don't lose datagrams queued for sending
+    if (m_sqQueued > 0) {
+        enter(0, 0);
+    }
+    ::close(m_fd);
+    ::munmap(m_bufRing, m_bufRingSize);
+    ::munmap(m_sqes, m_sqesSize);
+    ::munmap(m_rings, m_ringsSize);
+}
+
+io_uring_sqe* IoUring::getSqe()
+{
+    // Kernel frees entries by advancing the head, possibly only some of them
+    auto tail = *m_sqTail;
+    for (unsigned attempt = 0; (tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE)) >= m_sqEntries; attempt++) {
+        if (attempt == SUBMIT_ATTEMPTS) {
+            LOG_ERROR("Failed to submit io_uring requests, submission ring is full");
+            return nullptr;
+        }
+        if (enter(0, 0) < 0) {
+            if (errno == EBUSY || errno == EAGAIN) {
+                // Completion ring overflowed, kernel submits again once there's space
+                reap(m_reaped);
+            } else if (errno != EINTR) {
+                LOG_ERROR("Failed to submit io_uring requests: ", strerror(errno));
+                return nullptr;
+            }
+        }
+    }
+
+    auto idx = tail & m_sqMask;
+    auto sqe = &m_sqes[idx];
+    std::memset(sqe, 0, sizeof(*sqe));
+    m_sqArray[idx] = idx;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    m_sqQueued++;
+    return sqe;
+}
+
+int IoUring::enter(unsigned minComplete, int timeoutMs)
+{
+    unsigned flags = 0;
+    io_uring_getevents_arg arg;
+    std::memset(&arg, 0, sizeof(arg));
+    __kernel_timespec ts;
+    if (minComplete > 0) {
+        flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+        arg.sigmask_sz = _NSIG / 8;
+        if (timeoutMs >= 0) {
+            ts.tv_sec = timeoutMs / 1000;
+            ts.tv_nsec = (timeoutMs % 1000) * 1000000L;
+            arg.ts = reinterpret_cast<uint64_t>(&ts);
+        }
+    }
+
+    auto ret = ::syscall(__NR_io_uring_enter, m_fd, m_sqQueued, minComplete, flags, (minComplete > 0 ? &arg : nullptr), sizeof(arg));
+    if (ret >= 0) {
+        m_sqQueued -= std::min<unsigned>(m_sqQueued, static_cast<unsigned>(ret));
+    }
+    return static_cast<int>(ret);
+}
+
+bool IoUring::pollAdd(int fd, uint32_t events, uint64_t userData)
+{
+    auto sqe = getSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = events;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::recvMsg(int fd, uint64_t userData)
+{
+    auto sqe = getSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&m_recvHdr);
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = BUFFER_GROUP;
+    sqe->user_data = userData;
+    return true;
+}
+
+bool IoUring::getDatagram(const io_uring_cqe& cqe, const unsigned char*& data, size_t& len, sockaddr_in& remoteAddr) const
+{
+    if (cqe.res <= 0 || (cqe.flags & IORING_CQE_F_BUFFER) == 0) {
+        return false;
+    }
+
+    // Buffer starts with the header, followed by space for the address and the payload
+    auto buffer = m_buffers.data() + (cqe.flags >> IORING_CQE_BUFFER_SHIFT) * m_bufferSize;
+    auto out = reinterpret_cast<const io_uring_recvmsg_out*>(buffer);
+    size_t offset = sizeof(*out) + m_recvHdr.msg_namelen + m_recvHdr.msg_controllen;
+    if (static_cast<size_t>(cqe.res) < offset) {
+        return false;
+    }
+    remoteAddr = {};
+    std::memcpy(&remoteAddr, buffer + sizeof(*out), std::min<size_t>(out->namelen, sizeof(remoteAddr)));
+    data = buffer + offset;
+    // Truncated datagrams report their original length
+    len = std::min<size_t>(out->payloadlen, cqe.res - offset);
+    return true;
+}
+
+void IoUring::addBuffer(uint16_t bid)
+{
+    // Tail overlays the first entry, fields are set one by one not to overwrite it.
+    // Flexible bufs member is misplaced in C++, index the ring as an array instead.
+    auto& buf = reinterpret_cast<io_uring_buf*>(m_bufRing)[m_bufTail & m_bufMask];
+    buf.addr = reinterpret_cast<uint64_t>(m_buffers.data() + bid * m_bufferSize);
+    buf.len = static_cast<uint32_t>(m_bufferSize);
+    buf.bid = bid;
+    __atomic_store_n(&m_bufRing->tail, ++m_bufTail, __ATOMIC_RELEASE);
+}
+
+void IoUring::releaseBuffer(const io_uring_cqe& cqe)
+{
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        addBuffer(static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT));
+    }
+}
+
+bool IoUring::sendMsg(int fd, const void* data, size_t len, const sockaddr_in& remoteAddr)
+{
+    if (m_freeSlots.empty()) {
+        return false;
+    }
+    auto sqe = getSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    auto idx = m_freeSlots.back();
+    m_freeSlots.pop_back();
+
+    auto& slot = m_sendSlots[idx];
+    auto bytes = static_cast<const unsigned char*>(data);
+    slot.data.assign(bytes, bytes + len);
+    slot.remoteAddr = remoteAddr;
+    slot.iov.iov_base = slot.data.data();
+    slot.iov.iov_len = len;
+    std::memset(&slot.hdr, 0, sizeof(slot.hdr));
+    slot.hdr.msg_name = &slot.remoteAddr;
+    slot.hdr.msg_namelen = sizeof(slot.remoteAddr);
+    slot.hdr.msg_iov = &slot.iov;
+    slot.hdr.msg_iovlen = 1;
+
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(&slot.hdr);
+    sqe->len = 1;
+    sqe->user_data = SEND_TAG | idx;
+    return true;
+}
+
+void IoUring::sendCompleted(const io_uring_cqe& cqe)
+{
+    auto idx = static_cast<unsigned>(cqe.user_data & ~SEND_TAG);
+    if (cqe.res < 0) {
+        char ip[INET_ADDRSTRLEN];
+        auto& remoteAddr = m_sendSlots[idx].remoteAddr;
+        ::inet_ntop(AF_INET, &remoteAddr.sin_addr, ip, sizeof(ip));
+        LOG_ERROR("Failed to send UDP packet to ", ip, ":", ::ntohs(remoteAddr.sin_port), " - ", strerror(-cqe.res));
+    }
+    m_freeSlots.push_back(idx);
+}
+
+bool IoUring::cancel(uint64_t userData)
+{
+    auto sqe = getSqe();
+    if (sqe == nullptr) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = userData;
+    sqe->user_data = 0;
+    return true;
+}
+
+void IoUring::reap(std::vector<io_uring_cqe>& completions)
+{
+    auto head = *m_cqHead;
+    auto tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+    for (; head != tail; head++) {
+        auto& cqe = m_cqes[head & m_cqMask];
+        if (cqe.user_data & SEND_TAG) {
+            sendCompleted(cqe);
+        } else {
+            completions.push_back(cqe);
+        }
+    }
+    __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+}
+
+const std::vector<io_uring_cqe>& IoUring::wait(int timeoutMs)
+{
+    // Completions reaped while submitting come first
+    m_completions.clear();
+    m_completions.swap(m_reaped);
+
+    // Timeouts and signals end the wait without completions, not an error
+    if (m_completions.empty() && __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE) == *m_cqHead) {
+        enter(1, timeoutMs);
+    } else if (m_sqQueued > 0) {
+        enter(0, 0);
+    }
+
+    // Copy completions out so that processing them can queue new requests
+    reap(m_completions);
+    return m_completions;
+}
+
+#endif // __linux__
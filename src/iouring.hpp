@@ -0,0 +1,213 @@
+/**
+ * @file iouring.hpp
+ * @brief Minimal io_uring wrapper for socket events and datagram IO.
+ */
+
+#pragma once
+
+#ifdef __linux__
+
+#include <linux/io_uring.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class IoUring
+ * @brief Submission and completion rings set up with raw io_uring syscalls.
+ *
+ * Only what ConnectionsManager needs is supported: multishot poll requests
+ * on sockets, multishot datagram receives and datagram sends. Requests are
+ * queued in the submission ring and handed to the kernel together with
+ * waiting for completions, so one loop iteration costs a single
+ * io_uring_enter() regardless of how many sockets were added or removed and
+ * how many datagrams were received or sent.
+ *
+ * Received datagrams are written by the kernel into a ring of buffers
+ * registered up front, a buffer is returned to the kernel once its datagram
+ * was processed. Sent datagrams are copied into slots that are kept until the
+ * kernel completes the send.
+ *
+ * Requires kernel with IORING_FEAT_EXT_ARG (5.11+) for waiting with timeout,
+ * multishot poll (5.13+) and registered buffer rings (5.19+). Construction
+ * fails on older kernels or when io_uring is disabled, callers are expected to
+ * fall back to epoll. Multishot receive needs 6.0+, on older kernels its
+ * request completes with EINVAL and the socket must be polled instead.
+ */
+class IoUring {
+    private:
+        /**
+         * @brief Copy of an outgoing datagram, kept until the kernel sent it.
+         */
+        struct SendSlot {
+            msghdr hdr;
+            iovec iov;
+            sockaddr_in remoteAddr;
+            std::vector<unsigned char> data;
+        };
+
+        static constexpr uint64_t SEND_TAG = 1ULL << 63;    ///< Marks user data of sends, other user data is passed by the caller.
+        static constexpr uint16_t BUFFER_GROUP = 0;
+        static constexpr unsigned SUBMIT_ATTEMPTS = 3;      ///< Tries to make space in a full submission ring.
+
+        int m_fd = -1;
+        void* m_rings = nullptr;            ///< Submission and completion rings, mapped together.
+        size_t m_ringsSize = 0;
+        io_uring_sqe* m_sqes = nullptr;
+        size_t m_sqesSize = 0;
+
+        unsigned* m_sqHead = nullptr;
+        unsigned* m_sqTail = nullptr;
+        unsigned* m_sqArray = nullptr;
+        unsigned m_sqMask = 0;
+        unsigned m_sqEntries = 0;
+        unsigned m_sqQueued = 0;            ///< Requests queued but not yet submitted.
+
+        unsigned* m_cqHead = nullptr;
+        unsigned* m_cqTail = nullptr;
+        io_uring_cqe* m_cqes = nullptr;
+        unsigned m_cqMask = 0;
+
+        io_uring_buf_ring* m_bufRing = nullptr; ///< Buffers available to the kernel for receiving.
+        size_t m_bufRingSize = 0;
+        uint16_t m_bufTail = 0;
+        uint16_t m_bufMask = 0;
+        size_t m_bufferSize = 0;
+        std::vector<unsigned char> m_buffers;
+        msghdr m_recvHdr;                   ///< Tells the kernel how much space to leave for the sender address.
+
+        std::vector<SendSlot> m_sendSlots;
+        std::vector<unsigned> m_freeSlots;
+
+        std::vector<io_uring_cqe> m_completions;
+        std::vector<io_uring_cqe> m_reaped;             ///< Taken out to make space for submitting, returned by next wait().
+
+        /**
+         * @brief Returns next free submission entry, submits queued ones when the ring is full.
+         *
+         * Completions are taken out when the kernel refuses to submit because
+         * the completion ring overflowed.
+         *
+         * @return nullptr when the kernel didn't make space, the request can't be queued.
+         */
+        io_uring_sqe* getSqe();
+
+        /**
+         * @brief Moves available completions into the vector, sends are handled right away.
+         */
+        void reap(std::vector<io_uring_cqe>& completions);
+
+        /**
+         * @brief Submits queued requests, optionally waiting for completions.
+         */
+        int enter(unsigned minComplete, int timeoutMs);
+
+        /**
+         * @brief Hands the receive buffer back to the kernel.
+         */
+        void addBuffer(uint16_t bid);
+
+        /**
+         * @brief Frees the slot of a completed send, logs when it failed.
+         */
+        void sendCompleted(const io_uring_cqe& cqe);
+
+    public:
+        /**
+         * @brief Creates the rings and registers receive buffers.
+         * @param entries Size of the submission ring, rounded up to power of 2 by the kernel.
+         *                As many datagrams can be waiting to be sent.
+         * @param nBuffers Number of receive buffers, power of 2.
+         * @param bufferSize Size of each receive buffer, longer datagrams are truncated.
+         * @throws SocketException when io_uring is not available.
+         */
+        IoUring(unsigned entries, unsigned nBuffers, size_t bufferSize);
+        IoUring(const IoUring&) = delete;
+        IoUring& operator=(const IoUring&) = delete;
+        ~IoUring();
+
+        /**
+         * @brief Queues a multishot poll for the socket.
+         *
+         * A completion with the given user data and the ready events is posted
+         * every time the socket becomes ready. When a completion comes without
+         * IORING_CQE_F_MORE flag, the kernel stopped polling and the request
+         * needs to be queued again.
+         *
+         * @param fd Socket to poll.
+         * @param events Poll events, like POLLIN.
+         * @param userData Identifier returned with each completion.
+         * @return false when the request couldn't be queued, caller needs to try again later.
+         */
+        bool pollAdd(int fd, uint32_t events, uint64_t userData);
+
+        /**
+         * @brief Queues a multishot receive of datagrams from the socket.
+         *
+         * A completion with the given user data is posted for every received
+         * datagram, see getDatagram(). Like with polls, a completion without
+         * IORING_CQE_F_MORE flag means the request needs to be queued again,
+         * ie. after running out of buffers with ENOBUFS.
+         *
+         * @param fd UDP socket to receive from.
+         * @param userData Identifier returned with each completion.
+         * @return false when the request couldn't be queued, caller needs to try again later.
+         */
+        bool recvMsg(int fd, uint64_t userData);
+
+        /**
+         * @brief Extracts the datagram from a receive completion.
+         *
+         * @param cqe Completion of a recvMsg() request.
+         * @param data Set to the payload, valid until releaseBuffer().
+         * @param len Set to the length of the payload.
+         * @param remoteAddr Set to the sender of the datagram.
+         * @return false when the completion holds no datagram, ie. an error.
+         */
+        bool getDatagram(const io_uring_cqe& cqe, const unsigned char*& data, size_t& len, sockaddr_in& remoteAddr) const;
+
+        /**
+         * @brief Returns the buffer of the completion to the kernel, if it holds one.
+         *
+         * Must be called for every completion of recvMsg() requests, also
+         * for those that arrived after the request was cancelled.
+         */
+        void releaseBuffer(const io_uring_cqe& cqe);
+
+        /**
+         * @brief Queues a datagram to be sent.
+         *
+         * The data is copied. Errors are logged when the send completes,
+         * its completion is not returned from wait().
+         *
+         * @param fd UDP socket to send the datagram through.
+         * @param data Datagram payload.
+         * @param len Length of the payload.
+         * @param remoteAddr Destination address.
+         * @return false when too many sends are in progress or the request couldn't be
+         *         queued, caller needs to send it itself.
+         */
+        bool sendMsg(int fd, const void* data, size_t len, const sockaddr_in& remoteAddr);
+
+        /**
+         * @brief Queues cancellation of the poll or receive with given user data.
+         *
+         * The kernel keeps the socket open until the request is cancelled.
+         * Completions of the cancellation itself carry user data 0.
+         *
+         * @return false when the request couldn't be queued, caller needs to try again later.
+         */
+        bool cancel(uint64_t userData);
+
+        /**
+         * @brief Submits queued requests and waits for completions.
+         * @param timeoutMs Max time to wait in milliseconds, negative waits indefinitely.
+         * @return All completions available except for sends, valid until next wait().
+         */
+        const std::vector<io_uring_cqe>& wait(int timeoutMs);
+};
+
+#endif // __linux__
@@ -5,22 +5,22 @@
 #include <fcntl.h>
 #include <sys/socket.h>
 
-Listener::Listener(const std::string& ip, uint16_t port, const AccessControl& accessControl, const std::shared_ptr<Protocol>& protocol, PvSearchedCb& cb)
+Listener::Listener(const std::string& ip, uint16_t port, const AccessControl& accessControl, const std::shared_ptr<Protocol>& protocol, PvSearchedCb& cb, bool reusePort)
     : m_accessControl(accessControl)
     , m_protocol(protocol)
     , m_searchPvCb(cb)
+    , m_batch(4096, 1024)
 {
+    m_udpReceive = true;
     m_sock = ::socket(AF_INET, SOCK_DGRAM, 0);
     if (m_sock < 0) {
         throw SocketException("failed to create socket - {errno}");
     }
 
-/*
     int optval = 1;
-    if (::setsockopt(m_sock, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) != 0) {
+    if (reusePort && ::setsockopt(m_sock, SOL_SOCKET, SO_REUSEPORT, &optval, sizeof(optval)) != 0) {
         throw SocketException("can't set reuse port option - {errno}");
     }
-*/
 
     if (::fcntl(m_sock, F_SETFL, fcntl(m_sock, F_GETFL, 0) | O_NONBLOCK) == -1) {
         throw SocketException("failed to set socket non-blocking", errno);
@@ -41,12 +41,7 @@ Listener::Listener(const std::string& ip, uint16_t port, const AccessControl& ac
 }
 
 void Listener::processIncoming() {
-    unsigned char buffer[4096];
-    struct sockaddr_in remoteAddr;
-    socklen_t remoteAddrLen = sizeof(remoteAddr);
-
-    auto recvd = ::recvfrom(m_sock, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr *>(&remoteAddr), &remoteAddrLen);
-    while (recvd > 0) {
+    m_batch.receive(m_sock, [this](const unsigned char* buffer, size_t recvd, const sockaddr_in& remoteAddr) {
         char clientIp[20] = {0};
         ::inet_ntop(AF_INET, &remoteAddr.sin_addr, clientIp, sizeof(clientIp)-1);
         uint16_t clientPort = ::ntohs(remoteAddr.sin_port);
@@ -66,14 +61,18 @@ void Listener::processIncoming() {
             if (!pvname.empty() && checkAccessControl(pvname, clientIp, clientPort)) {
                 auto rsp = m_searchPvCb(pvname, clientIp, clientPort);
                 if (rsp.empty() == false) {
-                    m_protocol->updateSearchReply(rsp, chanId);
-                    ::sendto(m_sock, rsp.data(), rsp.size(), 0, reinterpret_cast<sockaddr *>(&remoteAddr), remoteAddrLen);
+                    // Buffer keeps its capacity, no allocation once it's big enough
+                    m_reply.assign(rsp);
+                    m_protocol->updateSearchReply(m_reply, chanId);
+                    m_batch.send(m_sock, m_reply.data(), m_reply.size(), remoteAddr);
                 }
             }
         }
+    });
+}
 
-        recvd = ::recvfrom(m_sock, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr *>(&remoteAddr), &remoteAddrLen);
-    }
+void Listener::processOutgoing() {
+    m_batch.flush(m_sock);
 }
 
 bool Listener::checkAccessControl(const std::string& pvname_, const std::string& client, uint16_t port)
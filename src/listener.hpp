@@ -8,6 +8,7 @@
 #include "config.hpp"
 #include "proto.hpp"
 #include "connection.hpp"
+#include "udpbatch.hpp"
 
 #include <functional>
 #include <memory>
@@ -31,14 +32,16 @@ class Listener : public Connection {
          * @param pvname The name of the PV being searched.
          * @param clientIP The IP address of the requesting client.
          * @param clientPort The UDP port of the requesting client.
-         * @return Protocol::Bytes The response packet to send back (if any).
+         * @return Protocol::BytesView The response packet to send back (if any), valid until the next call.
          */
-        typedef std::function<Protocol::Bytes (const std::string & /*pvname*/, const std::string & /*client IP*/, uint16_t /*client port*/)> PvSearchedCb;
+        typedef std::function<Protocol::BytesView (const std::string & /*pvname*/, const std::string & /*client IP*/, uint16_t /*client port*/)> PvSearchedCb;
 
     private:
         const AccessControl& m_accessControl;
         std::shared_ptr<Protocol> m_protocol;
         PvSearchedCb m_searchPvCb;
+        UdpBatch m_batch;
+        Protocol::Bytes m_reply;    ///< Reusable buffer for the response being sent.
 
         /**
          * @brief Checks if the client is authorized to search for the given PV.
@@ -60,14 +63,20 @@ class Listener : public Connection {
          * @param accessControl Reference to the security policies.
          * @param protocol Shared pointer to the protocol implementation (CA).
          * @param cb Callback function to query PV resolution.
+         * @param reusePort Allow other sockets to bind to the same address, the kernel spreads clients among them.
          */
-        Listener(const std::string& ip, uint16_t port, const AccessControl& accessControl, const std::shared_ptr<Protocol>& protocol, PvSearchedCb& cb);
+        Listener(const std::string& ip, uint16_t port, const AccessControl& accessControl, const std::shared_ptr<Protocol>& protocol, PvSearchedCb& cb, bool reusePort = false);
 
         /**
          * @brief Process incoming UDP packets.
          * 
          * Reads from the socket, parses the search request, checks ACLs, 
-         * invokes the callback, and sends the response if found.
+         * invokes the callback, and queues the response if found.
          */
         void processIncoming();
+
+        /**
+         * @brief Sends all queued responses.
+         */
+        void processOutgoing();
 };
\ No newline at end of file
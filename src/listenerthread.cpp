@@ -0,0 +1,75 @@
+#include "listenerthread.hpp"
+#include "logging.hpp"
+
+#include <poll.h>
+#include <pthread.h>
+
+#include <cstring>
+
+ListenerThread::ListenerThread(const std::vector<Config::Address>& addresses, const AccessControl& accessControl, const std::shared_ptr<Protocol>& protocol,
+                               const LookupCb& lookupCb, const MissCb& missCb, int cpu)
+    : m_lookupCb(lookupCb)
+    , m_missCb(missCb)
+    , m_cpu(cpu)
+{
+    // Reply points to this thread's buffer, it's copied by the listener right away
+    Listener::PvSearchedCb pvSearchedCb = [this](const std::string& pvname, const std::string& clientIP, uint16_t clientPort) {
+        if (m_lookupCb(pvname, clientIP, clientPort, m_reply)) {
+            m_hits.fetch_add(1, std::memory_order_relaxed);
+            return Protocol::BytesView(m_reply.data(), m_reply.size());
+        }
+        m_misses.fetch_add(1, std::memory_order_relaxed);
+        m_missCb(pvname, clientIP, clientPort);
+        return Protocol::BytesView();
+    };
+
+    for (auto& [ip, port]: addresses) {
+        m_listeners.emplace_back(new Listener(ip, port, accessControl, protocol, pvSearchedCb, true));
+    }
+}
+
+ListenerThread::~ListenerThread()
+{
+    m_stop = true;
+    if (m_thread.joinable()) {
+        m_thread.join();
+    }
+}
+
+void ListenerThread::start()
+{
+    m_thread = std::thread(&ListenerThread::loop, this);
+
+    if (m_cpu >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(m_cpu, &cpus);
+        auto err = ::pthread_setaffinity_np(m_thread.native_handle(), sizeof(cpus), &cpus);
+        if (err != 0) {
+            LOG_ERROR("Failed to pin listener thread to CPU ", m_cpu, ": ", strerror(err));
+        }
+    }
+}
+
+void ListenerThread::loop()
+{
+    std::vector<pollfd> fds(m_listeners.size());
+    for (size_t i = 0; i < m_listeners.size(); i++) {
+        fds[i].fd = m_listeners[i]->getSocket();
+        fds[i].events = POLLIN;
+    }
+
+    // Timeout only bounds the time to notice the stop request
+    while (m_stop == false) {
+        if (::poll(fds.data(), fds.size(), 100) > 0) {
+            for (size_t i = 0; i < fds.size(); i++) {
+                if (fds[i].revents & POLLIN) {
+                    m_listeners[i]->processIncoming();
+                }
+            }
+        }
+        for (auto& listener: m_listeners) {
+            listener->processOutgoing();
+        }
+    }
+}
@@ -0,0 +1,97 @@
+/**
+ * @file listenerthread.hpp
+ * @brief Answers client searches in a dedicated thread.
+ */
+
+#pragma once
+
+#include "config.hpp"
+#include "listener.hpp"
+#include "proto.hpp"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @class ListenerThread
+ * @brief Thread with its own listeners for client searches.
+ *
+ * Every thread binds a socket to each listen address with SO_REUSEPORT, the
+ * kernel spreads unicast searches among them by the client address. Searches
+ * for cached PVs are answered in the thread itself, all other searches are
+ * passed on to be handled like in the single threaded listener, starting a
+ * search if needed. Client gets the reply when it searches for the PV again.
+ */
+class ListenerThread {
+    public:
+        /**
+         * @brief Callback to look up the PV in the cache, invoked from the thread.
+         *
+         * @param pvname The name of the PV being searched.
+         * @param clientIP The IP address of the requesting client.
+         * @param clientPort The UDP port of the requesting client.
+         * @param reply Filled with the response packet when found.
+         * @return True when the PV was found.
+         */
+        typedef std::function<bool(const std::string& /*pvname*/, const std::string& /*client IP*/, uint16_t /*client port*/, Protocol::Bytes& /*reply*/)> LookupCb;
+
+        /**
+         * @brief Callback for searches not answered from the cache, invoked from the thread.
+         */
+        typedef std::function<void(const std::string& /*pvname*/, const std::string& /*client IP*/, uint16_t /*client port*/)> MissCb;
+
+    private:
+        std::vector<std::shared_ptr<Listener>> m_listeners;
+        LookupCb m_lookupCb;
+        MissCb m_missCb;
+        int m_cpu;
+        Protocol::Bytes m_reply;            ///< Reusable buffer for the cached reply.
+        std::atomic<bool> m_stop{false};
+        std::atomic<uint64_t> m_hits{0};
+        std::atomic<uint64_t> m_misses{0};
+        std::thread m_thread;
+
+        /**
+         * @brief Thread body, processes client searches until stopped.
+         */
+        void loop();
+
+    public:
+        /**
+         * @brief Creates listeners on all addresses, the thread is not started yet.
+         *
+         * @param addresses Addresses to listen on.
+         * @param accessControl Reference to the security policies.
+         * @param protocol Shared pointer to the protocol implementation (CA).
+         * @param lookupCb Callback to look up PVs in the cache.
+         * @param missCb Callback for searches not found in the cache.
+         * @param cpu CPU to pin the thread to, -1 for no pinning.
+         * @throws SocketException when any listener can't be created.
+         */
+        ListenerThread(const std::vector<Config::Address>& addresses, const AccessControl& accessControl, const std::shared_ptr<Protocol>& protocol,
+                       const LookupCb& lookupCb, const MissCb& missCb, int cpu = -1);
+
+        /**
+         * @brief Stops the thread and waits for it to finish.
+         */
+        ~ListenerThread();
+
+        /**
+         * @brief Starts the thread.
+         */
+        void start();
+
+        /**
+         * @brief Returns number of searches answered from the cache.
+         */
+        uint64_t getHits() const { return m_hits.load(std::memory_order_relaxed); }
+
+        /**
+         * @brief Returns number of searches passed on to the miss callback.
+         */
+        uint64_t getMisses() const { return m_misses.load(std::memory_order_relaxed); }
+};
@@ -79,9 +79,11 @@ namespace Log {
                 const auto now = std::chrono::system_clock::now();
                 auto millis = (now.time_since_epoch().count() / 1000000) % 1000;
                 const std::time_t now_t = std::chrono::system_clock::to_time_t(now);
-                auto timeinfo = std::localtime(&now_t);
+                // Listener threads log too, localtime() shares a static buffer
+                std::tm timeinfo;
+                localtime_r(&now_t, &timeinfo);
                 char buffer[64] = {0};
-                strftime(buffer, sizeof(buffer) - 1, "%Y-%m-%d %H:%M:%S", timeinfo);
+                strftime(buffer, sizeof(buffer) - 1, "%Y-%m-%d %H:%M:%S", &timeinfo);
                 printf("%s:%03d %s: %s\n", buffer, (int)millis, level2str(lvl), msg.str().c_str());
                 fflush(stdout);
             }
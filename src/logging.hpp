@@ -89,11 +89,15 @@ namespace Log {
     void write(Level lvl, std::ostringstream &msg);
 };
 
+/*
+ * Arguments are only evaluated when the level is enabled, they may be costly
+ * to format, ie. resolving host names.
+ */
 /** @brief Helper macro for Debug logs */
-#define LOG_DEBUG(args ...)    Log::write(Log::Level::Debug,   args)
+#define LOG_DEBUG(args ...)    do { if (Log::Level::Debug   >= Log::getLogLevel()) Log::write(Log::Level::Debug,   args); } while (0)
 /** @brief Helper macro for Verbose logs */
-#define LOG_VERBOSE(args ...)  Log::write(Log::Level::Verbose, args)
+#define LOG_VERBOSE(args ...)  do { if (Log::Level::Verbose >= Log::getLogLevel()) Log::write(Log::Level::Verbose, args); } while (0)
 /** @brief Helper macro for Info logs */
-#define LOG_INFO(args ...)     Log::write(Log::Level::Info,    args)
+#define LOG_INFO(args ...)     do { if (Log::Level::Info    >= Log::getLogLevel()) Log::write(Log::Level::Info,    args); } while (0)
 /** @brief Helper macro for Error logs */
-#define LOG_ERROR(args ...)    Log::write(Log::Level::Error,   args)
+#define LOG_ERROR(args ...)    do { if (Log::Level::Error   >= Log::getLogLevel()) Log::write(Log::Level::Error,   args); } while (0)
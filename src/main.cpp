@@ -71,7 +71,7 @@ int main(int argc, char** argv)
     std::signal(SIGUSR2, increaseLogLevel);
 
     while (true) {
-        dispatcher.run(0.1);
+        dispatcher.run();
     }
 
     return 0;
@@ -0,0 +1,52 @@
+#include "missqueue.hpp"
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+MissQueue::MissQueue(const MissCb& cb)
+    : m_cb(cb)
+{
+    m_sock = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_sock < 0) {
+        throw SocketException("failed to create eventfd", errno);
+    }
+}
+
+MissQueue::~MissQueue()
+{
+    if (m_sock != -1) {
+        ::close(m_sock);
+    }
+}
+
+void MissQueue::push(const std::string& pvname, const std::string& clientIP, uint16_t clientPort)
+{
+    bool wakeup;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        wakeup = m_pending.empty();
+        m_pending.push_back({pvname, clientIP, clientPort});
+    }
+
+    // Already signalled when the queue was not empty
+    if (wakeup) {
+        uint64_t one = 1;
+        (void)!::write(m_sock, &one, sizeof(one));
+    }
+}
+
+void MissQueue::processIncoming()
+{
+    uint64_t count;
+    (void)!::read(m_sock, &count, sizeof(count));
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pending.swap(m_processing);
+    }
+    for (auto& request: m_processing) {
+        m_cb(request.pvname, request.clientIP, request.clientPort);
+    }
+    // Keep the capacity for the next swap
+    m_processing.clear();
+}
@@ -0,0 +1,61 @@
+/**
+ * @file missqueue.hpp
+ * @brief Hands client searches over from listener threads to the main thread.
+ */
+
+#pragma once
+
+#include "connection.hpp"
+
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * @class MissQueue
+ * @brief Queue of client searches that listener threads could not answer from the cache.
+ *
+ * Any thread can push to the queue. The queue is registered with the
+ * ConnectionsManager like any other connection, its socket is an eventfd
+ * that becomes readable when there are queued searches, so that the main
+ * thread processes them in its IO loop without polling.
+ */
+class MissQueue : public Connection {
+    public:
+        /**
+         * @brief Callback invoked in the main thread for every queued search.
+         */
+        typedef std::function<void(const std::string& /*pvname*/, const std::string& /*client IP*/, uint16_t /*client port*/)> MissCb;
+
+    private:
+        struct Request {
+            std::string pvname;
+            std::string clientIP;
+            uint16_t clientPort;
+        };
+
+        MissCb m_cb;
+        std::mutex m_mutex;
+        std::vector<Request> m_pending;     ///< Pushed searches, guarded by m_mutex.
+        std::vector<Request> m_processing;  ///< Searches being processed, swapped with m_pending.
+
+    public:
+        /**
+         * @brief Creates the eventfd.
+         * @throws SocketException when eventfd can't be created.
+         */
+        MissQueue(const MissCb& cb);
+
+        ~MissQueue();
+
+        /**
+         * @brief Queues the search, can be called from any thread.
+         */
+        void push(const std::string& pvname, const std::string& clientIP, uint16_t clientPort);
+
+        /**
+         * @brief Invokes the callback for all queued searches.
+         */
+        void processIncoming();
+};
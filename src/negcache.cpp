@@ -0,0 +1,152 @@
+#include "negcache.hpp"
+
+#include <algorithm>
+
+NegativeCache::NegativeCache(size_t capacity, unsigned ttl)
+    : m_capacity(capacity)
+    , m_ttl(ttl)
+    , m_lastRotate(std::chrono::steady_clock::now())
+{
+    if (m_capacity > 0) {
+        // Filter also remembers names evicted from the table, make it twice as big.
+        // Power of 2 number of bits for cheap modulo.
+        uint64_t bits = 64;
+        while (bits < 2 * m_capacity * BITS_PER_NAME) {
+            bits <<= 1;
+        }
+        m_mask = bits - 1;
+        m_filters[0].assign(bits / 64, 0);
+        m_filters[1].assign(bits / 64, 0);
+    }
+}
+
+bool NegativeCache::filterContains(unsigned generation, std::string_view name) const
+{
+    auto& filter = m_filters[generation];
+    bool found = true;
+    forEachBit(name, [&](uint64_t bit) {
+        found = found && (filter[bit / 64] & (uint64_t(1) << (bit % 64))) != 0;
+    });
+    return found;
+}
+
+void NegativeCache::filterAdd(unsigned generation, std::string_view name)
+{
+    auto& filter = m_filters[generation];
+    forEachBit(name, [&](uint64_t bit) {
+        filter[bit / 64] |= (uint64_t(1) << (bit % 64));
+    });
+}
+
+void NegativeCache::expire(TimePoint now)
+{
+    while (m_fifo.empty() == false && (now - m_fifo.front().second) > m_ttl) {
+        auto it = m_table.find(m_fifo.front().first);
+        if (it != m_table.end() && it->second == m_fifo.front().second) {
+            m_table.erase(it);
+        }
+        m_fifo.pop_front();
+    }
+
+    // Filter has forgotten the names found earlier than the time to live
+    while (m_foundFifo.empty() == false && (now - m_foundFifo.front().second) > m_ttl) {
+        auto it = m_found.find(m_foundFifo.front().first);
+        if (it != m_found.end() && it->second == m_foundFifo.front().second) {
+            m_found.erase(it);
+        }
+        m_foundFifo.pop_front();
+    }
+
+    if ((now - m_lastRotate) > m_ttl) {
+        // Idle for longer than the time to live, both generations are too old
+        std::fill(m_filters[0].begin(), m_filters[0].end(), 0);
+        std::fill(m_filters[1].begin(), m_filters[1].end(), 0);
+        m_lastRotate = now;
+    } else if ((now - m_lastRotate) > (m_ttl / 2)) {
+        // Keep the rotation period fixed, so that no bits outlive the time to live
+        m_current ^= 1;
+        std::fill(m_filters[m_current].begin(), m_filters[m_current].end(), 0);
+        m_lastRotate += m_ttl / 2;
+    } else {
+        return;
+    }
+
+    for (auto& entry: m_table) {
+        filterAdd(m_current, entry.first);
+    }
+}
+
+void NegativeCache::insert(const std::string& name, TimePoint now)
+{
+    if (m_capacity == 0) {
+        return;
+    }
+
+    expire(now);
+    filterAdd(m_current, name);
+
+    // Re-inserted names get a new FIFO entry, the old one is skipped when evicted
+    m_table[name] = now;
+    m_fifo.emplace_back(name, now);
+    m_found.erase(name);
+    m_stats.inserts++;
+
+    while (m_table.size() > m_capacity && m_fifo.empty() == false) {
+        auto it = m_table.find(m_fifo.front().first);
+        if (it != m_table.end() && it->second == m_fifo.front().second) {
+            m_table.erase(it);
+            m_stats.evictions++;
+        }
+        m_fifo.pop_front();
+    }
+}
+
+void NegativeCache::remove(const std::string& name, TimePoint now)
+{
+    if (m_capacity == 0) {
+        return;
+    }
+
+    expire(now);
+
+    // Only names the filter may still report need to be remembered
+    if (filterContains(m_current, name) == false && filterContains(m_current ^ 1, name) == false) {
+        return;
+    }
+    m_table.erase(name);
+    m_found[name] = now;
+    m_foundFifo.emplace_back(name, now);
+
+    while (m_found.size() > m_capacity && m_foundFifo.empty() == false) {
+        auto it = m_found.find(m_foundFifo.front().first);
+        if (it != m_found.end() && it->second == m_foundFifo.front().second) {
+            m_found.erase(it);
+        }
+        m_foundFifo.pop_front();
+    }
+}
+
+NegativeCache::Match NegativeCache::lookup(const std::string& name, TimePoint now)
+{
+    if (m_capacity == 0) {
+        return Match::None;
+    }
+
+    expire(now);
+
+    // Most names are not in the cache, filter answers that without touching the table
+    if (filterContains(m_current, name) == false && filterContains(m_current ^ 1, name) == false) {
+        m_stats.misses++;
+        return Match::None;
+    }
+    if (m_table.find(name) != m_table.end()) {
+        m_stats.hits++;
+        return Match::Exact;
+    }
+    if (m_found.find(name) != m_found.end()) {
+        m_stats.misses++;
+        return Match::None;
+    }
+    m_stats.filterHits++;
+    return Match::Filter;
+}
@@ -0,0 +1,145 @@
+/**
+ * @file negcache.hpp
+ * @brief Remembers PV names that could not be found.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @class NegativeCache
+ * @brief Set of PV names that went through the full search schedule without being found.
+ *
+ * Most recent misses are kept in an exact table of limited capacity, oldest
+ * entries are evicted first. All misses are also recorded in a Bloom filter,
+ * which remembers names evicted from the table for a while longer at a cost
+ * of rare false positives. The filter consists of two generations, the older
+ * one is cleared and reused every half of the time to live, so that names
+ * are forgotten eventually and the false positive rate doesn't grow.
+ *
+ * Bits can't be cleared from the filter, names found since their miss are
+ * remembered in a separate table instead and the filter is not consulted
+ * for them.
+ */
+class NegativeCache {
+    public:
+        /**
+         * @struct Stats
+         * @brief Lookup statistics, to tune the cache size.
+         */
+        struct Stats {
+            uint64_t hits = 0;          ///< Lookups found in the exact table.
+            uint64_t filterHits = 0;    ///< Lookups found only in the Bloom filter.
+            uint64_t misses = 0;        ///< Lookups not found.
+            uint64_t inserts = 0;       ///< Names added.
+            uint64_t evictions = 0;     ///< Names evicted from the exact table to make space.
+        };
+
+        /**
+         * @brief Where a lookup found the name.
+         */
+        enum class Match {
+            None,       ///< Not found, or found since the miss.
+            Exact,      ///< Found in the exact table.
+            Filter,     ///< Found only in the Bloom filter, possibly a false positive.
+        };
+
+    private:
+        static constexpr unsigned HASHES = 7;         ///< Number of bits set per name.
+        static constexpr unsigned BITS_PER_NAME = 10; ///< Filter size per name of capacity, ~1% false positives.
+
+        typedef std::chrono::steady_clock::time_point TimePoint;
+
+        size_t m_capacity;
+        std::chrono::seconds m_ttl;
+        std::unordered_map<std::string, TimePoint> m_table;  ///< Exact recent misses and the time they were added.
+        std::deque<std::pair<std::string, TimePoint>> m_fifo; ///< Insertion order for eviction.
+        std::unordered_map<std::string, TimePoint> m_found;  ///< Names found while still in the filter and the time they were found.
+        std::deque<std::pair<std::string, TimePoint>> m_foundFifo; ///< Found order for eviction.
+        std::vector<uint64_t> m_filters[2];                   ///< Current and previous Bloom filter generation.
+        uint64_t m_mask = 0;                                  ///< Number of bits in a filter minus one.
+        unsigned m_current = 0;                               ///< Index of the current filter generation.
+        TimePoint m_lastRotate;
+        Stats m_stats;
+
+        /**
+         * @brief Invokes the callback with every filter bit position of the name.
+         */
+        template <typename F>
+        void forEachBit(std::string_view name, F&& f) const
+        {
+            // Double hashing, derives all positions from a single hash
+            uint64_t h1 = std::hash<std::string_view>()(name);
+            uint64_t h2 = ((h1 >> 32) | (h1 << 32)) * 0x9e3779b97f4a7c15ull | 1;
+            for (unsigned i = 0; i < HASHES; i++) {
+                f((h1 + i * h2) & m_mask);
+            }
+        }
+
+        bool filterContains(unsigned generation, std::string_view name) const;
+        void filterAdd(unsigned generation, std::string_view name);
+
+        /**
+         * @brief Drops expired table entries and rotates filter generations.
+         *
+         * Names still in the exact table are added to the current generation
+         * again, so that the filter doesn't forget them before the table does.
+         */
+        void expire(TimePoint now);
+
+    public:
+        /**
+         * @brief Constructs the cache.
+         *
+         * @param capacity Max number of names in the exact table, 0 disables the cache.
+         * @param ttl Time in seconds after which names are forgotten.
+         */
+        NegativeCache(size_t capacity = 0, unsigned ttl = 3600);
+
+        /**
+         * @brief Checks whether the cache is enabled.
+         */
+        bool isEnabled() const { return (m_capacity > 0); }
+
+        /**
+         * @brief Records a name that could not be found.
+         */
+        void insert(const std::string& name, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+        /**
+         * @brief Forgets the name because it was found.
+         *
+         * Name is removed from the exact table and remembered as found, so
+         * that the Bloom filter is not consulted for it until its generation
+         * expires.
+         */
+        void remove(const std::string& name, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+        /**
+         * @brief Looks up a name that could not be found recently, updating stats.
+         */
+        Match lookup(const std::string& name, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+        /**
+         * @brief Checks whether the name could not be found recently, updating stats.
+         */
+        bool contains(const std::string& name, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now()) { return (lookup(name, now) != Match::None); }
+
+        /**
+         * @brief Returns number of names in the exact table.
+         */
+        size_t size() const { return m_table.size(); }
+
+        /**
+         * @brief Returns lookup statistics since start.
+         */
+        const Stats& getStats() const { return m_stats; }
+};
@@ -7,6 +7,8 @@
 
 #include <cstdint>
 #include <string>
+#include <string_view>
+#include <tuple>
 #include <vector>
 
 /**
@@ -25,6 +27,11 @@ class Protocol {
          */
         typedef std::basic_string<unsigned char> Bytes;
 
+        /**
+         * @brief Type alias for a non-owning view of a raw byte buffer.
+         */
+        typedef std::basic_string_view<unsigned char> BytesView;
+
         /**
          * @brief Creates an ECHO request packet.
          * 
@@ -35,14 +42,26 @@ class Protocol {
         virtual Bytes createEchoRequest(bool includeVersion = false) = 0;
 
         /**
-         * @brief Creates a SEARCH request packet for a list of PVs.
-         * 
-         * @param pvs A vector of pairs (Channel CID, PV Name) to search for.
-         * @return std::pair<Bytes, uint16_t> A pair containing:
-         *         - The constructed packet buffer.
-         *         - The count of PVs that fit into the packet.
+         * @brief Starts a new SEARCH request packet.
+         *
+         * Clears the buffer and writes any header that must precede the searches.
+         * Buffer's capacity is preserved, reusing the same buffer for consecutive
+         * packets doesn't allocate memory.
+         *
+         * @param packet Buffer to build the packet in.
+         */
+        virtual void initSearchRequest(Bytes& packet) = 0;
+
+        /**
+         * @brief Appends a search for a single PV to the SEARCH request packet.
+         *
+         * @param packet Buffer previously initialized with initSearchRequest().
+         * @param chanId Channel ID to search with.
+         * @param pvname Name of the PV to search for.
+         * @param maxSize Maximum size of the packet in bytes.
+         * @return bool False if the search would exceed maxSize, packet is left unchanged.
          */
-        virtual std::pair<Bytes, uint16_t> createSearchRequest(const std::vector<std::pair<uint32_t, std::string>>& pvs) = 0;
+        virtual bool addSearchRequest(Bytes& packet, uint32_t chanId, const std::string& pvname, size_t maxSize) = 0;
 
         /**
          * @brief Updates a SEARCH reply packet with the given channel ID.
@@ -88,4 +107,13 @@ class Protocol {
          * @return std::pair<std::string, uint16_t> A pair containing the IOC IP and port.
          */
         virtual std::pair<std::string, uint16_t> parseIocAddr(const std::string& ip, uint16_t udpPort, const Bytes& buffer) = 0;
+
+        /**
+         * @brief Parses a beacon packet into a list of announcing IOCs.
+         *
+         * @param ip The IP address the packet was received from.
+         * @param buffer The buffer containing the beacon packet.
+         * @return std::vector<std::tuple<std::string, uint16_t, uint32_t>> A vector of (IOC IP, IOC port, Beacon ID).
+         */
+        virtual std::vector<std::tuple<std::string, uint16_t, uint32_t>> parseBeacons(const std::string& ip, const Bytes& buffer) = 0;
 };
@@ -4,6 +4,7 @@
 
 static uint16_t const CMD_VERSION =  0x0;
 static uint16_t const CMD_SEARCH  =  0x6;
+static uint16_t const CMD_BEACON  =  0xD;
 static uint16_t const CMD_ECHO    = 0x17;
 
 struct Header {
@@ -33,44 +34,42 @@ Protocol::Bytes ChannelAccess::createEchoRequest(bool includeVersion)
     return buffer;
 }
 
-std::pair<Protocol::Bytes, uint16_t> ChannelAccess::createSearchRequest(const std::vector<std::pair<uint32_t, std::string>>& pvs) {
-    Protocol::Bytes buffer(sizeof(Header), 0);
+void ChannelAccess::initSearchRequest(Protocol::Bytes& packet)
+{
+    packet.assign(sizeof(Header), 0);
 
-    auto hdr = reinterpret_cast<Header *>(buffer.data());
+    auto hdr = reinterpret_cast<Header *>(packet.data());
     hdr->command = ::htons(CMD_VERSION);
     hdr->payloadLen = ::htons(0x0);
     hdr->dataType = ::htons(0x1);
     hdr->dataCount = ::htons(13);
     hdr->param1 = ::htons(0x0);
     hdr->param2 = ::htons(0x0);
+}
 
-    size_t offset = buffer.size();
-    uint16_t nPvs = 0;
-    for (const auto& [chanId, pvname]: pvs) {
-        uint16_t payloadLen = (((pvname.length()+1) & 0xFFFF) + 7) & ~7; // must be aligned to 8
-        buffer.resize(buffer.size() + sizeof(Header) + payloadLen);
-
-        hdr = reinterpret_cast<Header *>(buffer.data() + offset);
-        hdr->command = ::htons(CMD_SEARCH);
-        hdr->payloadLen = ::htons(payloadLen);
-        hdr->dataType = ::htons(0x5);
-        hdr->dataCount = ::htons(13);
-        hdr->param1 = ::htonl(chanId);
-        hdr->param2 = ::htonl(chanId);
+bool ChannelAccess::addSearchRequest(Protocol::Bytes& packet, uint32_t chanId, const std::string& pvname, size_t maxSize)
+{
+    uint16_t payloadLen = (((pvname.length()+1) & 0xFFFF) + 7) & ~7; // must be aligned to 8
+    size_t offset = packet.size();
+    if ((offset + sizeof(Header) + payloadLen) > maxSize) {
+        return false;
+    }
 
-        auto payload = reinterpret_cast<char *>(buffer.data() + offset + sizeof(Header));
-        pvname.copy(payload, pvname.length() & 0xFFFF);
+    // Grows within the reserved capacity, zero-fills the padding
+    packet.resize(offset + sizeof(Header) + payloadLen, 0);
 
-        offset += sizeof(Header) + payloadLen;
-        nPvs++;
+    auto hdr = reinterpret_cast<Header *>(packet.data() + offset);
+    hdr->command = ::htons(CMD_SEARCH);
+    hdr->payloadLen = ::htons(payloadLen);
+    hdr->dataType = ::htons(0x5);
+    hdr->dataCount = ::htons(13);
+    hdr->param1 = ::htonl(chanId);
+    hdr->param2 = ::htonl(chanId);
 
-        // Limit packet size to about 1000 bytes
-        if (offset > 1000) {
-            break;
-        }
-    }
+    auto payload = reinterpret_cast<char *>(packet.data() + offset + sizeof(Header));
+    pvname.copy(payload, pvname.length() & 0xFFFF);
 
-    return std::make_pair(buffer, nPvs);
+    return true;
 }
 
 bool ChannelAccess::updateSearchReply(Bytes& reply, uint32_t chanId)
@@ -195,3 +194,30 @@ std::pair<std::string, uint16_t> ChannelAccess::parseIocAddr(const std::string&
 
     return std::make_pair("", 0);
 }
+
+std::vector<std::tuple<std::string, uint16_t, uint32_t>> ChannelAccess::parseBeacons(const std::string& ip, const Protocol::Bytes& buffer)
+{
+    std::vector<std::tuple<std::string, uint16_t, uint32_t>> beacons;
+
+    size_t offset = 0;
+    while ((offset + sizeof(Header)) <= buffer.size()) {
+        auto hdr = reinterpret_cast<const Header*>(buffer.data() + offset);
+        uint16_t command = ::ntohs(hdr->command);
+        auto payloadLen = ::ntohs(hdr->payloadLen);
+
+        if (command == CMD_BEACON) {
+            // IOC may leave its address empty for the receiver to use the sender's address
+            auto iocIp = ip;
+            if (hdr->param2 != INADDR_ANY) {
+                char buf[20] = {0};
+                ::inet_ntop(AF_INET, &hdr->param2, buf, sizeof(buf)-1);
+                iocIp = buf;
+            }
+            beacons.emplace_back(iocIp, ::ntohs(hdr->dataCount), ::ntohl(hdr->param1));
+        }
+
+        offset += sizeof(Header) + payloadLen;
+    }
+
+    return beacons;
+}
@@ -26,14 +26,16 @@ class ChannelAccess : public Protocol {
         Bytes createEchoRequest(bool includeVersion=false);
 
         /**
-         * @brief Creates a CA SEARCH payload.
-         * 
-         * Constructs a packet containing as many Search requests as fit within a safe MTU.
-         * 
-         * @param pvs List of (CID, Name) to search for.
-         * @return std::pair<Bytes, uint16_t> The packet buffer and the count of PVs included.
+         * @brief Starts a CA SEARCH packet with the CA_PROTO_VERSION header.
+         * @note Implements Protocol::initSearchRequest.
+         */
+        void initSearchRequest(Bytes& packet);
+
+        /**
+         * @brief Appends CA_PROTO_SEARCH header and the PV name to the packet.
+         * @note Implements Protocol::addSearchRequest.
          */
-        std::pair< Bytes, uint16_t> createSearchRequest(const std::vector<std::pair<uint32_t, std::string>> &pvs);
+        bool addSearchRequest(Bytes& packet, uint32_t chanId, const std::string& pvname, size_t maxSize);
 
         /**
          * @brief Updates a search reply buffer with a specific Channel ID.
@@ -64,4 +66,10 @@ class ChannelAccess : public Protocol {
          * @return Pair of (IP String, Port).
          */
         std::pair<std::string, uint16_t> parseIocAddr(const std::string& ip, uint16_t udpPort, const Bytes& buffer);
+
+        /**
+         * @brief Extracts IOC addresses and beacon IDs from RSRV_IS_UP messages.
+         * @return List of (IP String, Port, Beacon ID).
+         */
+        std::vector<std::tuple<std::string, uint16_t, uint32_t>> parseBeacons(const std::string& ip, const Bytes& buffer);
 };
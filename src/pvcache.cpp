@@ -0,0 +1,295 @@
+#include "pvcache.hpp"
+
+PvCache::PvCache()
+{
+    m_index.assign(MIN_BUCKETS, {0, EMPTY});
+}
+
+uint64_t PvCache::hash(std::string_view pvname)
+{
+    return std::hash<std::string_view>()(pvname);
+}
+
+size_t PvCache::findBucket(std::string_view pvname, uint64_t h) const
+{
+    size_t mask = m_index.size() - 1;
+    auto tag = static_cast<uint32_t>(h >> 32);
+    for (size_t pos = (h & mask); ; pos = ((pos + 1) & mask)) {
+        auto& bucket = m_index[pos];
+        if (bucket.slot == EMPTY) {
+            return m_index.size();
+        }
+        if (bucket.slot != DELETED && bucket.hash == tag && m_entries[bucket.slot].pvname == pvname) {
+            return pos;
+        }
+    }
+}
+
+void PvCache::rehash(size_t nBuckets)
+{
+    std::vector<Bucket> index(nBuckets, {0, EMPTY});
+    size_t mask = nBuckets - 1;
+    for (auto& bucket: m_index) {
+        if (bucket.slot == EMPTY || bucket.slot == DELETED) {
+            continue;
+        }
+        auto pos = (m_entries[bucket.slot].hash & mask);
+        while (index[pos].slot != EMPTY) {
+            pos = ((pos + 1) & mask);
+        }
+        index[pos] = bucket;
+    }
+    m_index.swap(index);
+    m_deleted = 0;
+}
+
+void PvCache::reserve(size_t n)
+{
+    // Keep the load factor under 1/2 after rebuilding
+    size_t nBuckets = MIN_BUCKETS;
+    while (nBuckets < 2 * n) {
+        nBuckets <<= 1;
+    }
+    if (nBuckets > m_index.size()) {
+        rehash(nBuckets);
+    }
+}
+
+void PvCache::setCapacity(size_t capacity, const EntryCb& evictCb)
+{
+    m_capacity = capacity;
+    m_evictCb = evictCb;
+    while (m_capacity > 0 && m_size > m_capacity) {
+        evict();
+    }
+}
+
+void PvCache::evict()
+{
+    // Every PV gets cleared in the first round at most, terminates in two rounds
+    while (true) {
+        if (m_clockHand >= m_entries.size()) {
+            m_clockHand = 0;
+        }
+        auto slot = m_clockHand++;
+        auto& pv = m_entries[slot];
+        if (pv.used == false) {
+            continue;
+        }
+        if (pv.referenced.exchange(false, std::memory_order_relaxed)) {
+            continue;
+        }
+
+        if (m_evictCb) {
+            m_evictCb(pv);
+        }
+        eraseBucket(findBucket(pv.pvname, pv.hash));
+        m_stats.evictions++;
+        return;
+    }
+}
+
+PvCache::Entry* PvCache::find(std::string_view pvname)
+{
+    auto pos = findBucket(pvname, hash(pvname));
+    if (pos == m_index.size()) {
+        m_stats.misses++;
+        return nullptr;
+    }
+    m_stats.hits++;
+    auto& pv = m_entries[m_index[pos].slot];
+    pv.referenced.store(true, std::memory_order_relaxed);
+    pv.lastLookup.store(lookupTime(), std::memory_order_relaxed);
+    return &pv;
+}
+
+const PvCache::Entry* PvCache::peek(std::string_view pvname) const
+{
+    auto pos = findBucket(pvname, hash(pvname));
+    if (pos == m_index.size()) {
+        return nullptr;
+    }
+    auto& pv = m_entries[m_index[pos].slot];
+    pv.referenced.store(true, std::memory_order_relaxed);
+    pv.lastLookup.store(lookupTime(), std::memory_order_relaxed);
+    return &pv;
+}
+
+PvCache::Entry& PvCache::insert(const std::string& pvname)
+{
+    auto h = hash(pvname);
+    auto pos = findBucket(pvname, h);
+    if (pos != m_index.size()) {
+        return m_entries[m_index[pos].slot];
+    }
+
+    if (m_capacity > 0 && m_size >= m_capacity) {
+        evict();
+    }
+
+    // Probe sequences get long when buckets, including tombstones, are over 3/4 full
+    if (4 * (m_size + m_deleted + 1) > 3 * m_index.size()) {
+        if (2 * (m_size + 1) > m_index.size()) {
+            reserve(m_size + 1);
+        } else {
+            rehash(m_index.size());
+        }
+    }
+
+    uint32_t slot;
+    if (m_freeSlots.empty() == false) {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    } else {
+        slot = static_cast<uint32_t>(m_entries.size());
+        m_entries.emplace_back();
+    }
+    auto& entry = m_entries[slot];
+    entry.pvname = pvname;
+    entry.used = true;
+    entry.hash = h;
+
+    // Reuse the first tombstone on the way
+    size_t mask = m_index.size() - 1;
+    pos = (h & mask);
+    while (m_index[pos].slot != EMPTY && m_index[pos].slot != DELETED) {
+        pos = ((pos + 1) & mask);
+    }
+    if (m_index[pos].slot == DELETED) {
+        m_deleted--;
+    }
+    m_index[pos] = {static_cast<uint32_t>(h >> 32), slot};
+    m_size++;
+
+    return entry;
+}
+
+bool PvCache::erase(std::string_view pvname)
+{
+    auto pos = findBucket(pvname, hash(pvname));
+    if (pos == m_index.size()) {
+        return false;
+    }
+    eraseBucket(pos);
+    return true;
+}
+
+void PvCache::eraseBucket(size_t pos)
+{
+    auto slot = m_index[pos].slot;
+    detachIoc(slot);
+    // Entries are not copyable because of the atomic flag, reset in place
+    auto& entry = m_entries[slot];
+    entry.pvname.clear();
+    entry.hash = 0;
+    entry.unverified = false;
+    entry.used = false;
+    entry.referenced.store(false, std::memory_order_relaxed);
+    entry.lastLookup.store(0, std::memory_order_relaxed);
+    m_freeSlots.push_back(slot);
+
+    // Tombstone is not needed when the next bucket ends the probing anyway
+    if (m_index[(pos + 1) & (m_index.size() - 1)].slot == EMPTY) {
+        m_index[pos].slot = EMPTY;
+    } else {
+        m_index[pos].slot = DELETED;
+        m_deleted++;
+    }
+    m_size--;
+}
+
+uint32_t PvCache::addIoc(const std::shared_ptr<IocGuard>& guard)
+{
+    uint32_t ioc;
+    if (m_freeIocs.empty() == false) {
+        ioc = m_freeIocs.back();
+        m_freeIocs.pop_back();
+    } else {
+        ioc = static_cast<uint32_t>(m_iocs.size());
+        m_iocs.emplace_back();
+    }
+    auto& record = m_iocs[ioc];
+    record.guard = guard;
+    record.listed = true;
+    record.used = true;
+    m_nIocs++;
+    return ioc;
+}
+
+void PvCache::unlistIoc(uint32_t ioc)
+{
+    auto& record = m_iocs[ioc];
+    record.listed = false;
+    if (record.nPvs == 0) {
+        releaseIoc(ioc);
+    }
+}
+
+void PvCache::releaseIoc(uint32_t ioc)
+{
+    m_iocs[ioc] = Ioc();
+    m_freeIocs.push_back(ioc);
+    m_nIocs--;
+}
+
+void PvCache::detachIoc(uint32_t slot)
+{
+    auto& pv = m_entries[slot];
+    if (pv.ioc == NO_IOC) {
+        return;
+    }
+
+    auto& record = m_iocs[pv.ioc];
+    if (pv.iocPrev != NO_PV) {
+        m_entries[pv.iocPrev].iocNext = pv.iocNext;
+    } else {
+        record.firstPv = pv.iocNext;
+    }
+    if (pv.iocNext != NO_PV) {
+        m_entries[pv.iocNext].iocPrev = pv.iocPrev;
+    }
+
+    auto ioc = pv.ioc;
+    pv.ioc = NO_IOC;
+    pv.iocNext = NO_PV;
+    pv.iocPrev = NO_PV;
+    if (--record.nPvs == 0 && record.listed == false) {
+        releaseIoc(ioc);
+    }
+}
+
+void PvCache::setIoc(Entry& pv, uint32_t ioc)
+{
+    if (pv.ioc == ioc) {
+        return;
+    }
+
+    // Hash is already known, finding the slot doesn't touch other entries much
+    auto slot = m_index[findBucket(pv.pvname, pv.hash)].slot;
+
+    // Count the new one first, in case the old record gets released
+    auto& record = m_iocs[ioc];
+    record.nPvs++;
+    detachIoc(slot);
+
+    pv.ioc = ioc;
+    pv.iocPrev = NO_PV;
+    pv.iocNext = record.firstPv;
+    if (record.firstPv != NO_PV) {
+        m_entries[record.firstPv].iocPrev = slot;
+    }
+    record.firstPv = slot;
+}
+
+size_t PvCache::eraseIoc(uint32_t ioc, const EntryCb& cb)
+{
+    // Unlisted record is cleared together with the last PV, ending the loop
+    size_t nErased = 0;
+    while (m_iocs[ioc].firstPv != NO_PV) {
+        auto& pv = m_entries[m_iocs[ioc].firstPv];
+        cb(pv);
+        eraseBucket(findBucket(pv.pvname, pv.hash));
+        nErased++;
+    }
+    return nErased;
+}
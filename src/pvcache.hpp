@@ -0,0 +1,360 @@
+/**
+ * @file pvcache.hpp
+ * @brief Cache of found PVs, optimized for lookups by name.
+ */
+
+#pragma once
+
+#include "iocguard.hpp"
+#include "proto.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/**
+ * @class PvCache
+ * @brief Hash table of found PVs and the IOCs hosting them.
+ *
+ * Entries are stored in slots that are reused once the PV is removed, so they
+ * never move in memory. Slots are looked up through an open-addressed index
+ * with linear probing. Index buckets are 8 bytes, they hold the slot and the
+ * upper half of the PV name's hash, so that probing compares names only for
+ * likely matches and a miss rarely touches any entry. Removed PVs leave a
+ * tombstone in the index, the index is rebuilt when it's too full.
+ *
+ * Everything PVs on the same IOC have in common is stored once in an IOC
+ * record, PVs only refer to it by a small id. That includes the search reply,
+ * which differs between PVs of the same IOC only in the channel ID that is
+ * filled in for every client anyway. PVs of each IOC are linked in an
+ * intrusive list, so that all of them can be removed at once when the IOC
+ * disconnects.
+ *
+ * Number of cached PVs can be limited. When the cache is full, a PV is evicted
+ * using the CLOCK algorithm: the hand sweeps over the slots, PVs looked up since
+ * the hand passed them last time get a second chance, the first PV not looked
+ * up is evicted. PVs that clients keep asking for thus stay in the cache, while
+ * PVs found once and never asked for again make space for new ones.
+ *
+ * Cache is not synchronized. Const methods can be called from several threads
+ * at once as long as the caller guards modifications with a lock, peek() is
+ * meant for such readers.
+ */
+class PvCache {
+    public:
+        /**
+         * @struct Entry
+         * @brief Cached PV.
+         */
+        static constexpr uint32_t NO_IOC = UINT32_MAX;
+        static constexpr uint32_t NO_PV = UINT32_MAX;
+
+        /**
+         * @struct Stats
+         * @brief Lookup statistics, to tune the cache size.
+         */
+        struct Stats {
+            uint64_t hits = 0;          ///< Lookups of cached PVs.
+            uint64_t misses = 0;        ///< Lookups of PVs not in cache.
+            uint64_t evictions = 0;     ///< PVs removed to make space for new ones.
+        };
+
+        /**
+         * @struct Ioc
+         * @brief IOC hosting cached PVs.
+         */
+        struct Ioc {
+            /**
+             * Pointer to the IOC monitoring connection to determine IOC status.
+             * This allows for quick determination if the PVs are valid or not.
+             * When IOC disconnects, its status will change.
+             */
+            std::shared_ptr<IocGuard> guard;
+
+            /** Search reply template returned to the clients, channel ID is filled in when sending */
+            Protocol::Bytes reply;
+
+            /** UDP port where the IOC accepts searches, to probe it when it reconnects */
+            uint16_t udpPort = 0;
+
+            /** Number of cached PVs on this IOC */
+            uint32_t nPvs = 0;
+
+            /** Slot of the first PV on this IOC, NO_PV when none */
+            uint32_t firstPv = NO_PV;
+
+            /** IOC is tracked by its address, the record is kept even without PVs */
+            bool listed = false;
+
+            /** Slot is assigned to an IOC */
+            bool used = false;
+        };
+
+        /**
+         * @struct Entry
+         * @brief Cached PV.
+         */
+        struct Entry {
+            /** Name of the PV. */
+            std::string pvname;
+
+            /** Hash of the PV name, to rebuild the index without hashing all names again */
+            uint64_t hash = 0;
+
+            /** Id of the IOC hosting the PV, NO_IOC when not assigned */
+            uint32_t ioc = NO_IOC;
+
+            /** Slot of the next PV on the same IOC, NO_PV when last */
+            uint32_t iocNext = NO_PV;
+
+            /** Slot of the previous PV on the same IOC, NO_PV when first */
+            uint32_t iocPrev = NO_PV;
+
+            /** PV was loaded from the cache file or its IOC is being reconnected, not valid until the IOC connects */
+            bool unverified = false;
+
+            /** Slot is assigned to a cached PV */
+            bool used = false;
+
+            /** PV was looked up since the eviction hand passed it, also set by concurrent readers */
+            mutable std::atomic<bool> referenced{false};
+
+            /** Time of the last lookup as returned by lookupTime(), 0 when not looked up since cached, also set by concurrent readers */
+            mutable std::atomic<uint32_t> lastLookup{0};
+        };
+
+        /**
+         * @brief Callback invoked with a PV before it's removed from the cache.
+         */
+        typedef std::function<void(const Entry& pv)> EntryCb;
+
+    private:
+        /**
+         * @struct Bucket
+         * @brief Index entry pointing to a slot.
+         */
+        struct Bucket {
+            uint32_t hash;  ///< Upper half of the PV name's hash.
+            uint32_t slot;  ///< Slot of the entry, EMPTY or DELETED.
+        };
+
+        static constexpr uint32_t EMPTY = UINT32_MAX;       ///< Bucket was never used, ends probing.
+        static constexpr uint32_t DELETED = UINT32_MAX - 1; ///< Tombstone of a removed entry.
+        static constexpr size_t MIN_BUCKETS = 16;
+
+        std::deque<Entry> m_entries;        ///< Slots of cached PVs.
+        std::vector<uint32_t> m_freeSlots;  ///< Released slots, to be reused.
+        std::vector<Bucket> m_index;        ///< Open-addressed index, power of 2 size.
+        std::deque<Ioc> m_iocs;             ///< IOC records, indexed by IOC id.
+        std::vector<uint32_t> m_freeIocs;   ///< Released IOC ids, to be reused.
+        size_t m_nIocs = 0;                 ///< Number of IOC records in use.
+        size_t m_capacity = 0;              ///< Max number of cached PVs, 0 for unlimited.
+        uint32_t m_clockHand = 0;           ///< Next slot considered for eviction.
+        EntryCb m_evictCb;                  ///< Invoked for every evicted PV.
+        Stats m_stats;
+        size_t m_size = 0;                  ///< Number of cached PVs.
+        size_t m_deleted = 0;               ///< Number of tombstones in the index.
+
+        /**
+         * @brief Calculates the hash of the PV name.
+         */
+        static uint64_t hash(std::string_view pvname);
+
+        /**
+         * @brief Finds the index bucket pointing to the PV.
+         * @return Bucket position, or index size when not found.
+         */
+        size_t findBucket(std::string_view pvname, uint64_t h) const;
+
+        /**
+         * @brief Rebuilds the index with the given number of buckets, dropping tombstones.
+         */
+        void rehash(size_t nBuckets);
+
+        /**
+         * @brief Removes the PV from its IOC, releasing the IOC record if it's no longer needed.
+         */
+        void detachIoc(uint32_t slot);
+
+        /**
+         * @brief Removes the PV from the index and releases its slot.
+         * @param pos Index bucket pointing to the PV.
+         */
+        void eraseBucket(size_t pos);
+
+        /**
+         * @brief Evicts a PV that wasn't looked up recently.
+         */
+        void evict();
+
+        /**
+         * @brief Frees the IOC record for reuse.
+         */
+        void releaseIoc(uint32_t ioc);
+
+    public:
+        PvCache();
+
+        /**
+         * @brief Grows the index so that it doesn't need rebuilding while adding up to n PVs.
+         */
+        void reserve(size_t n);
+
+        /**
+         * @brief Limits the number of cached PVs.
+         *
+         * Excess PVs are evicted when new ones are added.
+         *
+         * @param capacity Max number of cached PVs, 0 for unlimited.
+         * @param evictCb Callback invoked with every evicted PV.
+         */
+        void setCapacity(size_t capacity, const EntryCb& evictCb);
+
+        /**
+         * @brief Returns current time in seconds, for comparing with Entry::lastLookup.
+         */
+        static uint32_t lookupTime()
+        {
+            return static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+        }
+
+        /**
+         * @brief Finds the cached PV, marking it as recently used.
+         * @return Pointer to the entry, nullptr when not cached. Valid until the PV is removed.
+         */
+        Entry* find(std::string_view pvname);
+
+        /**
+         * @brief Finds the cached PV without updating statistics.
+         *
+         * PV is marked as recently used, that's the only change and it's safe to
+         * make from several threads at once.
+         *
+         * @return Pointer to the entry, nullptr when not cached.
+         */
+        const Entry* peek(std::string_view pvname) const;
+
+        /**
+         * @brief Returns the cached PV, adding an empty entry if not cached yet.
+         *
+         * Adding a PV to a full cache evicts another PV.
+         */
+        Entry& insert(const std::string& pvname);
+
+        /**
+         * @brief Removes the PV from the cache.
+         * @return True if the PV was cached.
+         */
+        bool erase(std::string_view pvname);
+
+        /**
+         * @brief Returns number of cached PVs.
+         */
+        size_t size() const { return m_size; }
+
+        /**
+         * @brief Returns lookup statistics since start.
+         */
+        const Stats& getStats() const { return m_stats; }
+
+        /**
+         * @brief Creates a new IOC record.
+         *
+         * Record is listed until unlistIoc() is called, and kept afterwards
+         * as long as any PV refers to it.
+         *
+         * @param guard Monitoring connection of the IOC.
+         * @return Id of the IOC.
+         */
+        uint32_t addIoc(const std::shared_ptr<IocGuard>& guard);
+
+        /**
+         * @brief Marks the IOC record as no longer tracked by its address.
+         *
+         * Record is released right away if no PV refers to it, or when the last such PV is removed.
+         */
+        void unlistIoc(uint32_t ioc);
+
+        /**
+         * @brief Returns the IOC record, the id must be valid.
+         */
+        Ioc& getIoc(uint32_t ioc) { return m_iocs[ioc]; }
+        const Ioc& getIoc(uint32_t ioc) const { return m_iocs[ioc]; }
+
+        /**
+         * @brief Moves the PV to the given IOC.
+         */
+        void setIoc(Entry& pv, uint32_t ioc);
+
+        /**
+         * @brief Removes all PVs of the IOC from the cache.
+         *
+         * @param ioc Id of the IOC.
+         * @param cb Callback invoked with every PV before it's removed.
+         * @return Number of removed PVs.
+         */
+        size_t eraseIoc(uint32_t ioc, const EntryCb& cb);
+
+        /**
+         * @brief Returns number of IOC records in use.
+         */
+        size_t iocCount() const { return m_nIocs; }
+
+        /**
+         * @brief Invokes the callback for every PV of the IOC.
+         *
+         * Callback may modify the PV, but must not remove or move it to another IOC.
+         */
+        template <typename F>
+        void forEachOnIoc(uint32_t ioc, F&& f)
+        {
+            for (auto slot = m_iocs[ioc].firstPv; slot != NO_PV; slot = m_entries[slot].iocNext) {
+                f(m_entries[slot]);
+            }
+        }
+
+        /**
+         * @brief Invokes the callback for every cached PV.
+         */
+        template <typename F>
+        void forEach(F&& f) const
+        {
+            for (auto& entry: m_entries) {
+                if (entry.used) {
+                    f(entry);
+                }
+            }
+        }
+
+        /**
+         * @brief Invokes the callback for cached PVs in the next slots, to spread a walk over time.
+         *
+         * PVs added or removed between steps may or may not be visited.
+         *
+         * @param cursor Next slot to visit, 0 to start the walk. Advanced by the step, reset when done.
+         * @param maxSlots Max number of slots to visit.
+         * @return True when all slots were visited.
+         */
+        template <typename F>
+        bool forEachStep(size_t& cursor, size_t maxSlots, F&& f) const
+        {
+            auto end = std::min(m_entries.size(), cursor + maxSlots);
+            for (; cursor < end; cursor++) {
+                if (m_entries[cursor].used) {
+                    f(m_entries[cursor]);
+                }
+            }
+            if (cursor < m_entries.size()) {
+                return false;
+            }
+            cursor = 0;
+            return true;
+        }
+};
@@ -3,19 +3,42 @@
 #include "searcher.hpp"
 
 #include <algorithm>
-#include <cmath>
 #include <cstdint>
 #include <fcntl.h>
-#include <numeric>
+#include <tuple>
 #include <vector>
 
-Searcher::Searcher(const std::string& ip, uint16_t port, const std::vector<uint32_t>& searchIntervals, const std::shared_ptr<Protocol>& protocol, PvFoundCb& foundPvCb)
+static size_t getMaxPacketSize(unsigned mtu)
+{
+    return (mtu > Searcher::UDP_OVERHEAD ? mtu - Searcher::UDP_OVERHEAD : 0);
+}
+
+static size_t getMaxPacketSize(const std::vector<Searcher::SearchAddress>& addresses)
+{
+    size_t maxSize = 0;
+    for (auto& address: addresses) {
+        maxSize = std::max(maxSize, getMaxPacketSize(address.mtu));
+    }
+    return maxSize;
+}
+
+static size_t getMinPacketSize(const std::vector<Searcher::SearchAddress>& addresses)
+{
+    size_t minSize = getMaxPacketSize(addresses);
+    for (auto& address: addresses) {
+        minSize = std::min(minSize, getMaxPacketSize(address.mtu));
+    }
+    return minSize;
+}
+
+Searcher::Searcher(const std::vector<SearchAddress>& addresses, const std::vector<uint32_t>& searchIntervals, const std::shared_ptr<Protocol>& protocol, PvFoundCb& foundPvCb)
     : m_searchIntervals(searchIntervals)
     , m_protocol(protocol)
     , m_foundPvCb(foundPvCb)
-    , m_searchIp(ip)
-    , m_searchPort(port)
+    , m_batch(4096, getMaxPacketSize(addresses))
+    , m_maxProbeSize(getMinPacketSize(addresses))
 {
+    m_udpReceive = true;
     m_sock = ::socket(AF_INET, SOCK_DGRAM, 0);
     if (m_sock < 0) {
         throw SocketException("failed to create socket - {errno}");
@@ -30,11 +53,25 @@ Searcher::Searcher(const std::string& ip, uint16_t port, const std::vector<uint3
         throw SocketException("failed to set socket non-blocking", errno);
     }
 
-    m_addr = {}; // avoid using memset()
-    m_addr.sin_family = AF_INET;
-    m_addr.sin_port = ::htons(port);
-    if (::inet_aton(ip.c_str(), reinterpret_cast<in_addr*>(&m_addr.sin_addr.s_addr)) == 0) {
-        throw SocketException("invalid IP address - {errno}");
+    for (auto& address: addresses) {
+        struct sockaddr_in addr = {}; // avoid using memset()
+        addr.sin_family = AF_INET;
+        addr.sin_port = ::htons(address.port);
+        if (::inet_aton(address.ip.c_str(), reinterpret_cast<in_addr*>(&addr.sin_addr.s_addr)) == 0) {
+            throw SocketException("invalid IP address - {errno}");
+        }
+
+        // Packets are built once for all destinations with the same MTU
+        auto maxPacketSize = getMaxPacketSize(address.mtu);
+        auto group = std::find_if(m_groups.begin(), m_groups.end(), [maxPacketSize](auto& g) { return g.maxPacketSize == maxPacketSize; });
+        if (group == m_groups.end()) {
+            group = m_groups.emplace(m_groups.end());
+            group->maxPacketSize = maxPacketSize;
+            // Packet buffer is reused for all searches, no need to ever allocate again
+            group->packet.reserve(maxPacketSize);
+        }
+        group->addrs.push_back(addr);
+        group->addresses.push_back(address);
     }
 
     // Search at most every 0.1s
@@ -46,70 +83,160 @@ Searcher::Searcher(const std::string& ip, uint16_t port, const std::vector<uint3
     m_searchIntervals.insert(m_searchIntervals.begin(), 2);
     m_searchIntervals.insert(m_searchIntervals.begin(), 1);
 
-    // Now allocate buckets of PVs to be searched for every 0.1s apart
-    auto maxInterval = m_searchIntervals.back();
-    auto nBins = maxInterval;
-    m_searchedPvs.resize(nBins);
+    // IOCs may be on any of the networks, probes must fit all of them
+    m_probePacket.reserve(m_maxProbeSize);
 
-    m_lastSearch = std::chrono::steady_clock::now();
+    m_startTime = std::chrono::steady_clock::now();
 }
 
-uint32_t Searcher::getNextChanId()
+uint32_t Searcher::allocSlot()
 {
-    if (++m_chanId == INT32_MAX) {
-        // Change ids of all searched PVs
-        m_chanId = 0;
-        for (auto& bin: m_searchedPvs) {
-            for (auto& pv: bin) {
-                pv.chanId = m_chanId++;
-            }
-        }
+    uint32_t slot;
+    if (!m_freeSlots.empty()) {
+        slot = m_freeSlots.front();
+        m_freeSlots.pop_front();
+    } else if (m_searchedPvs.size() <= CHANID_SLOT_MASK) {
+        slot = static_cast<uint32_t>(m_searchedPvs.size());
+        m_searchedPvs.emplace_back();
+        m_searchedPvs.back().chanId = slot;
+    } else {
+        return TimerWheel::NONE;
+    }
+
+    m_searchedPvs[slot].used = true;
+    return slot;
+}
+
+void Searcher::releaseSlot(uint32_t slot)
+{
+    auto& pv = m_searchedPvs[slot];
+    m_pvIndex.erase(pv.pvname);
+    m_schedule.cancel(slot);
+    if (pv.queued) {
+        // Entry in the ready queue is skipped when popped
+        pv.queued = false;
+        m_nQueued--;
+    }
+
+    // Bump the generation, wraps around naturally
+    pv.chanId += (1u << CHANID_SLOT_BITS);
+    pv.used = false;
+    pv.referenced = false;
+    pv.probeIp = 0;
+    pv.probeSent = false;
+    std::string().swap(pv.pvname);
+    m_freeSlots.push_back(slot);
+}
+
+Searcher::SearchedPV* Searcher::findChanId(uint32_t chanId)
+{
+    auto slot = chanId & CHANID_SLOT_MASK;
+    if (slot < m_searchedPvs.size() && m_searchedPvs[slot].used && m_searchedPvs[slot].chanId == chanId) {
+        return &m_searchedPvs[slot];
     }
-    return m_chanId;
+    return nullptr;
+}
+
+TimerWheel::Tick Searcher::currentTick() const
+{
+    return static_cast<TimerWheel::Tick>((std::chrono::steady_clock::now() - m_startTime) / TICK);
 }
 
 bool Searcher::addPV(const std::string& pvname)
 {
-    for (auto& bin: m_searchedPvs) {
-        for (auto& pv: bin) {
-            if (pv.pvname == pvname) {
-                // We're already searching for this PV
-                pv.lastSearched = std::chrono::steady_clock::now();
-                return false;
-            }
-        }
+    auto it = m_pvIndex.find(pvname);
+    if (it != m_pvIndex.end()) {
+        // We're already searching for this PV
+        m_searchedPvs[it->second].lastSearched = std::chrono::steady_clock::now();
+        m_searchedPvs[it->second].referenced = true;
+        return false;
+    }
+
+    if (m_maxPvs > 0 && m_pvIndex.size() >= m_maxPvs) {
+        evict();
+    }
+
+    auto slot = allocSlot();
+    if (slot == TimerWheel::NONE) {
+        LOG_ERROR("Can't search for ", pvname, ", too many PVs being searched for");
+        return false;
     }
 
-    // Prepend the PV to the first bucket to be picked up next time we search for PVs
-    SearchedPV pv;
+    auto& pv = m_searchedPvs[slot];
     pv.pvname = pvname;
     pv.lastSearched = std::chrono::steady_clock::now();
-    pv.chanId = m_chanId++;
-    pv.intervals = m_searchIntervals;
-    m_searchedPvs[m_currentBin].emplace_front(pv);
+    pv.interval = 0;
+    m_pvIndex.emplace(pv.pvname, slot);
+
+    // PVs recently not found skip the initial burst of searches
+    auto match = m_negativeCache.lookup(pvname);
+    if (match != NegativeCache::Match::None) {
+        LOG_VERBOSE(pvname, " was not found recently, searching at the longest interval");
+        pv.interval = static_cast<uint16_t>(m_searchIntervals.size() - 1);
+        // Filter hit may be a false positive, don't make it an exact entry
+        if (match == NegativeCache::Match::Exact) {
+            m_negativeCache.insert(pvname);
+        }
+    }
+
+    // Schedule the first search to be picked up next time we search for PVs
+    m_schedule.schedule(slot, m_schedule.now() + 1);
+    scheduleWakeup();
 
     return true;
 }
 
-void Searcher::removePV(const std::string& pvname)
+bool Searcher::addPV(const std::string& pvname, const std::string& iocIp, uint16_t udpPort)
 {
-    for (auto& bin: m_searchedPvs) {
-        for (auto jt = bin.begin(); jt != bin.end(); jt++) {
-            if (jt->pvname == pvname) {
-                bin.erase(jt);
-                return;
-            }
+    if (addPV(pvname) == false) {
+        return false;
+    }
+
+    // First search goes only to the IOC, rest of the schedule stays the same
+    auto& pv = m_searchedPvs[m_pvIndex.at(pvname)];
+    in_addr addr;
+    if (::inet_aton(iocIp.c_str(), &addr) != 0 && udpPort != 0) {
+        pv.probeIp = addr.s_addr;
+        pv.probePort = ::htons(udpPort);
+    }
+    return true;
+}
+
+void Searcher::evict()
+{
+    // Every PV gets cleared in the first round at most, terminates in two rounds
+    while (m_pvIndex.empty() == false) {
+        if (m_clockHand >= m_searchedPvs.size()) {
+            m_clockHand = 0;
+        }
+        auto slot = m_clockHand++;
+        auto& pv = m_searchedPvs[slot];
+        if (pv.used == false) {
+            continue;
         }
+        if (pv.referenced) {
+            pv.referenced = false;
+            continue;
+        }
+
+        LOG_VERBOSE("Stopped searching for ", pv.pvname, " to make space for new PVs");
+        releaseSlot(slot);
+        m_nEvicted++;
+        return;
+    }
+}
+
+void Searcher::removePV(const std::string& pvname)
+{
+    auto it = m_pvIndex.find(pvname);
+    if (it != m_pvIndex.end()) {
+        releaseSlot(it->second);
     }
 }
 
 void Searcher::processIncoming()
 {
-    char buffer[4096];
-    struct sockaddr_in remoteAddr;
-    socklen_t remoteAddrLen = sizeof(remoteAddr);
-    auto recvd = ::recvfrom(m_sock, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr *>(&remoteAddr), &remoteAddrLen);
-    while (recvd > 0) {
+    m_batch.receive(m_sock, [this](const unsigned char* buffer, size_t recvd, const sockaddr_in& remoteAddr) {
         char iocIp[20] = {0};
         ::inet_ntop(AF_INET, &remoteAddr.sin_addr, iocIp, sizeof(iocIp)-1);
         uint16_t udpPort = ::ntohs(remoteAddr.sin_port);
@@ -126,124 +253,348 @@ void Searcher::processIncoming()
             // nameserver is in between, so we need to set the IOC's IP in the packet.
             m_protocol->updateSearchReply(rsp, iocIp, iocPort);
 
-            // The PV must be in one of the bins
-            for (size_t i = 0; i < m_searchedPvs.size(); i++) {
-                // Most likely the PV exists all the time and we'll find the PV right away.
-                // Look in the most recent bin first.
-                auto& bin = m_searchedPvs[(m_currentBin+i-1)%m_searchedPvs.size()];
-                for (auto it = bin.begin(); it != bin.end(); it++) {
-                    if (it->chanId == chanId) {
-                        auto pvname = it->pvname;
+            auto pv = findChanId(chanId);
+            if (pv == nullptr) {
+                LOG_DEBUG("Ignoring search reply for unknown channel id ", chanId, " from ", DnsCache::resolveIP(iocIp), ":", iocPort);
+                continue;
+            }
 
-                        bin.erase(it);
+            auto pvname = pv->pvname;
+            releaseSlot(chanId & CHANID_SLOT_MASK);
+            m_negativeCache.remove(pvname);
 
-                        LOG_VERBOSE("Found ", pvname, " on ", DnsCache::resolveIP(iocIp), ":", iocPort);
-                        m_foundPvCb(pvname, iocIp, iocPort, rsp);
+            LOG_VERBOSE("Found ", pvname, " on ", DnsCache::resolveIP(iocIp), ":", iocPort);
+            m_foundPvCb(pvname, iocIp, iocPort, udpPort, rsp);
+        }
+    });
+}
 
-                        i = m_searchedPvs.size();
-                        break;
-                    }
-                }
+void Searcher::addToPacket(const SearchedPV& pv)
+{
+    for (auto& group: m_groups) {
+        auto& packet = group.packet;
+        if (packet.empty() == false && m_protocol->addSearchRequest(packet, pv.chanId, pv.pvname, group.maxPacketSize) == false) {
+            sendPacket(group);
+        }
+        if (packet.empty()) {
+            m_protocol->initSearchRequest(packet);
+            if (m_protocol->addSearchRequest(packet, pv.chanId, pv.pvname, group.maxPacketSize) == false) {
+                LOG_ERROR("Can't search for ", pv.pvname, ", doesn't fit in a ", group.maxPacketSize, " bytes packet");
+                packet.clear();
+                continue;
             }
         }
-        recvd = ::recvfrom(m_sock, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr *>(&remoteAddr), &remoteAddrLen);
+
+        if (Log::getLogLevel() <= Log::Level::Verbose) {
+            group.packetPvs += pv.pvname + ",";
+        }
     }
+
+    m_totalStats.searches++;
 }
 
-void Searcher::processOutgoing()
+void Searcher::sendPacket(PacketGroup& group)
 {
-    // Enforce 10Hz processing, but leave just a bit of tolerance
-    auto diff = std::chrono::steady_clock::now() - m_lastSearch;
-    auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(diff).count();
-    if (duration < 99) {
+    if (group.packet.empty()) {
         return;
     }
 
-    std::vector<std::pair<uint32_t, std::string>> pvs;
+    if (group.packetPvs.empty() == false) {
+        group.packetPvs.pop_back();
+        for (auto& address: group.addresses) {
+            LOG_VERBOSE("Sending search request for ", group.packetPvs, " to ", DnsCache::resolveIP(address.ip), ":", address.port);
+        }
+        group.packetPvs.clear();
+    }
 
-    auto& bin = m_searchedPvs[m_currentBin];
+    for (auto& addr: group.addrs) {
+        m_batch.send(m_sock, group.packet.data(), group.packet.size(), addr);
+        m_totalStats.packets++;
+        m_totalStats.bytes += group.packet.size();
+        m_packetBudget.consume(1);
+        m_byteBudget.consume(group.packet.size());
+    }
+    group.packet.clear();
+}
 
-    for (auto it = bin.begin(); it != bin.end();) {
-        // Add to the list of PVs to be searched for this time
-        pvs.emplace_back(it->chanId, it->pvname);
+void Searcher::setRateLimit(unsigned long packetsPerSec, unsigned long bytesPerSec)
+{
+    // Allow bursts of one tick worth of traffic, but at least one packet
+    double ticksPerSec = std::chrono::seconds(1) / TICK;
+    m_packetBudget = TokenBucket(packetsPerSec, std::max(1.0, packetsPerSec / ticksPerSec));
+    m_byteBudget = TokenBucket(bytesPerSec, std::max(1.0, bytesPerSec / ticksPerSec));
+}
 
-        // If not the last search interval, determine the new bin
-        // and move the element to that queue. If it is the last
-        // search interval, we leave it in current queue since it's
-        // exactly the max interval apart from now.
-        if (it->intervals.size() > 1) {
-            auto newBinIdx = (m_currentBin + it->intervals.front()) % m_searchedPvs.size();
-            it->intervals.erase(it->intervals.begin());
-            auto jt = it++; // the next command will invalidate current it iterator, make a copy
-            m_searchedPvs[newBinIdx].splice(m_searchedPvs[newBinIdx].begin(), bin, jt);
-        } else {
-            it++;
-        }
+void Searcher::sendProbes()
+{
+    if (m_probes.empty()) {
+        return;
     }
-    m_currentBin = ((m_currentBin + 1) % m_searchedPvs.size());
 
-    // Send some PVs in each iteration depending how large packets are allowed by a given protol.
-    // Keep iterating until there's more PVs to search for
-    while (pvs.empty() == false) {
-        const auto [msg, nPvs] = m_protocol->createSearchRequest(pvs);
+    // Group probes by IOC to pack them together
+    std::sort(m_probes.begin(), m_probes.end(), [this](uint32_t a, uint32_t b) {
+        auto& pvA = m_searchedPvs[a];
+        auto& pvB = m_searchedPvs[b];
+        return std::tie(pvA.probeIp, pvA.probePort) < std::tie(pvB.probeIp, pvB.probePort);
+    });
+
+    struct sockaddr_in addr = {}; // avoid using memset()
+    addr.sin_family = AF_INET;
+    size_t nPvs = 0;
+    auto send = [&]() {
+        if (m_probePacket.empty() == false) {
+            LOG_VERBOSE("Probing IOC ", DnsCache::resolveIP(::inet_ntoa(addr.sin_addr)), ":", ::ntohs(addr.sin_port), " for ", nPvs, " PVs");
+            m_batch.send(m_sock, m_probePacket.data(), m_probePacket.size(), addr);
+            m_probePacket.clear();
+            nPvs = 0;
+        }
+    };
+
+    for (auto slot: m_probes) {
+        auto& pv = m_searchedPvs[slot];
+        if (pv.probeIp != addr.sin_addr.s_addr || pv.probePort != addr.sin_port) {
+            send();
+            addr.sin_addr.s_addr = pv.probeIp;
+            addr.sin_port = pv.probePort;
+        }
+        if (m_probePacket.empty() == false && m_protocol->addSearchRequest(m_probePacket, pv.chanId, pv.pvname, m_maxProbeSize) == false) {
+            send();
+        }
+        if (m_probePacket.empty()) {
+            m_protocol->initSearchRequest(m_probePacket);
+            if (m_protocol->addSearchRequest(m_probePacket, pv.chanId, pv.pvname, m_maxProbeSize) == false) {
+                LOG_ERROR("Can't search for ", pv.pvname, ", doesn't fit in a ", m_maxProbeSize, " bytes packet");
+                m_probePacket.clear();
+            }
+        }
 
-        std::string tmp;
-        std::for_each(pvs.begin(), pvs.begin()+nPvs, [&tmp](auto& jt) { tmp += jt.second + ","; });
-        tmp.pop_back();
-        LOG_VERBOSE("Sending search request for ", tmp, " to ", DnsCache::resolveIP(m_searchIp), ":", m_searchPort);
+        nPvs++;
+        m_totalStats.probes++;
+        pv.probeSent = true;
+        m_schedule.schedule(slot, m_schedule.now() + PROBE_TIMEOUT);
+    }
+    send();
+    m_probes.clear();
+}
+
+void Searcher::setNegativeCache(size_t capacity, unsigned ttl)
+{
+    m_negativeCache = NegativeCache(capacity, ttl);
+}
 
-        ::sendto(m_sock, msg.data(), msg.size(), 0, reinterpret_cast<sockaddr *>(&m_addr), sizeof(sockaddr_in));
+void Searcher::setExpediteHoldoff(unsigned holdoff)
+{
+    m_expediteHoldoff = std::chrono::seconds(holdoff) / TICK;
+}
 
-        pvs.erase(pvs.begin(), pvs.begin() + nPvs);
+void Searcher::pullForward()
+{
+    // PVs at the longest interval, which includes those recently not found,
+    // and PVs waiting for a probe are left alone. The rest is pulled forward
+    // in limited portions, continuing where the previous expedite stopped,
+    // spread over a second.
+    auto lastInterval = m_searchIntervals.size() - 1;
+    auto tick = m_schedule.now() + 1;
+    size_t nPending = 0;
+    size_t nPulled = 0;
+    for (size_t n = 0; n < m_searchedPvs.size() && nPulled < MAX_EXPEDITED; n++) {
+        if (m_expediteHand >= m_searchedPvs.size()) {
+            m_expediteHand = 0;
+        }
+        auto slot = m_expediteHand++;
+        auto& pv = m_searchedPvs[slot];
+        if (m_schedule.isScheduled(slot) == false || pv.interval >= lastInterval || pv.probeIp != 0) {
+            continue;
+        }
+        auto expires = tick + (nPending++ % EXPEDITE_TICKS);
+        if (m_schedule.getExpires(slot) > expires) {
+            m_schedule.schedule(slot, expires);
+            nPulled++;
+        }
     }
+    LOG_VERBOSE("Expedited search for ", nPulled, " PVs");
 }
 
-std::pair<uint32_t, uint32_t> Searcher::purgePVs(unsigned maxtime)
+void Searcher::search(TimerWheel::Tick tick)
 {
-    unsigned nPurged = 0;
-    std::list<SearchedPV> pvs;
-    for (auto& bin: m_searchedPvs) {
-        for (auto it = bin.begin(); it != bin.end();) {
-            auto diff = std::chrono::steady_clock::now() - it->lastSearched;
-            auto duration = std::chrono::duration_cast<std::chrono::seconds>(diff).count();
-            if (duration > maxtime) {
-                LOG_VERBOSE("Purged ", it->pvname, ", last searched ", duration, " seconds ago");
-                it = bin.erase(it);
-                nPurged++;
-            } else {
-                it++;
+    auto totalStats = m_totalStats;
+
+    if (m_expedite && m_schedule.now() >= m_nextExpedite) {
+        m_expedite = false;
+        m_nextExpedite = m_schedule.now() + m_expediteHoldoff;
+        pullForward();
+    }
+
+    m_schedule.advance(tick, [&](uint32_t slot) {
+        auto& pv = m_searchedPvs[slot];
+        if (pv.probeIp != 0) {
+            if (pv.probeSent == false) {
+                m_probes.push_back(slot);
+                return;
             }
+            // IOC didn't respond to the probe, continue with regular search
+            LOG_DEBUG("No response to probe for ", pv.pvname, ", searching on all networks");
+            pv.probeIp = 0;
+            pv.probeSent = false;
+        }
+
+        pv.queued = true;
+        m_nQueued++;
+        if (pv.interval == 0) {
+            m_firstSearches.push_back(slot);
+        } else {
+            m_retries.push_back(slot);
         }
+    });
+
+    // Searches are packed into packets as long as there's budget left, full
+    // packets are sent right away. Budget is charged when the packet is sent,
+    // so the last packet may overdraw it, next ticks make up for it.
+    m_packetBudget.refill();
+    m_byteBudget.refill();
+    while (m_packetBudget.isAvailable() && m_byteBudget.isAvailable()) {
+        auto& queue = (m_firstSearches.empty() ? m_retries : m_firstSearches);
+        if (queue.empty()) {
+            break;
+        }
+        auto slot = queue.front();
+        queue.pop_front();
 
-        // Move all PVs to a temporary queue where they can be balanced to bins evenly
-        pvs.splice(pvs.end(), bin);
-        bin.clear();
+        auto& pv = m_searchedPvs[slot];
+        if (pv.queued == false) {
+            // PV was removed while waiting in the queue
+            continue;
+        }
+        pv.queued = false;
+        m_nQueued--;
+
+        addToPacket(pv);
+
+        // Schedule the next search, the last interval repeats
+        auto delay = m_searchIntervals[pv.interval];
+        if ((pv.interval + 1u) < m_searchIntervals.size()) {
+            pv.interval++;
+            if ((pv.interval + 1u) == m_searchIntervals.size()) {
+                // All shorter intervals tried without success
+                m_negativeCache.insert(pv.pvname);
+            }
+        }
+        m_schedule.schedule(slot, m_schedule.now() + delay);
     }
-    auto nSearching = pvs.size();
 
-    // Balance the PVs in bins evenly, allowing some bins to be empty if the total number of PVs is small
-    auto pvsPerBin = static_cast<size_t>(std::ceil(static_cast<double>(pvs.size()) / m_searchedPvs.size()));
-    for (size_t i = 0; i < m_searchedPvs.size() && !pvs.empty(); i++) {
-        auto& bin = m_searchedPvs[i];
-        size_t nPvs = std::min(pvsPerBin, pvs.size());
-        if (nPvs < 10) {
-            // Not optimal to send only a few PVs in a UDP packet, let's 
-            // combine some PVs. Pick 10 as conservative number of how many
-            // PVs can fit in a single packet, but still significant improvement
-            // when pvsPerBin is very small.
-            i += (10 - nPvs - 1);
-            nPvs = std::min(pvs.size(), (size_t)10);
+    sendProbes();
+
+    // Partially filled packets wait for more searches in the next tick when out of budget
+    if (m_packetBudget.isAvailable() && m_byteBudget.isAvailable()) {
+        for (auto& group: m_groups) {
+            sendPacket(group);
         }
-        bin.splice(bin.begin(), pvs, pvs.begin(), std::next(pvs.begin(), nPvs));
     }
+    m_batch.flush(m_sock);
+    m_totalStats.deferred += m_nQueued;
+
+    if (m_totalStats.packets != totalStats.packets || m_totalStats.probes != totalStats.probes || m_nQueued > 0) {
+        m_tickStats.packets = m_totalStats.packets - totalStats.packets;
+        m_tickStats.bytes = m_totalStats.bytes - totalStats.bytes;
+        m_tickStats.searches = m_totalStats.searches - totalStats.searches;
+        m_tickStats.probes = m_totalStats.probes - totalStats.probes;
+        m_tickStats.deferred = m_nQueued;
+        LOG_DEBUG("Sent ", m_tickStats.packets, " search packets (", m_tickStats.bytes, " bytes) for ", m_tickStats.searches, " PVs, probed ", m_tickStats.probes, " PVs, deferred ", m_tickStats.deferred, " PVs");
+    }
+}
 
-    // Unlikely but possible scenario: if any PVs remain (due to rounding or skip logic),
-    // add them to the last bin
-    if (!pvs.empty()) {
-        m_searchedPvs.back().splice(m_searchedPvs.back().end(), pvs);
+void Searcher::processOutgoing()
+{
+    // Search at most once per tick
+    auto tick = currentTick();
+    if (tick > m_schedule.now()) {
+        search(tick);
     }
+    scheduleWakeup();
+}
 
-    m_currentBin = 0;
+void Searcher::scheduleWakeup()
+{
+    auto next = m_schedule.now() + TimerWheel::MAX_DELAY;
+    bool pending = (m_schedule.size() > 0);
+    if (pending) {
+        next = m_schedule.nextTick(next);
+    }
+    if (m_expedite) {
+        next = std::min(next, std::max(m_schedule.now() + 1, m_nextExpedite));
+        pending = true;
+    }
+    // Deferred searches and partially filled packets continue in the next tick
+    if (m_nQueued > 0 || m_packetBudget.isAvailable() == false || m_byteBudget.isAvailable() == false) {
+        next = m_schedule.now() + 1;
+        pending = true;
+    }
+    if (pending) {
+        wakeupAt(m_startTime + next * TICK);
+    }
+}
 
-    return std::make_pair(nPurged, nSearching);
+void Searcher::rebalance(uint32_t slot)
+{
+    // Balance the PVs over the longest interval evenly, allowing some ticks to be
+    // empty if the total number of PVs is small. Not optimal to send only a few PVs
+    // in a UDP packet, let's combine some PVs. Pick 10 as conservative number of how
+    // many PVs can fit in a single packet, but still significant improvement when
+    // there's only a few PVs per tick.
+    TimerWheel::Tick period = m_searchIntervals.back();
+    auto nTicks = std::max<size_t>(1, std::min<size_t>(period, m_schedule.size() / 10));
+    auto phase = (slot % nTicks) * period / nTicks;
+
+    // Tick with the PV's phase closest to when it's due
+    auto expires = m_schedule.getExpires(slot);
+    auto target = expires - (expires % period) + phase;
+    if (target > expires + period / 2) {
+        target -= period;
+    } else if (target + period / 2 < expires) {
+        target += period;
+    }
+    while (target <= m_schedule.now()) {
+        target += period;
+    }
+    if (target != expires) {
+        m_schedule.schedule(slot, target);
+    }
+}
+
+bool Searcher::purgeStep(unsigned maxtime, size_t maxSlots)
+{
+    auto deadline = std::chrono::steady_clock::now() - std::chrono::seconds(maxtime);
+    auto end = std::min<size_t>(m_searchedPvs.size(), m_purgeCursor + maxSlots);
+    for (; m_purgeCursor < end; m_purgeCursor++) {
+        auto slot = m_purgeCursor;
+        auto& pv = m_searchedPvs[slot];
+        if (pv.used == false) {
+            continue;
+        }
+        if (pv.lastSearched < deadline) {
+            LOG_VERBOSE("Purged ", pv.pvname, ", not requested for more than ", maxtime, " seconds");
+            releaseSlot(slot);
+            m_purgeCounts.first++;
+        } else {
+            m_purgeCounts.second++;
+            // Leave alone PVs in the initial searches, waiting to be sent or probed
+            if ((pv.interval + 1u) == m_searchIntervals.size() && pv.probeIp == 0 && m_schedule.isScheduled(slot)) {
+                rebalance(slot);
+            }
+        }
+    }
+
+    if (m_purgeCursor < m_searchedPvs.size()) {
+        return false;
+    }
+    m_purgeResult = m_purgeCounts;
+    m_purgeCounts = {0, 0};
+    m_purgeCursor = 0;
+    return true;
+}
+
+std::pair<uint32_t, uint32_t> Searcher::purgePVs(unsigned maxtime)
+{
+    while (purgeStep(maxtime, m_searchedPvs.size()) == false);
+    return m_purgeResult;
 }
@@ -6,13 +6,19 @@
 #pragma once
 
 #include "connection.hpp"
+#include "negcache.hpp"
 #include "proto.hpp"
+#include "timerwheel.hpp"
+#include "tokenbucket.hpp"
+#include "udpbatch.hpp"
 
 #include <chrono>
+#include <deque>
 #include <functional>
 #include <map>
 #include <memory>
-#include <list>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 /**
@@ -23,6 +29,34 @@
  * It implements an exponential backoff strategy (via configured intervals) to avoid
  * flooding the network. It manages a socket for both sending UDP broadcasts and
  * receiving search responses.
+ *
+ * A single search schedule is shared by all search addresses. Every search packet
+ * is sent to all of them, so the cost of a searched PV doesn't depend on the number
+ * of search addresses.
+ *
+ * Outgoing search traffic can be limited to a budget of packets and bytes per
+ * second. Searches that are due but exceed the budget wait in ready queues and
+ * go out in subsequent ticks, first searches of new PVs before retries.
+ *
+ * PVs whose IOC was known before, ie. IOC restarted, are first probed with
+ * a unicast search to the IOC's last address. Only if the IOC doesn't respond
+ * in a short time, the PV enters the regular search schedule.
+ *
+ * PVs that went through all search intervals without being found are
+ * remembered in a negative cache. When such PV is requested again, it
+ * skips the initial burst of searches and continues at the longest interval.
+ *
+ * Number of searched PVs can be limited. When the limit is reached, PVs that
+ * clients didn't ask for again since the last eviction round are dropped
+ * first, using the CLOCK algorithm over search slots.
+ *
+ * Stale PVs are purged incrementally, a limited number of slots at a time, so
+ * that purging a large search list doesn't stall processing of client requests.
+ *
+ * When a new IOC is detected, pending searches can be expedited. A limited
+ * number of PVs in backoff are pulled forward to be searched within a second,
+ * without changing their position in the backoff sequence. PVs at the longest
+ * interval are not expedited, to avoid a burst of searches for the whole list.
  */
 class Searcher : public Connection {
     public:
@@ -31,49 +65,241 @@ class Searcher : public Connection {
          * @param pvname The name of the PV found.
          * @param iocIp The IP address of the responding IOC.
          * @param iocPort The port of the responding IOC.
+         * @param udpPort The UDP port the IOC responded from, where it accepts searches.
          * @param response The raw response packet containing additional metadata.
          */
-        typedef std::function<void(const std::string& pvname, const std::string& iocIp, uint16_t iocPort, const Protocol::Bytes& response)> PvFoundCb;
+        typedef std::function<void(const std::string& pvname, const std::string& iocIp, uint16_t iocPort, uint16_t udpPort, const Protocol::Bytes& response)> PvFoundCb;
+
+        /**
+         * @struct Stats
+         * @brief Amount of search traffic produced.
+         */
+        struct Stats {
+            uint64_t packets = 0;   ///< Number of UDP packets sent to search addresses.
+            uint64_t bytes = 0;     ///< Number of UDP payload bytes sent to search addresses.
+            uint64_t searches = 0;  ///< Number of individual PV searches sent to search addresses.
+            uint64_t probes = 0;    ///< Number of unicast searches sent to last known IOCs.
+            uint64_t deferred = 0;  ///< Number of due searches postponed to the next tick due to search budget.
+        };
+
+        /**
+         * @struct SearchAddress
+         * @brief Destination where search requests are sent to.
+         */
+        struct SearchAddress {
+            std::string ip;     ///< Broadcast or unicast IP address.
+            uint16_t port;      ///< Destination UDP port.
+            unsigned mtu;       ///< MTU of the network, search packets are filled up to it.
+        };
+
+        /**
+         * @brief Size of IPv4 and UDP headers, subtracted from MTU to get the max packet size.
+         */
+        static constexpr unsigned UDP_OVERHEAD = 28;
 
     protected:
         /**
          * @struct SearchedPV
          * @brief Internal tracking structure for a PV being searched.
+         *
+         * Records are stored in slots that are reused once the PV is found or
+         * purged. The slot index is part of the channel ID and also identifies
+         * the PV's timer in the search schedule.
          */
         struct SearchedPV {
-            uint32_t chanId;                    ///< Unique channel ID assigned for the search session.
             std::string pvname;                 ///< Name of the PV.
+            uint32_t chanId;                    ///< Unique channel ID assigned for the search session.
+            uint16_t interval = 0;              ///< Index into m_searchIntervals of the next search delay.
+            bool used = false;                  ///< Slot is assigned to a searched PV.
+            bool queued = false;                ///< PV is due and waits in one of the ready queues.
+            bool probeSent = false;             ///< Probe was sent, PV waits for the probe timeout.
+            bool referenced = false;            ///< PV was requested again since the eviction hand passed it.
+            uint16_t probePort = 0;             ///< UDP port of the IOC to probe, network byte order.
+            uint32_t probeIp = 0;               ///< IP address of the IOC to probe, network byte order, 0 when not probing.
             std::chrono::steady_clock::time_point lastSearched; ///< Timestamp of the last search/allocation.
-            std::vector<uint32_t> intervals;    ///< Remaining backoff intervals key.
         };
 
-        std::vector<uint32_t> m_searchIntervals; ///< Configured backoff intervals.
-        uint32_t m_chanId = 0;                   ///< Counter for generating unique Channel IDs.
+        /**
+         * Index of all searched PVs by name. Keys point to the pvname of the slot
+         * and are valid for as long as the slot is used, std::deque never relocates
+         * its elements when growing.
+         */
+        typedef std::unordered_map<std::string_view, uint32_t> PvIndex;
+
+        /**
+         * Channel IDs consist of a slot index in the lower bits and the slot's
+         * generation in the upper bits. Generation is incremented every time the
+         * slot is released, so replies for a channel ID that was already recycled
+         * don't match any more.
+         */
+        static constexpr unsigned CHANID_SLOT_BITS = 24;
+        static constexpr uint32_t CHANID_SLOT_MASK = (1u << CHANID_SLOT_BITS) - 1;
+
+        /**
+         * Length of a single tick of the search schedule.
+         */
+        static constexpr std::chrono::milliseconds TICK{100};
+
+        /**
+         * Number of ticks to wait for the response to a probe before broadcasting.
+         */
+        static constexpr TimerWheel::Tick PROBE_TIMEOUT = 5;
+
+        /**
+         * Max number of PVs pulled forward by a single expedite, and the number
+         * of ticks they're spread over.
+         */
+        static constexpr size_t MAX_EXPEDITED = 1000;
+        static constexpr size_t EXPEDITE_TICKS = 10;
+
+        std::vector<uint32_t> m_searchIntervals; ///< Configured backoff intervals, in ticks.
         std::shared_ptr<Protocol> m_protocol;    ///< Protocol handler (CA/PVA).
-        std::vector<std::list<SearchedPV>> m_searchedPvs; ///< Bins of PVs scheduled for future searches.
-        size_t m_currentBin = 0;                 ///< Current bin index being processed.
-        std::chrono::steady_clock::time_point m_lastSearch; ///< Timestamp of the last outgoing broadcast.
+        std::deque<SearchedPV> m_searchedPvs;    ///< Slots of PVs being searched for.
+        std::deque<uint32_t> m_freeSlots;        ///< Released slots, reused in FIFO order.
+        PvIndex m_pvIndex;                       ///< Name lookup into slots for O(1) add/remove.
+        TimerWheel m_schedule;                   ///< Next search time of every PV, by slot.
+        std::chrono::steady_clock::time_point m_startTime; ///< Time of the schedule's tick 0.
         PvFoundCb m_foundPvCb;                   ///< User callback for found PVs.
-        std::string m_searchIp;                  ///< Broadcast IP address.
-        uint16_t m_searchPort;                   ///< Broadcast port.
+        /**
+         * @struct PacketGroup
+         * @brief Search addresses sharing the same MTU also share the same packets.
+         */
+        struct PacketGroup {
+            size_t maxPacketSize;                ///< Max UDP payload size, derived from MTU.
+            Protocol::Bytes packet;              ///< Reusable buffer for the search packet being built.
+            std::string packetPvs;               ///< Names of PVs in the packet being built, for logging only.
+            std::vector<sockaddr_in> addrs;      ///< Destinations of the packets.
+            std::vector<SearchAddress> addresses; ///< Destinations of the packets, for logging.
+        };
+
+        std::vector<PacketGroup> m_groups;       ///< Search destinations grouped by MTU.
+        UdpBatch m_batch;                        ///< Batched receiving of replies and sending of searches.
+        TokenBucket m_packetBudget;              ///< Limits the rate of search packets sent.
+        TokenBucket m_byteBudget;                ///< Limits the rate of search bytes sent.
+        std::deque<uint32_t> m_firstSearches;    ///< Due PVs never searched before, sent with priority.
+        std::deque<uint32_t> m_retries;          ///< Due PVs being searched again.
+        size_t m_nQueued = 0;                    ///< Number of PVs waiting in ready queues.
+        std::vector<uint32_t> m_probes;          ///< Slots of PVs to be probed in the current tick.
+        Protocol::Bytes m_probePacket;           ///< Reusable buffer for probe packets.
+        size_t m_maxProbeSize;                   ///< Max size of probe packets, fits all search networks.
+        bool m_expedite = false;                 ///< Pending searches should be pulled forward.
+        TimerWheel::Tick m_expediteHoldoff = 0;  ///< Minimum number of ticks between expedited searches.
+        TimerWheel::Tick m_nextExpedite = 0;     ///< Earliest tick for the next expedited searches.
+        uint32_t m_expediteHand = 0;             ///< Next slot considered for expediting.
+        NegativeCache m_negativeCache;           ///< Names that weren't found in a full search schedule.
+        size_t m_maxPvs = 0;                     ///< Max number of searched PVs, 0 for unlimited.
+        uint32_t m_clockHand = 0;                ///< Next slot considered for eviction.
+        uint64_t m_nEvicted = 0;                 ///< Number of PVs dropped to make space since start.
+        uint32_t m_purgeCursor = 0;              ///< Next slot to be checked by the purge pass in progress.
+        std::pair<uint32_t, uint32_t> m_purgeCounts; ///< Purged and remaining PVs of the pass in progress.
+        std::pair<uint32_t, uint32_t> m_purgeResult; ///< Purged and remaining PVs of the last completed pass.
+        Stats m_tickStats;                       ///< Search traffic produced in the last tick with any searches.
+        Stats m_totalStats;                      ///< Search traffic produced since start.
+
+        /**
+         * @brief Assigns a slot with a unique Channel ID to a new searched PV.
+         *
+         * Released slots are reused in FIFO order to maximize the time before
+         * the same slot gets assigned again.
+         *
+         * @return Slot index, TimerWheel::NONE if the channel ID space is exhausted.
+         */
+        uint32_t allocSlot();
+
+        /**
+         * @brief Removes the PV from the index and schedule and releases its slot.
+         *
+         * Further replies for the PV's channel ID will be ignored.
+         *
+         * @param slot Slot index previously returned by allocSlot().
+         */
+        void releaseSlot(uint32_t slot);
+
+        /**
+         * @brief Finds the searched PV by the Channel ID from the search reply.
+         * @param chanId Channel ID as returned by the IOC.
+         * @return Pointer to the searched PV, or nullptr when unknown or stale.
+         */
+        SearchedPV* findChanId(uint32_t chanId);
+
+        /**
+         * @brief Returns the schedule tick corresponding to current time.
+         */
+        TimerWheel::Tick currentTick() const;
+
+        /**
+         * @brief Appends a search for the PV to the packets being built.
+         *
+         * When a packet is full, it's sent out and a new one is started in
+         * the same buffer.
+         */
+        void addToPacket(const SearchedPV& pv);
+
+        /**
+         * @brief Sends the group's packet to all its destinations, if it contains any searches.
+         */
+        void sendPacket(PacketGroup& group);
+
+        /**
+         * @brief Requests a wakeup for the next tick with any work to do.
+         *
+         * Idle searcher doesn't wake up at all, one with only pending retries
+         * sleeps until the first of them is due.
+         */
+        void scheduleWakeup();
+
+        /**
+         * @brief Sends unicast searches for all PVs in m_probes.
+         *
+         * Probes to the same IOC are packed into as few packets as possible.
+         */
+        void sendProbes();
+
+        /**
+         * @brief Reschedules up to MAX_EXPEDITED pending PVs to be searched in the next few ticks.
+         *
+         * Searches are spread evenly over a second. PVs already due sooner,
+         * at the longest interval or waiting for a probe are left alone.
+         */
+        void pullForward();
+
+        /**
+         * @brief Moves the PV's next search to balance searches at the longest interval.
+         *
+         * PVs at the longest interval are spread evenly over the interval, based
+         * on their slot. Search is moved by at most half of the interval from
+         * the time it was due, ticks in the past are skipped by a full interval.
+         * PV remains at the same position in the backoff sequence.
+         *
+         * @param slot Slot of a scheduled PV at the longest interval.
+         */
+        void rebalance(uint32_t slot);
 
         /**
-         * @brief Generates a unique Channel ID for a new search.
-         * @return A unique 32-bit integer.
+         * @brief Stops searching for a PV that wasn't requested recently, to make space for a new one.
          */
-        uint32_t getNextChanId();
+        void evict();
+
+        /**
+         * @brief Moves PVs due up to the given tick to ready queues and searches for as many as the budget allows.
+         *
+         * Searched PVs are rescheduled according to the search intervals, the
+         * rest remain in ready queues for the next tick.
+         *
+         * @param tick Schedule tick to advance to.
+         */
+        void search(TimerWheel::Tick tick);
 
     public:
         /**
          * @brief Constructs a Searcher.
          * 
-         * @param ip Broadcast IP address (e.g., "192.168.1.255").
-         * @param port Broadcast port.
-         * @param searchIntervals List of intervals (in arbitrary units, often ~10Hz steps) for backoff.
+         * @param addresses Destinations of search requests (e.g., "192.168.1.255":5064).
+         * @param searchIntervals List of intervals (in seconds) for backoff.
          * @param protocol Shared pointer to the protocol implementation.
          * @param foundPvCb Callback for when a PV is found.
          */
-        Searcher(const std::string& ip, uint16_t port, const std::vector<uint32_t>& searchIntervals, const std::shared_ptr<Protocol>& protocol, PvFoundCb& foundPvCb);
+        Searcher(const std::vector<SearchAddress>& addresses, const std::vector<uint32_t>& searchIntervals, const std::shared_ptr<Protocol>& protocol, PvFoundCb& foundPvCb);
 
         /**
          * @brief Adds a PV to the search list.
@@ -83,12 +309,104 @@ class Searcher : public Connection {
          */
         bool addPV(const std::string& pvname);
 
+        /**
+         * @brief Adds a PV to the search list, probing its last known IOC first.
+         *
+         * The first search is sent only to the given IOC. If it doesn't respond
+         * within PROBE_TIMEOUT ticks, PV is searched for at search addresses.
+         *
+         * @param pvname Name of the PV to find.
+         * @param iocIp IP address of the IOC that had the PV before.
+         * @param udpPort UDP port where the IOC accepted searches.
+         * @return bool True if the PV was added, False if it was already being searched.
+         */
+        bool addPV(const std::string& pvname, const std::string& iocIp, uint16_t udpPort);
+
         /**
          * @brief Removes a PV from the search list.
          * @param pvname Name of the PV to stop searching for.
          */
         void removePV(const std::string& pvname);
 
+        /**
+         * @brief Limits the rate of outgoing search traffic.
+         *
+         * Bursts are allowed up to the budget of a single tick, the rest of due
+         * searches is spread over subsequent ticks.
+         *
+         * @param packetsPerSec Max number of search packets per second, 0 for unlimited.
+         * @param bytesPerSec Max number of search payload bytes per second, 0 for unlimited.
+         */
+        void setRateLimit(unsigned long packetsPerSec, unsigned long bytesPerSec);
+
+        /**
+         * @brief Requests all pending PVs to be searched for soon.
+         *
+         * Typically invoked when a new IOC appears on the network. Requests are
+         * coalesced, pending PVs are pulled forward at most once per holdoff
+         * period. PVs keep their backoff intervals.
+         */
+        void expedite() { m_expedite = true; scheduleWakeup(); }
+
+        /**
+         * @brief Sets minimum time between two expedited searches.
+         * @param holdoff Holdoff period in seconds.
+         */
+        void setExpediteHoldoff(unsigned holdoff);
+
+        /**
+         * @brief Enables remembering PVs that were not found in a full search schedule.
+         *
+         * @param capacity Max number of exactly remembered PV names, 0 disables the cache.
+         * @param ttl Time in seconds to remember PV names.
+         */
+        void setNegativeCache(size_t capacity, unsigned ttl);
+
+        /**
+         * @brief Limits the number of PVs being searched for.
+         *
+         * When the limit is reached, adding a new PV stops searching for
+         * another PV that wasn't requested again recently.
+         *
+         * @param maxPvs Max number of searched PVs, 0 for unlimited.
+         */
+        void setCapacity(size_t maxPvs) { m_maxPvs = maxPvs; }
+
+        /**
+         * @brief Returns number of PVs dropped from the search list to make space since start.
+         */
+        uint64_t getEvictions() const { return m_nEvicted; }
+
+        /**
+         * @brief Returns the negative cache, for statistics.
+         */
+        const NegativeCache& getNegativeCache() const { return m_negativeCache; }
+
+        /**
+         * @brief Returns number of PVs due for a search but deferred due to the search budget.
+         */
+        size_t getBacklog() const { return m_nQueued; }
+
+        /**
+         * @brief Returns number of PVs currently being searched for.
+         */
+        size_t size() const { return m_pvIndex.size(); }
+
+        /**
+         * @brief Checks whether the PV is being searched for.
+         */
+        bool isSearched(const std::string& pvname) const { return (m_pvIndex.find(pvname) != m_pvIndex.end()); }
+
+        /**
+         * @brief Returns search traffic produced in the last tick that had any searches.
+         */
+        const Stats& getTickStats() const { return m_tickStats; }
+
+        /**
+         * @brief Returns search traffic produced since start.
+         */
+        const Stats& getTotalStats() const { return m_totalStats; }
+
         /**
          * @brief Processes incoming UDP packets.
          * 
@@ -100,20 +418,40 @@ class Searcher : public Connection {
         /**
          * @brief Processes outgoing UDP broadcasts.
          * 
-         * Iterates through the current bin of PVs, sends search requests,
-         * and schedules them for the next interval bin.
+         * Advances the search schedule to current time, sends search requests
+         * for all PVs that are due and schedules their next search. All search
+         * packets are flushed to the network at the end, then the wakeup for
+         * the next due search is requested.
          */
         void processOutgoing();
 
         /**
-         * @brief Purges stale PVs from the search list.
-         * 
+         * @brief Purges stale PVs from a part of the search list.
+         *
          * Removes PVs that haven't been "touched" or re-added by a client
          * within the specified time, effectively implementing a timeout mechanism
-         * for unreferenced PVs.
-         * 
+         * for unreferenced PVs. PVs at the longest search interval are also
+         * rebalanced. Each call continues the pass where the previous one
+         * stopped and checks at most maxSlots slots.
+         *
+         * @param maxtime Maximum duration (in seconds) to keep a searched PV active.
+         * @param maxSlots Maximum number of slots to check in this call.
+         * @return True when the pass over the search list completed, see getPurgeResult().
+         */
+        bool purgeStep(unsigned maxtime, size_t maxSlots);
+
+        /**
+         * @brief Purges stale PVs from the whole search list at once.
+         *
+         * Completes the pass in progress, if any.
+         *
          * @param maxtime Maximum duration (in seconds) to keep a searched PV active.
          * @return std::pair<uint32_t, uint32_t> Pair of (Purged Count, Remaining Count).
          */
         std::pair<uint32_t, uint32_t> purgePVs(unsigned maxtime);
+
+        /**
+         * @brief Returns (Purged Count, Remaining Count) of the last completed purge pass.
+         */
+        const std::pair<uint32_t, uint32_t>& getPurgeResult() const { return m_purgeResult; }
 };
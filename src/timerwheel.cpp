@@ -0,0 +1,98 @@
+#include "timerwheel.hpp"
+
+TimerWheel::TimerWheel()
+{
+    m_heads.fill(NONE);
+    m_occupied.fill(0);
+}
+
+void TimerWheel::schedule(uint32_t id, Tick expires)
+{
+    if (id >= m_nodes.size()) {
+        m_nodes.resize(id + 1);
+    }
+    if (m_nodes[id].slot != NONE) {
+        unlink(id);
+    }
+
+    if (expires <= m_now) {
+        expires = m_now + 1;
+    } else if ((expires - m_now) > MAX_DELAY) {
+        expires = m_now + MAX_DELAY;
+    }
+    m_nodes[id].expires = expires;
+    link(id);
+}
+
+void TimerWheel::cancel(uint32_t id)
+{
+    if (isScheduled(id)) {
+        unlink(id);
+    }
+}
+
+void TimerWheel::link(uint32_t id)
+{
+    auto& node = m_nodes[id];
+    auto delta = node.expires - m_now;
+
+    unsigned level = 0;
+    while (level < (LEVELS - 1) && delta >= (Tick(1) << (SLOT_BITS * (level + 1)))) {
+        level++;
+    }
+    auto idx = static_cast<unsigned>((node.expires >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+    node.slot = level * SLOTS + idx;
+    node.prev = NONE;
+    node.next = m_heads[node.slot];
+    if (node.next != NONE) {
+        m_nodes[node.next].prev = id;
+    }
+    m_heads[node.slot] = id;
+    m_occupied[level] |= (uint64_t(1) << idx);
+    m_size++;
+}
+
+void TimerWheel::unlink(uint32_t id)
+{
+    auto& node = m_nodes[id];
+    if (node.prev != NONE) {
+        m_nodes[node.prev].next = node.next;
+    } else {
+        m_heads[node.slot] = node.next;
+        if (node.next == NONE) {
+            m_occupied[node.slot / SLOTS] &= ~(uint64_t(1) << (node.slot % SLOTS));
+        }
+    }
+    if (node.next != NONE) {
+        m_nodes[node.next].prev = node.prev;
+    }
+    node.next = NONE;
+    node.prev = NONE;
+    node.slot = NONE;
+    m_size--;
+}
+
+void TimerWheel::cascade(unsigned level, unsigned idx)
+{
+    auto& head = m_heads[level * SLOTS + idx];
+    while (head != NONE) {
+        auto id = head;
+        unlink(id);
+        link(id);
+    }
+}
+
+TimerWheel::Tick TimerWheel::nextTick(Tick limit) const
+{
+    // Next cascading boundary, level 0 slots past it belong to the next round
+    Tick next = (m_now | (SLOTS - 1)) + 1;
+
+    auto idx = static_cast<unsigned>(m_now & (SLOTS - 1));
+    auto pending = (idx == (SLOTS - 1) ? 0 : (m_occupied[0] >> (idx + 1)));
+    if (pending != 0) {
+        next = m_now + 1 + static_cast<Tick>(__builtin_ctzll(pending));
+    }
+
+    return (next < limit ? next : limit);
+}
@@ -0,0 +1,162 @@
+/**
+ * @file timerwheel.hpp
+ * @brief Hierarchical timing wheel for scheduling many timers cheaply.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @class TimerWheel
+ * @brief Schedules timers identified by small integer ids on a hierarchical wheel.
+ *
+ * Time is measured in abstract ticks. The wheel consists of several levels,
+ * each having 64 slots. Level 0 slots are one tick apart, each next level
+ * covers 64 times longer period. Timers are kept in intrusive doubly linked
+ * lists per slot, so scheduling and cancelling is O(1) regardless of the number
+ * of timers or how far in the future they expire. Timers from higher levels
+ * are cascaded to lower levels as the time approaches.
+ *
+ * Per slot occupancy bitmaps allow to skip empty slots when advancing time,
+ * so empty ticks don't cost anything.
+ *
+ * Timer ids are expected to be dense, like indexes into caller's storage. The
+ * wheel grows its internal storage to accommodate the largest id.
+ */
+class TimerWheel {
+    public:
+        typedef uint64_t Tick;
+        static constexpr uint32_t NONE = UINT32_MAX;
+
+    private:
+        static constexpr unsigned SLOT_BITS = 6;
+        static constexpr unsigned SLOTS = (1u << SLOT_BITS);
+        static constexpr unsigned LEVELS = 4;
+
+        /**
+         * @struct Node
+         * @brief Scheduling information of a single timer.
+         */
+        struct Node {
+            uint32_t next = NONE;   ///< Next timer in the same slot.
+            uint32_t prev = NONE;   ///< Previous timer in the same slot, NONE when first.
+            uint32_t slot = NONE;   ///< Slot index across all levels, NONE when not scheduled.
+            Tick expires = 0;       ///< Absolute tick when the timer expires.
+        };
+
+        std::vector<Node> m_nodes;                      ///< Timers indexed by id.
+        std::array<uint32_t, LEVELS * SLOTS> m_heads;   ///< First timer in each slot.
+        std::array<uint64_t, LEVELS> m_occupied;        ///< Bitmap of non-empty slots per level.
+        Tick m_now = 0;                                 ///< Last processed tick.
+        size_t m_size = 0;                              ///< Number of scheduled timers.
+
+        /**
+         * @brief Puts the timer in the slot determined by its expiration time.
+         */
+        void link(uint32_t id);
+
+        /**
+         * @brief Removes the timer from its slot.
+         */
+        void unlink(uint32_t id);
+
+        /**
+         * @brief Moves all timers from the given slot to lower levels.
+         */
+        void cascade(unsigned level, unsigned idx);
+
+    public:
+        /**
+         * @brief Largest supported delay from now, longer delays are clamped.
+         */
+        static constexpr Tick MAX_DELAY = (Tick(1) << (SLOT_BITS * LEVELS)) - 1;
+
+        TimerWheel();
+
+        /**
+         * @brief Schedules timer to expire at the given tick.
+         *
+         * Previously scheduled timer with the same id is rescheduled. Timers can't
+         * expire in the past, expiration is adjusted to the next tick if needed.
+         *
+         * @param id Timer identifier.
+         * @param expires Absolute tick when the timer should expire.
+         */
+        void schedule(uint32_t id, Tick expires);
+
+        /**
+         * @brief Cancels the timer, does nothing if the timer is not scheduled.
+         * @param id Timer identifier.
+         */
+        void cancel(uint32_t id);
+
+        /**
+         * @brief Checks whether the timer is scheduled.
+         */
+        bool isScheduled(uint32_t id) const { return (id < m_nodes.size() && m_nodes[id].slot != NONE); }
+
+        /**
+         * @brief Returns the tick when the timer expires, only valid when scheduled.
+         */
+        Tick getExpires(uint32_t id) const { return m_nodes[id].expires; }
+
+        /**
+         * @brief Returns the last processed tick.
+         */
+        Tick now() const { return m_now; }
+
+        /**
+         * @brief Returns the number of scheduled timers.
+         */
+        size_t size() const { return m_size; }
+
+        /**
+         * @brief Determines next tick that may have work to do.
+         *
+         * That's either next non-empty level 0 slot or next cascading boundary,
+         * whichever comes first, but not further than the limit. Callers can
+         * sleep until then without missing any timer.
+         */
+        Tick nextTick(Tick limit) const;
+
+        /**
+         * @brief Advances time and invokes the callback for every expired timer.
+         *
+         * Timers are no longer scheduled when the callback is invoked, the callback
+         * is free to schedule the same or any other timer again.
+         *
+         * @param tick New current tick, must not be in the past.
+         * @param expired Callback invoked with the id of each expired timer.
+         */
+        template <typename F>
+        void advance(Tick tick, F&& expired)
+        {
+            while (m_now < tick) {
+                m_now = nextTick(tick);
+
+                if ((m_now & (SLOTS - 1)) == 0) {
+                    // Find the highest level that starts a new round and cascade
+                    // from there down, so that timers can drop multiple levels
+                    unsigned level = 1;
+                    while (level < (LEVELS - 1) && ((m_now >> (SLOT_BITS * level)) & (SLOTS - 1)) == 0) {
+                        level++;
+                    }
+                    for (; level > 0; level--) {
+                        cascade(level, (m_now >> (SLOT_BITS * level)) & (SLOTS - 1));
+                    }
+                }
+
+                // Callback can only schedule timers into the future, never into current slot
+                auto& head = m_heads[m_now & (SLOTS - 1)];
+                while (head != NONE) {
+                    auto id = head;
+                    unlink(id);
+                    expired(id);
+                }
+            }
+        }
+};
@@ -0,0 +1,20 @@
+#include "tokenbucket.hpp"
+
+#include <algorithm>
+
+TokenBucket::TokenBucket(double rate, double burst)
+    : m_rate(rate)
+    , m_burst(burst)
+    , m_tokens(burst)
+    , m_lastRefill(std::chrono::steady_clock::now())
+{
+}
+
+void TokenBucket::refill(std::chrono::steady_clock::time_point now)
+{
+    if (m_rate > 0 && now > m_lastRefill) {
+        std::chrono::duration<double> elapsed = now - m_lastRefill;
+        m_tokens = std::min(m_burst, m_tokens + elapsed.count() * m_rate);
+    }
+    m_lastRefill = now;
+}
@@ -0,0 +1,69 @@
+/**
+ * @file tokenbucket.hpp
+ * @brief Rate limiting with a token bucket.
+ */
+
+#pragma once
+
+#include <chrono>
+
+/**
+ * @class TokenBucket
+ * @brief Limits the average rate of some resource usage, ie. packets or bytes sent.
+ *
+ * Tokens are added to the bucket at a configured rate, up to the burst size.
+ * Consumers may take tokens while there are any available. The bucket is allowed
+ * to go into debt by the last consumption, which is repaid before any new tokens
+ * become available. That allows to meter variable size items like packets after
+ * they were built, while still keeping the long term average rate.
+ *
+ * Bucket with rate 0 is unlimited.
+ */
+class TokenBucket {
+    private:
+        double m_rate = 0;      ///< Tokens added per second, 0 means unlimited.
+        double m_burst = 0;     ///< Maximum number of tokens in the bucket.
+        double m_tokens = 0;    ///< Currently available tokens, negative when in debt.
+        std::chrono::steady_clock::time_point m_lastRefill;
+
+    public:
+        /**
+         * @brief Constructs a bucket, initially full.
+         *
+         * @param rate Number of tokens added per second, 0 for unlimited.
+         * @param burst Maximum number of tokens in the bucket.
+         */
+        TokenBucket(double rate = 0, double burst = 0);
+
+        /**
+         * @brief Adds tokens accumulated since the last refill.
+         * @param now Current time.
+         */
+        void refill(std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now());
+
+        /**
+         * @brief Checks whether the bucket limits the rate at all.
+         */
+        bool isLimited() const { return (m_rate > 0); }
+
+        /**
+         * @brief Checks whether any tokens are available.
+         */
+        bool isAvailable() const { return (m_rate <= 0 || m_tokens > 0); }
+
+        /**
+         * @brief Takes tokens out of the bucket, possibly going into debt.
+         * @param n Number of tokens to take.
+         */
+        void consume(double n) { m_tokens -= (m_rate > 0 ? n : 0); }
+
+        /**
+         * @brief Returns time until tokens become available, 0 when they are.
+         */
+        std::chrono::duration<double> getWaitTime() const { return std::chrono::duration<double>(isAvailable() ? 0.0 : -m_tokens / m_rate); }
+
+        /**
+         * @brief Returns currently available tokens, negative when in debt.
+         */
+        double getTokens() const { return m_tokens; }
+};
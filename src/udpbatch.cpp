@@ -0,0 +1,163 @@
+#include "logging.hpp"
+#include "udpbatch.hpp"
+
+#ifdef __linux__
+#include "iouring.hpp"
+#endif
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+size_t UdpBatch::s_batchSize = 32;
+thread_local IoUring* UdpBatch::s_ring = nullptr;
+thread_local int UdpBatch::s_deliveredSock = -1;
+thread_local const std::vector<UdpBatch::Datagram>* UdpBatch::s_delivered = nullptr;
+#else
+size_t UdpBatch::s_batchSize = 1;
+#endif
+
+UdpBatch::UdpBatch(size_t rxBufferSize, size_t txBufferSize)
+    : m_batchSize(s_batchSize > 1 ? s_batchSize : 1)
+    , m_rxBufferSize(rxBufferSize)
+    , m_txBufferSize(txBufferSize)
+{
+    m_rxBuffers.resize(m_batchSize * m_rxBufferSize);
+    m_rxIovs.resize(m_batchSize);
+    m_rxAddrs.resize(m_batchSize);
+    for (size_t i = 0; i < m_batchSize; i++) {
+        m_rxIovs[i].iov_base = m_rxBuffers.data() + i * m_rxBufferSize;
+        m_rxIovs[i].iov_len = m_rxBufferSize;
+    }
+
+#ifdef __linux__
+    if (m_batchSize > 1) {
+        m_txBuffers.resize(m_batchSize * m_txBufferSize);
+        m_txIovs.resize(m_batchSize);
+        m_txAddrs.resize(m_batchSize);
+        m_rxMsgs.resize(m_batchSize);
+        m_txMsgs.resize(m_batchSize);
+        for (size_t i = 0; i < m_batchSize; i++) {
+            m_txIovs[i].iov_base = m_txBuffers.data() + i * m_txBufferSize;
+
+            m_rxMsgs[i].msg_hdr = {};
+            m_rxMsgs[i].msg_hdr.msg_iov = &m_rxIovs[i];
+            m_rxMsgs[i].msg_hdr.msg_iovlen = 1;
+            m_rxMsgs[i].msg_hdr.msg_name = &m_rxAddrs[i];
+
+            m_txMsgs[i].msg_hdr = {};
+            m_txMsgs[i].msg_hdr.msg_iov = &m_txIovs[i];
+            m_txMsgs[i].msg_hdr.msg_iovlen = 1;
+            m_txMsgs[i].msg_hdr.msg_name = &m_txAddrs[i];
+            m_txMsgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+    }
+#endif
+}
+
+void UdpBatch::receive(int sock, const ReceiveCb& cb)
+{
+#ifdef __linux__
+    if (s_delivered && sock == s_deliveredSock) {
+        // Truncated like when read into our own buffers
+        for (auto& datagram: *s_delivered) {
+            cb(datagram.data, std::min(datagram.len, m_rxBufferSize), datagram.remoteAddr);
+        }
+        return;
+    }
+
+    if (m_batchSize > 1) {
+        while (true) {
+            for (auto& msg: m_rxMsgs) {
+                msg.msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            }
+            auto n = ::recvmmsg(sock, m_rxMsgs.data(), static_cast<unsigned>(m_batchSize), MSG_DONTWAIT, nullptr);
+            if (n < 0 && isTransientError(errno)) {
+                continue;
+            }
+            if (n <= 0) {
+                break;
+            }
+            for (int i = 0; i < n; i++) {
+                auto data = static_cast<const unsigned char*>(m_rxIovs[i].iov_base);
+                cb(data, m_rxMsgs[i].msg_len, m_rxAddrs[i]);
+            }
+        }
+        return;
+    }
+#endif
+
+    auto buffer = m_rxBuffers.data();
+    struct sockaddr_in remoteAddr;
+    socklen_t remoteAddrLen = sizeof(remoteAddr);
+    auto recvd = ::recvfrom(sock, buffer, m_rxBufferSize, 0, reinterpret_cast<sockaddr *>(&remoteAddr), &remoteAddrLen);
+    while (recvd > 0 || (recvd < 0 && isTransientError(errno))) {
+        if (recvd > 0) {
+            cb(buffer, static_cast<size_t>(recvd), remoteAddr);
+        }
+        remoteAddrLen = sizeof(remoteAddr);
+        recvd = ::recvfrom(sock, buffer, m_rxBufferSize, 0, reinterpret_cast<sockaddr *>(&remoteAddr), &remoteAddrLen);
+    }
+}
+
+bool UdpBatch::isTransientError(int err)
+{
+    // ICMP errors from previously sent packets are reported once, packets behind them are still queued
+    return (err == ECONNREFUSED || err == EHOSTUNREACH || err == ENETUNREACH || err == EINTR);
+}
+
+void UdpBatch::logSendError(const sockaddr_in& remoteAddr)
+{
+    // Also called from listener threads, no name resolution here
+    auto err = errno;
+    char ip[INET_ADDRSTRLEN];
+    ::inet_ntop(AF_INET, &remoteAddr.sin_addr, ip, sizeof(ip));
+    LOG_ERROR("Failed to send UDP packet to ", ip, ":", ::ntohs(remoteAddr.sin_port), " - ", strerror(err));
+}
+
+void UdpBatch::send(int sock, const void* data, size_t len, const sockaddr_in& remoteAddr)
+{
+#ifdef __linux__
+    // Ring is full when the kernel falls behind, send it ourselves then
+    if (s_ring && s_ring->sendMsg(sock, data, len, remoteAddr)) {
+        return;
+    }
+#endif
+
+    if (m_batchSize <= 1 || len > m_txBufferSize) {
+        if (::sendto(sock, data, len, 0, reinterpret_cast<const sockaddr *>(&remoteAddr), sizeof(sockaddr_in)) < 0) {
+            logSendError(remoteAddr);
+        }
+        return;
+    }
+
+#ifdef __linux__
+    ::memcpy(m_txIovs[m_txCount].iov_base, data, len);
+    m_txIovs[m_txCount].iov_len = len;
+    m_txAddrs[m_txCount] = remoteAddr;
+    if (++m_txCount == m_batchSize) {
+        flush(sock);
+    }
+#endif
+}
+
+void UdpBatch::flush([[maybe_unused]] int sock)
+{
+#ifdef __linux__
+    size_t sent = 0;
+    while (sent < m_txCount) {
+        auto n = ::sendmmsg(sock, m_txMsgs.data() + sent, static_cast<unsigned>(m_txCount - sent), 0);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            // Error is about the first datagram, the rest may go to other destinations
+            logSendError(m_txAddrs[sent]);
+            n = 1;
+        }
+        sent += n;
+    }
+    m_txCount = 0;
+#endif
+}
@@ -0,0 +1,157 @@
+/**
+ * @file udpbatch.hpp
+ * @brief Batched sending and receiving of UDP datagrams.
+ */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+#ifdef __linux__
+class IoUring;
+#endif
+
+/**
+ * @class UdpBatch
+ * @brief Reduces the number of syscalls needed to process UDP datagrams.
+ *
+ * Incoming datagrams are drained from the socket with recvmmsg() into a ring
+ * of preallocated buffers, many datagrams per syscall. Outgoing datagrams are
+ * queued in another ring of buffers and sent out with sendmmsg() when flushed,
+ * typically once per loop iteration, or when the ring fills up.
+ *
+ * Batching can be disabled globally, in which case every datagram is received
+ * with recvfrom() and sent with sendto() right away. This is also the only mode
+ * on systems without recvmmsg()/sendmmsg().
+ *
+ * When the ConnectionsManager uses io_uring, the syscalls are avoided entirely
+ * in its thread. Datagrams are received by the kernel into the ring's buffers
+ * and delivered to receive(), and sent datagrams are queued in the ring. Both
+ * are handed over with the manager's single io_uring_enter() per iteration.
+ */
+class UdpBatch {
+    public:
+        /**
+         * @brief Callback invoked for every received datagram.
+         * @param data Pointer to the datagram, only valid during the callback.
+         * @param len Length of the datagram.
+         * @param remoteAddr Sender of the datagram.
+         */
+        typedef std::function<void(const unsigned char* data, size_t len, const sockaddr_in& remoteAddr)> ReceiveCb;
+
+        /**
+         * @brief Datagram received on behalf of the UdpBatch.
+         */
+        struct Datagram {
+            const unsigned char* data;
+            size_t len;
+            sockaddr_in remoteAddr;
+        };
+
+    private:
+        static size_t s_batchSize;
+#ifdef __linux__
+        static thread_local IoUring* s_ring;                            ///< Sends go through it when set.
+        static thread_local int s_deliveredSock;
+        static thread_local const std::vector<Datagram>* s_delivered;   ///< Datagrams already received from s_deliveredSock.
+#endif
+
+        size_t m_batchSize;
+        size_t m_rxBufferSize;
+        size_t m_txBufferSize;
+        std::vector<unsigned char> m_rxBuffers;
+        std::vector<unsigned char> m_txBuffers;
+#ifdef __linux__
+        std::vector<struct mmsghdr> m_rxMsgs;
+        std::vector<struct mmsghdr> m_txMsgs;
+#endif
+        std::vector<struct iovec> m_rxIovs;
+        std::vector<struct iovec> m_txIovs;
+        std::vector<struct sockaddr_in> m_rxAddrs;
+        std::vector<struct sockaddr_in> m_txAddrs;
+        size_t m_txCount = 0;
+
+        /**
+         * @brief Checks whether receiving can go on after the error.
+         */
+        static bool isTransientError(int err);
+
+        /**
+         * @brief Logs failure to send a datagram, with errno of the failed call.
+         */
+        static void logSendError(const sockaddr_in& remoteAddr);
+
+    public:
+        /**
+         * @brief Sets the number of datagrams processed in a single syscall.
+         *
+         * Applies to UdpBatch objects created afterwards. 0 or 1 disables batching.
+         *
+         * @param batchSize Number of datagrams per syscall.
+         */
+        static void setBatchSize(size_t batchSize) { s_batchSize = batchSize; }
+
+#ifdef __linux__
+        /**
+         * @brief Sends datagrams of all UdpBatch objects in the calling thread through io_uring.
+         * @param ring Ring to queue the sends to, nullptr to send with syscalls again.
+         */
+        static void useRing(IoUring* ring) { s_ring = ring; }
+
+        /**
+         * @brief Makes receive() in the calling thread return given datagrams instead of reading the socket.
+         *
+         * @param sock Socket the datagrams were received from.
+         * @param datagrams Received datagrams, nullptr to read sockets again.
+         */
+        static void deliver(int sock, const std::vector<Datagram>* datagrams)
+        {
+            s_deliveredSock = sock;
+            s_delivered = datagrams;
+        }
+#endif
+
+        /**
+         * @brief Allocates buffers for the batches.
+         *
+         * @param rxBufferSize Max size of the received datagram, longer ones are truncated.
+         * @param txBufferSize Max size of the queued datagram, longer ones are sent right away.
+         */
+        UdpBatch(size_t rxBufferSize, size_t txBufferSize);
+
+        /**
+         * @brief Receives all datagrams pending on the socket.
+         *
+         * Reads until the socket would block, so it can be used with edge-triggered polling.
+         * Datagrams delivered for the socket are passed to the callback instead.
+         *
+         * @param sock Non-blocking UDP socket.
+         * @param cb Callback invoked for each datagram.
+         */
+        void receive(int sock, const ReceiveCb& cb);
+
+        /**
+         * @brief Queues a datagram to be sent with the next flush.
+         *
+         * The data is copied, the caller can reuse its buffer right away. When batching
+         * is disabled, the datagram is sent immediately. With io_uring, it's queued
+         * in the ring instead.
+         *
+         * @param sock UDP socket to send the datagram through.
+         * @param data Datagram payload.
+         * @param len Length of the payload.
+         * @param remoteAddr Destination address.
+         */
+        void send(int sock, const void* data, size_t len, const sockaddr_in& remoteAddr);
+
+        /**
+         * @brief Sends all queued datagrams.
+         * @param sock UDP socket to send datagrams through, must be the same as in send().
+         */
+        void flush(int sock);
+};
@@ -0,0 +1,116 @@
+#include "catch.hpp"
+
+#include "cachefile.hpp"
+
+#include <cstdio>
+#include <map>
+#include <unistd.h>
+
+static std::map<std::string, CacheFile::Entry> loadAll(const std::string& path)
+{
+    std::map<std::string, CacheFile::Entry> entries;
+    CacheFile(path).load([&entries](const CacheFile::Entry& entry) {
+        if (entry.response.empty()) {
+            entries.erase(entry.pvname);
+        } else {
+            entries[entry.pvname] = entry;
+        }
+    });
+    return entries;
+}
+
+TEST_CASE("Cache file snapshot and journal survive restart") {
+    std::string path = "/tmp/pvmapper_test_cache." + std::to_string(::getpid());
+    Protocol::Bytes rsp1 = {1, 2, 3, 4};
+    Protocol::Bytes rsp2 = {5, 6, 7, 8, 9};
+
+    {
+        CacheFile cache(path);
+        REQUIRE(cache.beginSnapshot());
+        cache.addToSnapshot({"PV1", "10.0.0.1", 5064, 5064, rsp1});
+        cache.addToSnapshot({"PV2", "10.0.0.2", 40000, 5064, rsp2});
+        REQUIRE(cache.commitSnapshot());
+
+        cache.add({"PV3", "10.0.0.3", 5064, 5065, rsp1});
+        cache.remove("PV1");
+        cache.flush();
+    }
+
+    auto entries = loadAll(path);
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries.count("PV1") == 0);
+    REQUIRE(entries["PV2"].iocIp == "10.0.0.2");
+    REQUIRE(entries["PV2"].iocPort == 40000);
+    REQUIRE(entries["PV2"].response == rsp2);
+    REQUIRE(entries["PV3"].udpPort == 5065);
+    REQUIRE(entries["PV3"].response == rsp1);
+
+    // Torn write at the end of the journal is ignored
+    {
+        CacheFile cache(path);
+        cache.add({"PV4", "10.0.0.4", 5064, 5064, rsp2});
+        cache.flush();
+    }
+    auto journal = path + ".journal";
+    REQUIRE(::truncate(journal.c_str(), 10 + 20 + 4 + 4 + 20 + 3) == 0);
+    entries = loadAll(path);
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries.count("PV4") == 0);
+
+    // New snapshot truncates the journal
+    {
+        CacheFile cache(path);
+        REQUIRE(cache.beginSnapshot());
+        cache.addToSnapshot({"PV5", "10.0.0.5", 5064, 5064, rsp1});
+        REQUIRE(cache.commitSnapshot());
+    }
+    entries = loadAll(path);
+    REQUIRE(entries.size() == 1);
+    REQUIRE(entries.count("PV5") == 1);
+
+    ::unlink(path.c_str());
+    ::unlink(journal.c_str());
+}
+
+TEST_CASE("Cache file keeps changes made while the snapshot is written") {
+    std::string path = "/tmp/pvmapper_test_cache_bg." + std::to_string(::getpid());
+    auto journal = path + ".journal";
+    auto newJournal = path + ".journal.new";
+    Protocol::Bytes rsp = {1, 2, 3, 4};
+
+    CacheFile cache(path);
+    cache.add({"PV1", "10.0.0.1", 5064, 5064, rsp});
+    cache.add({"PV2", "10.0.0.2", 5064, 5064, rsp});
+    cache.flush();
+
+    // PV2 is removed after it was added to the snapshot, PV3 added after the walk passed
+    REQUIRE(cache.beginSnapshot());
+    cache.addToSnapshot({"PV1", "10.0.0.1", 5064, 5064, rsp});
+    cache.addToSnapshot({"PV2", "10.0.0.2", 5064, 5064, rsp});
+    cache.remove("PV2");
+    cache.add({"PV3", "10.0.0.3", 5064, 5064, rsp});
+    cache.flush();
+
+    // Interrupted before the snapshot was committed, both journals are replayed
+    auto entries = loadAll(path);
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries.count("PV1") == 1);
+    REQUIRE(entries.count("PV3") == 1);
+
+    REQUIRE(cache.commitSnapshot());
+    REQUIRE(cache.waitSnapshot());
+    REQUIRE(cache.isCommitting() == false);
+    REQUIRE(::access(newJournal.c_str(), F_OK) != 0);
+    entries = loadAll(path);
+    REQUIRE(entries.size() == 2);
+    REQUIRE(entries.count("PV2") == 0);
+    REQUIRE(entries.count("PV3") == 1);
+
+    // Journal continues after the rename
+    cache.add({"PV4", "10.0.0.4", 5064, 5064, rsp});
+    cache.flush();
+    REQUIRE(loadAll(path).size() == 3);
+
+    ::unlink(path.c_str());
+    ::unlink(journal.c_str());
+}
@@ -0,0 +1,117 @@
+#include "catch.hpp"
+
+#include "concurrentcache.hpp"
+#include "epoch.hpp"
+#include "pvcache.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Epoch domain frees retired objects after readers leave") {
+    EpochDomain domain;
+    static int nFreed;
+    nFreed = 0;
+    auto deleter = [](void* p) { nFreed++; delete static_cast<int*>(p); };
+
+    {
+        EpochDomain::Guard guard(domain);
+        domain.retire(new int(1), deleter);
+        domain.reclaim();
+        REQUIRE(nFreed == 0);
+        REQUIRE(domain.pending() == 1);
+    }
+    domain.reclaim();
+    REQUIRE(nFreed == 1);
+
+    // Readers arriving after retirement don't hold it back
+    domain.retire(new int(2), deleter);
+    {
+        EpochDomain::Guard guard(domain);
+        domain.reclaim();
+        REQUIRE(nFreed == 2);
+    }
+    REQUIRE(domain.pending() == 0);
+}
+
+TEST_CASE("Concurrent PV cache finds, replaces and removes PVs") {
+    ConcurrentPvCache cache;
+    Protocol::Bytes reply;
+    REQUIRE(cache.find("TEST1", reply) == false);
+    REQUIRE(cache.erase("TEST1") == false);
+
+    std::atomic<bool> referenced{false};
+    std::atomic<uint32_t> lastLookup{0};
+    cache.insert("TEST1", {1, 2, 3}, &referenced, &lastLookup);
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.find("TEST1", reply));
+    REQUIRE(reply == Protocol::Bytes{1, 2, 3});
+    REQUIRE(referenced);
+    REQUIRE(lastLookup >= PvCache::lookupTime() - 1);
+
+    cache.insert("TEST1", {4, 5});
+    REQUIRE(cache.size() == 1);
+    REQUIRE(cache.find("TEST1", reply));
+    REQUIRE(reply == Protocol::Bytes{4, 5});
+
+    // Shards grow many times
+    for (int i = 0; i < 10000; i++) {
+        cache.insert("PV" + std::to_string(i), {static_cast<unsigned char>(i)});
+    }
+    REQUIRE(cache.size() == 10001);
+    for (int i = 0; i < 10000; i += 2) {
+        REQUIRE(cache.erase("PV" + std::to_string(i)));
+    }
+    REQUIRE(cache.size() == 5001);
+    for (int i = 0; i < 10000; i++) {
+        REQUIRE(cache.find("PV" + std::to_string(i), reply) == (i % 2 == 1));
+        if (i % 2 == 1) {
+            REQUIRE(reply == Protocol::Bytes{static_cast<unsigned char>(i)});
+        }
+    }
+    REQUIRE(cache.erase("TEST1"));
+    REQUIRE(cache.find("TEST1", reply) == false);
+}
+
+TEST_CASE("Concurrent PV cache is read while modified") {
+    ConcurrentPvCache cache;
+    for (int i = 0; i < 1000; i++) {
+        cache.insert("STABLE" + std::to_string(i), {static_cast<unsigned char>(i)});
+    }
+
+    // Assertions are not thread safe, readers only count errors
+    std::atomic<bool> stop{false};
+    std::atomic<int> nErrors{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&cache, &stop, &nErrors]() {
+            Protocol::Bytes reply;
+            while (stop == false) {
+                for (int i = 0; i < 1000; i++) {
+                    if (cache.find("STABLE" + std::to_string(i), reply) == false || reply != Protocol::Bytes{static_cast<unsigned char>(i)}) {
+                        nErrors++;
+                    }
+                    // Churned PVs may or may not be there, but replies must be consistent
+                    if (cache.find("CHURN" + std::to_string(i), reply) && reply != Protocol::Bytes{static_cast<unsigned char>(i), 0}) {
+                        nErrors++;
+                    }
+                }
+            }
+        });
+    }
+
+    for (int round = 0; round < 20; round++) {
+        for (int i = 0; i < 1000; i++) {
+            cache.insert("CHURN" + std::to_string(i), {static_cast<unsigned char>(i), 0});
+        }
+        for (int i = 0; i < 1000; i++) {
+            cache.erase("CHURN" + std::to_string(i));
+        }
+    }
+    stop = true;
+    for (auto& reader: readers) {
+        reader.join();
+    }
+    REQUIRE(nErrors == 0);
+    REQUIRE(cache.size() == 1000);
+}
@@ -0,0 +1,159 @@
+#include "catch.hpp"
+
+#include "connectscheduler.hpp"
+#include "connmgr.hpp"
+#include "proto_ca.hpp"
+
+#include <unistd.h>
+
+#include <thread>
+
+/**
+ * Fake IOC TCP socket on a loopback ephemeral port, refuses connections unless listening.
+ */
+static int createIocSocket(uint16_t& port, bool listening)
+{
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    ::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    if (listening) {
+        ::listen(sock, 8);
+    }
+    socklen_t len = sizeof(addr);
+    ::getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len);
+    port = ::ntohs(addr.sin_port);
+    return sock;
+}
+
+TEST_CASE("Connect scheduler paces connections and backs off unreachable IOCs") {
+    std::vector<uint16_t> ports(3);
+    std::vector<int> socks;
+    socks.push_back(createIocSocket(ports[0], true));
+    socks.push_back(createIocSocket(ports[1], true));
+    socks.push_back(createIocSocket(ports[2], false));
+
+    int nDisconnects = 0;
+    IocGuard::DisconnectCb disconnectCb = [&nDisconnects](const std::string&, uint16_t) { nDisconnects++; };
+    std::shared_ptr<Protocol> protocol(new ChannelAccess);
+    std::vector<std::shared_ptr<IocGuard>> guards;
+    for (auto port: ports) {
+        guards.emplace_back(new IocGuard("127.0.0.1", port, protocol, disconnectCb));
+    }
+    REQUIRE(guards[0]->isWaiting());
+    REQUIRE(guards[0]->isConnected());
+    REQUIRE(guards[0]->getSocket() == -1);
+
+    // One connection at a time, next one starts when the previous completes
+    auto now = std::chrono::steady_clock::now();
+    ConnectScheduler scheduler(1);
+    for (auto& guard: guards) {
+        scheduler.schedule(guard);
+    }
+    scheduler.process(now);
+    REQUIRE(scheduler.getConnecting() == 1);
+    REQUIRE(scheduler.getWaiting() == 2);
+    REQUIRE(guards[1]->isWaiting());
+    REQUIRE(scheduler.nextWakeup(now) == std::chrono::steady_clock::time_point::max());
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    guards[0]->processOutgoing();
+    REQUIRE(guards[0]->isEstablished());
+    scheduler.process(now);
+    REQUIRE(scheduler.getConnecting() == 1);
+    REQUIRE(guards[1]->isWaiting() == false);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    guards[1]->processOutgoing();
+    scheduler.process(now);
+
+    // Refused connection is detected and the IOC is held back
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    guards[2]->processOutgoing();
+    REQUIRE(guards[2]->isConnected() == false);
+    REQUIRE(nDisconnects == 1);
+    scheduler.process(now);
+    REQUIRE(scheduler.getConnecting() == 0);
+    REQUIRE(scheduler.isUnreachable(guards[2]->getIocAddr()));
+    REQUIRE(scheduler.isUnreachable(guards[0]->getIocAddr()) == false);
+
+    std::shared_ptr<IocGuard> retry(new IocGuard("127.0.0.1", ports[2], protocol, disconnectCb));
+    scheduler.schedule(retry);
+    REQUIRE(scheduler.getWaiting() == 1);
+    scheduler.process(now);
+    REQUIRE(retry->isWaiting());
+    REQUIRE(scheduler.nextWakeup(now) > now + std::chrono::seconds(9));
+    scheduler.process(now + std::chrono::seconds(11));
+    REQUIRE(retry->isWaiting() == false);
+
+    // Backoff doubles after another failure
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    retry->processOutgoing();
+    scheduler.process(now + std::chrono::seconds(11));
+    std::shared_ptr<IocGuard> retry2(new IocGuard("127.0.0.1", ports[2], protocol, disconnectCb));
+    scheduler.schedule(retry2);
+    REQUIRE(scheduler.nextWakeup(now + std::chrono::seconds(11)) > now + std::chrono::seconds(30));
+
+    // Guards released while waiting are dropped
+    retry2.reset();
+    scheduler.process(now + std::chrono::seconds(40));
+    REQUIRE(scheduler.getWaiting() == 0);
+    REQUIRE(scheduler.getConnecting() == 0);
+
+    // Failures are forgotten after the max backoff
+    scheduler.purge(now + std::chrono::seconds(400));
+    REQUIRE(scheduler.getUnreachable() == 0);
+
+    for (auto& guard: guards) {
+        ConnectionsManager::remove(guard);
+    }
+    ConnectionsManager::remove(retry);
+    for (auto sock: socks) {
+        ::close(sock);
+    }
+}
+
+TEST_CASE("Connect scheduler holds back guards replacing failed ones") {
+    uint16_t refusedPort, listeningPort;
+    int refusedSock = createIocSocket(refusedPort, false);
+    int listeningSock = createIocSocket(listeningPort, true);
+
+    // Replacement is scheduled from the disconnect callback, like by the Dispatcher
+    ConnectScheduler scheduler;
+    std::shared_ptr<Protocol> protocol(new ChannelAccess);
+    std::shared_ptr<IocGuard> replacement;
+    IocGuard::DisconnectCb disconnectCb = [&](const std::string& ip, uint16_t port) {
+        replacement.reset(new IocGuard(ip, port, protocol, disconnectCb));
+        scheduler.schedule(replacement);
+    };
+    std::shared_ptr<IocGuard> guard(new IocGuard("127.0.0.1", refusedPort, protocol, disconnectCb));
+    scheduler.schedule(guard);
+    scheduler.process();
+    REQUIRE(scheduler.getConnecting() == 1);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    guard->processOutgoing();
+    REQUIRE(replacement);
+    REQUIRE(scheduler.isUnreachable(guard->getIocAddr()));
+    REQUIRE(scheduler.getConnecting() == 0);
+    auto now = std::chrono::steady_clock::now();
+    scheduler.process(now);
+    REQUIRE(replacement->isWaiting());
+    REQUIRE(scheduler.nextWakeup(now) > now + std::chrono::seconds(9));
+
+    // Stopping a connecting guard is not a failure of the IOC
+    std::shared_ptr<IocGuard> stopped(new IocGuard("127.0.0.1", listeningPort, protocol, disconnectCb));
+    scheduler.schedule(stopped);
+    scheduler.process();
+    REQUIRE(scheduler.getConnecting() == 1);
+    ConnectionsManager::remove(stopped);
+    stopped->stop();
+    scheduler.process();
+    REQUIRE(scheduler.getConnecting() == 0);
+    REQUIRE(scheduler.isUnreachable(stopped->getIocAddr()) == false);
+
+    ConnectionsManager::remove(guard);
+    ::close(refusedSock);
+    ::close(listeningSock);
+}
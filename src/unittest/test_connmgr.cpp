@@ -0,0 +1,267 @@
+#include "catch.hpp"
+
+#include "connmgr.hpp"
+#include "iouring.hpp"
+#include "udpbatch.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <memory>
+#include <set>
+#include <vector>
+
+/**
+ * Connection signalled through an eventfd, counts how many times it was processed.
+ */
+class TestConnection : public Connection {
+    public:
+        unsigned nIncoming = 0;
+        unsigned nOutgoing = 0;
+
+        TestConnection() { m_sock = ::eventfd(0, EFD_NONBLOCK); }
+        ~TestConnection() { close(); }
+
+        void signal()
+        {
+            uint64_t one = 1;
+            (void)!::write(m_sock, &one, sizeof(one));
+        }
+
+        void close()
+        {
+            if (m_sock != -1) {
+                ::close(m_sock);
+                m_sock = -1;
+            }
+        }
+
+        void processIncoming()
+        {
+            uint64_t count;
+            (void)!::read(m_sock, &count, sizeof(count));
+            nIncoming++;
+        }
+
+        void processOutgoing() { nOutgoing++; }
+
+        void wakeupIn(std::chrono::milliseconds delay) { wakeupAt(std::chrono::steady_clock::now() + delay); }
+};
+
+/**
+ * UDP connection echoing every datagram back to its sender.
+ */
+class EchoConnection : public Connection {
+    private:
+        UdpBatch m_batch;
+
+    public:
+        unsigned nReceived = 0;
+
+        EchoConnection()
+            : m_batch(1024, 1024)
+        {
+            m_udpReceive = true;
+            m_sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+            ::fcntl(m_sock, F_SETFL, O_NONBLOCK);
+            m_addr = {};
+            m_addr.sin_family = AF_INET;
+            m_addr.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+            ::bind(m_sock, reinterpret_cast<sockaddr*>(&m_addr), sizeof(m_addr));
+            socklen_t len = sizeof(m_addr);
+            ::getsockname(m_sock, reinterpret_cast<sockaddr*>(&m_addr), &len);
+        }
+        ~EchoConnection() { ::close(m_sock); }
+
+        const sockaddr_in& getAddr() const { return m_addr; }
+
+        void processIncoming()
+        {
+            m_batch.receive(m_sock, [this](const unsigned char* data, size_t len, const sockaddr_in& remoteAddr) {
+                nReceived++;
+                m_batch.send(m_sock, data, len, remoteAddr);
+            });
+        }
+
+        void processOutgoing() { m_batch.flush(m_sock); }
+};
+
+static void testDispatch()
+{
+    std::vector<std::shared_ptr<TestConnection>> connections;
+    for (int i = 0; i < 3; i++) {
+        connections.emplace_back(new TestConnection);
+        ConnectionsManager::add(connections.back());
+    }
+
+    connections[1]->signal();
+    ConnectionsManager::run(0.01);
+    REQUIRE(connections[0]->nIncoming == 0);
+    REQUIRE(connections[1]->nIncoming == 1);
+    REQUIRE(connections[2]->nIncoming == 0);
+
+    // Edge is only reported once, until signalled again
+    ConnectionsManager::run(0.01);
+    REQUIRE(connections[1]->nIncoming == 1);
+
+    // Removed connection is not processed anymore, the others still are
+    ConnectionsManager::remove(connections[0]);
+    auto nOutgoing = connections[0]->nOutgoing;
+    connections[0]->signal();
+    connections[0]->wakeupIn(std::chrono::milliseconds(0));
+    connections[2]->signal();
+    ConnectionsManager::run(0.01);
+    REQUIRE(connections[0]->nIncoming == 0);
+    REQUIRE(connections[0]->nOutgoing == nOutgoing);
+    REQUIRE(connections[2]->nIncoming == 1);
+
+    // Closed connections are dropped once processed, the others stay
+    connections[2]->close();
+    connections[2]->wakeupIn(std::chrono::milliseconds(0));
+    ConnectionsManager::run(0.01);
+    nOutgoing = connections[2]->nOutgoing;
+    auto nOutgoingOther = connections[1]->nOutgoing;
+    connections[1]->wakeupIn(std::chrono::milliseconds(0));
+    connections[2]->wakeupIn(std::chrono::milliseconds(0));
+    ConnectionsManager::run(0.01);
+    REQUIRE(connections[2]->nOutgoing == nOutgoing);
+    REQUIRE(connections[1]->nOutgoing == nOutgoingOther + 1);
+
+    ConnectionsManager::remove(connections[1]);
+}
+
+TEST_CASE("Connections manager dispatches events to registered connections") {
+    testDispatch();
+}
+
+TEST_CASE("Connections manager dispatches events with io_uring") {
+    if (ConnectionsManager::setBackend(ConnectionsManager::Backend::IoUring) == false) {
+        WARN("io_uring not supported, skipping");
+        return;
+    }
+    testDispatch();
+
+    // Registered connections move between backends
+    std::shared_ptr<TestConnection> connection(new TestConnection);
+    ConnectionsManager::add(connection);
+    REQUIRE(ConnectionsManager::setBackend(ConnectionsManager::Backend::Epoll));
+    connection->signal();
+    ConnectionsManager::run(0.01);
+    REQUIRE(connection->nIncoming == 1);
+    ConnectionsManager::remove(connection);
+}
+
+TEST_CASE("Connections manager receives and sends datagrams with io_uring") {
+    if (ConnectionsManager::setBackend(ConnectionsManager::Backend::IoUring) == false) {
+        WARN("io_uring not supported, skipping");
+        return;
+    }
+
+    std::shared_ptr<EchoConnection> connection(new EchoConnection);
+    ConnectionsManager::add(connection);
+    int client = ::socket(AF_INET, SOCK_DGRAM, 0);
+    struct timeval timeout = {1, 0};
+    ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // More datagrams than fit into a single batch, each echoed once
+    for (unsigned i = 0; i < 100; i++) {
+        ::sendto(client, &i, sizeof(i), 0, reinterpret_cast<const sockaddr*>(&connection->getAddr()), sizeof(sockaddr_in));
+    }
+    for (int i = 0; i < 100 && connection->nReceived < 100; i++) {
+        ConnectionsManager::run(0.01);
+    }
+    REQUIRE(connection->nReceived == 100);
+
+    // Echoes go out with the next wait
+    ConnectionsManager::run(0);
+    for (unsigned i = 0; i < 100; i++) {
+        unsigned echo = 1000;
+        REQUIRE(::recv(client, &echo, sizeof(echo), 0) == sizeof(echo));
+        REQUIRE(echo == i);
+    }
+
+    // Removed connection stops receiving, its datagrams are not lost after switching back
+    REQUIRE(ConnectionsManager::setBackend(ConnectionsManager::Backend::Epoll));
+    unsigned last = 100;
+    ::sendto(client, &last, sizeof(last), 0, reinterpret_cast<const sockaddr*>(&connection->getAddr()), sizeof(sockaddr_in));
+    ConnectionsManager::run(0.1);
+    REQUIRE(connection->nReceived == 101);
+    unsigned echo = 0;
+    REQUIRE(::recv(client, &echo, sizeof(echo), 0) == sizeof(echo));
+    REQUIRE(echo == last);
+
+    ConnectionsManager::remove(connection);
+    ::close(client);
+}
+
+#ifdef __linux__
+TEST_CASE("io_uring queues more requests than fit in its rings") {
+    std::unique_ptr<IoUring> ring;
+    try {
+        ring.reset(new IoUring(4, 8, 256));
+    } catch (SocketException&) {
+        WARN("io_uring not supported, skipping");
+        return;
+    }
+
+    // Submission ring fills up many times, completions overflow their ring
+    std::vector<int> fds;
+    for (uint64_t i = 1; i <= 64; i++) {
+        fds.push_back(::eventfd(1, EFD_NONBLOCK));
+        REQUIRE(ring->pollAdd(fds.back(), POLLIN, i));
+    }
+    std::set<uint64_t> completed;
+    for (int i = 0; i < 10 && completed.size() < fds.size(); i++) {
+        for (auto& cqe: ring->wait(10)) {
+            REQUIRE(cqe.res > 0);
+            completed.insert(cqe.user_data);
+        }
+    }
+    REQUIRE(completed.size() == fds.size());
+
+    for (uint64_t i = 1; i <= 64; i++) {
+        REQUIRE(ring->cancel(i));
+    }
+    ring->wait(0);
+    for (auto fd: fds) {
+        ::close(fd);
+    }
+}
+#endif
+
+TEST_CASE("Connections manager wakes up connections when requested") {
+    std::shared_ptr<TestConnection> connection(new TestConnection);
+    ConnectionsManager::add(connection);
+
+    // First processing right after being added
+    ConnectionsManager::run(0.01);
+    REQUIRE(connection->nOutgoing >= 1);
+
+    // Nothing scheduled, nothing to do
+    auto nOutgoing = connection->nOutgoing;
+    ConnectionsManager::run(0.01);
+    REQUIRE(connection->nOutgoing == nOutgoing);
+
+    // Sleeps exactly until the wakeup, not for the whole timeout
+    auto start = std::chrono::steady_clock::now();
+    connection->wakeupIn(std::chrono::milliseconds(50));
+    connection->wakeupIn(std::chrono::milliseconds(500));
+    // Signals may end the wait early
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    while (connection->nOutgoing == nOutgoing && elapsed < std::chrono::seconds(5)) {
+        ConnectionsManager::run(5.0);
+        elapsed = std::chrono::steady_clock::now() - start;
+    }
+    REQUIRE(connection->nOutgoing == nOutgoing + 1);
+    REQUIRE(elapsed >= std::chrono::milliseconds(50));
+    REQUIRE(elapsed < std::chrono::milliseconds(500));
+
+    // Later request was superseded by the earlier one
+    ConnectionsManager::run(0.6);
+    REQUIRE(connection->nOutgoing == nOutgoing + 1);
+
+    ConnectionsManager::remove(connection);
+}
@@ -0,0 +1,155 @@
+#include "catch.hpp"
+
+#include "connmgr.hpp"
+#include "dispatcher.hpp"
+
+#include <unistd.h>
+
+#include <thread>
+
+/**
+ * Dispatcher with callbacks invoked directly, IOCs are not searched for over the network.
+ */
+class TestDispatcher : public Dispatcher {
+    public:
+        TestDispatcher(const Config& config)
+        : Dispatcher(config)
+        {}
+
+        ~TestDispatcher()
+        {
+            for (auto& ioc: m_iocs) {
+                ConnectionsManager::remove(m_connectedPVs.getIoc(ioc.second).guard);
+            }
+            ConnectionsManager::remove(m_caSearcher);
+        }
+
+        using Dispatcher::caPvFound;
+        using Dispatcher::caPvSearched;
+        using Dispatcher::iocDisconnected;
+        using Dispatcher::checkSuspects;
+
+        Searcher& getSearcher() { return *m_caSearcher; }
+
+        PvCache& getCache() { return m_connectedPVs; }
+
+        ConnectScheduler& getConnectScheduler() { return m_connectScheduler; }
+
+        std::shared_ptr<IocGuard> getGuard(const std::string& iocIP, uint16_t iocPort)
+        {
+            return m_connectedPVs.getIoc(m_iocs.at(std::make_pair(iocIP, iocPort))).guard;
+        }
+
+        size_t getSuspects() const { return m_suspects.size(); }
+
+        void endGracePeriods()
+        {
+            for (auto& suspect: m_suspects) {
+                suspect.second = std::chrono::steady_clock::now();
+            }
+        }
+};
+
+/**
+ * Fake IOC TCP socket on a loopback ephemeral port.
+ */
+static int createIocSocket(uint16_t& port)
+{
+    int sock = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    ::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    ::listen(sock, 8);
+    socklen_t len = sizeof(addr);
+    ::getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len);
+    port = ::ntohs(addr.sin_port);
+    return sock;
+}
+
+static Config createConfig()
+{
+    Config config;
+    // Searches are never sent, nothing needs to listen there
+    config.ca_search_addresses = {{"127.0.0.1", 5064}};
+    config.purge_delay = 60;
+    return config;
+}
+
+TEST_CASE("PVs of removed IOCs are searched for again as configured") {
+    uint16_t iocPort;
+    int iocSock = createIocSocket(iocPort);
+    Protocol::Bytes reply = {1, 2, 3};
+
+    auto orphanSearch = [&](Config::OrphanSearch mode) {
+        auto config = createConfig();
+        config.orphan_search = mode;
+        TestDispatcher dispatcher(config);
+        for (auto pvname: {"RECENT", "OLD", "NEVER"}) {
+            dispatcher.caPvFound(pvname, "127.0.0.1", iocPort, 5064, reply);
+        }
+        REQUIRE(dispatcher.getSearcher().size() == 0);
+
+        // Client asked for OLD before the purge delay, it would be purged from the search list
+        REQUIRE(dispatcher.caPvSearched("RECENT", "127.0.0.1", 10000).empty() == false);
+        dispatcher.getCache().find("OLD")->lastLookup = PvCache::lookupTime() - config.purge_delay - 1;
+
+        dispatcher.iocDisconnected("127.0.0.1", iocPort);
+        REQUIRE(dispatcher.getCache().size() == 0);
+        std::vector<std::string> searched;
+        for (auto pvname: {"RECENT", "OLD", "NEVER"}) {
+            if (dispatcher.getSearcher().isSearched(pvname)) {
+                searched.push_back(pvname);
+            }
+        }
+        return searched;
+    };
+
+    REQUIRE(orphanSearch(Config::OrphanSearch::All) == std::vector<std::string>{"RECENT", "OLD", "NEVER"});
+    REQUIRE(orphanSearch(Config::OrphanSearch::Referenced) == std::vector<std::string>{"RECENT"});
+    REQUIRE(orphanSearch(Config::OrphanSearch::None).empty());
+
+    ::close(iocSock);
+}
+
+TEST_CASE("PVs of IOCs reconnecting within the grace period are served without a search") {
+    uint16_t iocPort;
+    int iocSock = createIocSocket(iocPort);
+    Protocol::Bytes reply = {1, 2, 3};
+    auto config = createConfig();
+    config.ioc_grace_period = 10;
+    TestDispatcher dispatcher(config);
+    dispatcher.caPvFound("PV", "127.0.0.1", iocPort, 5064, reply);
+    REQUIRE(dispatcher.caPvSearched("PV", "127.0.0.1", 10000).empty() == false);
+
+    // PV is kept but not returned while reconnecting
+    dispatcher.iocDisconnected("127.0.0.1", iocPort);
+    REQUIRE(dispatcher.getSuspects() == 1);
+    REQUIRE(dispatcher.getCache().size() == 1);
+    REQUIRE(dispatcher.caPvSearched("PV", "127.0.0.1", 10000).empty());
+    REQUIRE(dispatcher.getSearcher().isSearched("PV") == false);
+
+    auto guard = dispatcher.getGuard("127.0.0.1", iocPort);
+    dispatcher.getConnectScheduler().process();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    guard->processOutgoing();
+    REQUIRE(guard->isEstablished());
+    dispatcher.checkSuspects();
+    REQUIRE(dispatcher.getSuspects() == 0);
+    REQUIRE(dispatcher.caPvSearched("PV", "127.0.0.1", 10000).empty() == false);
+    REQUIRE(dispatcher.getSearcher().isSearched("PV") == false);
+
+    // IOC not reconnecting in time is removed with its PVs
+    dispatcher.iocDisconnected("127.0.0.1", iocPort);
+    dispatcher.checkSuspects();
+    REQUIRE(dispatcher.getCache().size() == 1);
+    dispatcher.endGracePeriods();
+    dispatcher.checkSuspects();
+    REQUIRE(dispatcher.getSuspects() == 0);
+    REQUIRE(dispatcher.getCache().size() == 0);
+    REQUIRE(dispatcher.caPvSearched("PV", "127.0.0.1", 10000).empty());
+    REQUIRE(dispatcher.getSearcher().isSearched("PV"));
+
+    ConnectionsManager::remove(guard);
+    ::close(iocSock);
+}
@@ -0,0 +1,116 @@
+#include "catch.hpp"
+
+#include "echoprober.hpp"
+#include "proto_ca.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <thread>
+
+/**
+ * Fake IOC UDP socket on a loopback ephemeral port.
+ */
+static int createIocSocket(uint16_t& port)
+{
+    int sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    ::fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    ::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    socklen_t len = sizeof(addr);
+    ::getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len);
+    port = ::ntohs(addr.sin_port);
+    return sock;
+}
+
+/**
+ * Receives all probes and optionally echoes them back, returns number of probes.
+ */
+static int answerProbes(int sock, bool respond)
+{
+    int nProbes = 0;
+    unsigned char buffer[1024];
+    sockaddr_in from;
+    socklen_t len = sizeof(from);
+    ssize_t recvd;
+    while ((recvd = ::recvfrom(sock, buffer, sizeof(buffer), 0, reinterpret_cast<sockaddr*>(&from), &len)) > 0) {
+        nProbes++;
+        if (respond) {
+            ::sendto(sock, buffer, recvd, 0, reinterpret_cast<sockaddr*>(&from), len);
+        }
+    }
+    return nProbes;
+}
+
+TEST_CASE("Echo prober detects lost IOCs") {
+    uint16_t udpPort;
+    int iocSock = createIocSocket(udpPort);
+
+    int nDisconnects = 0;
+    IocGuard::DisconnectCb disconnectCb = [&nDisconnects](const std::string&, uint16_t) { nDisconnects++; };
+    std::shared_ptr<Protocol> protocol(new ChannelAccess);
+    std::shared_ptr<IocGuard> guard(new IocGuard("127.0.0.1", 5064, protocol, disconnectCb, false));
+    REQUIRE(guard->getSocket() == -1);
+    REQUIRE(guard->isConnected());
+    REQUIRE(guard->isEstablished() == false);
+
+    EchoProber prober(protocol, 1, 1);
+    prober.add(guard, udpPort);
+    REQUIRE(prober.size() == 1);
+
+    // First probe goes out right away
+    prober.processOutgoing();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(answerProbes(iocSock, true) == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    prober.processIncoming();
+    REQUIRE(guard->isEstablished());
+
+    // Answered probe is not missed, next one is sent after the interval
+    std::this_thread::sleep_for(std::chrono::milliseconds(1050));
+    prober.processOutgoing();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(answerProbes(iocSock, false) == 1);
+    REQUIRE(nDisconnects == 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(1050));
+    prober.processOutgoing();
+    REQUIRE(nDisconnects == 1);
+    REQUIRE(guard->isConnected() == false);
+    REQUIRE(prober.size() == 0);
+
+    ::close(iocSock);
+}
+
+TEST_CASE("Echo prober refuses IOCs sharing UDP port") {
+    uint16_t udpPort;
+    int iocSock = createIocSocket(udpPort);
+
+    int nDisconnects = 0;
+    IocGuard::DisconnectCb disconnectCb = [&nDisconnects](const std::string&, uint16_t) { nDisconnects++; };
+    std::shared_ptr<Protocol> protocol(new ChannelAccess);
+    std::shared_ptr<IocGuard> guard1(new IocGuard("127.0.0.1", 5064, protocol, disconnectCb, false));
+    std::shared_ptr<IocGuard> guard2(new IocGuard("127.0.0.1", 5065, protocol, disconnectCb, false));
+
+    EchoProber prober(protocol, 1, 1);
+    REQUIRE(prober.add(guard1, udpPort));
+    REQUIRE(prober.add(guard2, udpPort) == false);
+    REQUIRE(prober.size() == 1);
+
+    // First IOC is still probed and gets lost when not responding
+    prober.processOutgoing();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    REQUIRE(answerProbes(iocSock, false) == 1);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1050));
+    prober.processOutgoing();
+    REQUIRE(nDisconnects == 1);
+    REQUIRE(guard1->isConnected() == false);
+
+    // Address is free once its IOC is lost
+    REQUIRE(prober.add(guard2, udpPort));
+    REQUIRE(prober.size() == 1);
+
+    ::close(iocSock);
+}
@@ -0,0 +1,67 @@
+#include "catch.hpp"
+
+#include "negcache.hpp"
+
+TEST_CASE("Negative cache remembers and evicts names") {
+    NegativeCache disabled;
+    disabled.insert("TEST");
+    REQUIRE(disabled.contains("TEST") == false);
+
+    NegativeCache cache(100, 3600);
+    for (int i = 0; i < 150; i++) {
+        cache.insert("MISSING" + std::to_string(i));
+    }
+    REQUIRE(cache.size() == 100);
+    REQUIRE(cache.getStats().inserts == 150);
+    REQUIRE(cache.getStats().evictions == 50);
+
+    // Recent names are exact hits, evicted ones are still in the filter
+    REQUIRE(cache.contains("MISSING149") == true);
+    REQUIRE(cache.contains("MISSING0") == true);
+    REQUIRE(cache.getStats().hits == 1);
+    REQUIRE(cache.getStats().filterHits == 1);
+
+    // Filter is sized for ~1% false positives
+    size_t falsePositives = 0;
+    for (int i = 0; i < 10000; i++) {
+        falsePositives += (cache.contains("OTHER" + std::to_string(i)) ? 1 : 0);
+    }
+    REQUIRE(falsePositives < 200);
+    REQUIRE(cache.getStats().misses == 10000 - falsePositives);
+
+    REQUIRE(cache.lookup("MISSING149") == NegativeCache::Match::Exact);
+    REQUIRE(cache.lookup("MISSING0") == NegativeCache::Match::Filter);
+
+    // Found names are no longer reported by the filter, evicted or not
+    cache.remove("MISSING149");
+    cache.remove("MISSING0");
+    REQUIRE(cache.size() == 99);
+    REQUIRE(cache.contains("MISSING149") == false);
+    REQUIRE(cache.contains("MISSING0") == false);
+
+    // Until they are not found again
+    cache.insert("MISSING0");
+    REQUIRE(cache.lookup("MISSING0") == NegativeCache::Match::Exact);
+}
+
+TEST_CASE("Negative cache forgets names after the time to live") {
+    NegativeCache cache(100, 100);
+    auto now = std::chrono::steady_clock::now();
+
+    // Exact entries outlive the filter generation they were added to
+    cache.insert("MISSING", now + std::chrono::seconds(49));
+    REQUIRE(cache.lookup("MISSING", now + std::chrono::seconds(51)) == NegativeCache::Match::Exact);
+    REQUIRE(cache.lookup("MISSING", now + std::chrono::seconds(102)) == NegativeCache::Match::Exact);
+    REQUIRE(cache.lookup("MISSING", now + std::chrono::seconds(148)) == NegativeCache::Match::Exact);
+
+    // Then the filter remembers them for a while longer
+    REQUIRE(cache.lookup("MISSING", now + std::chrono::seconds(151)) == NegativeCache::Match::Filter);
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.lookup("MISSING", now + std::chrono::seconds(260)) == NegativeCache::Match::None);
+
+    // Found names are not reported after an idle period longer than the time to live
+    cache.insert("FOUND", now + std::chrono::seconds(261));
+    cache.remove("FOUND", now + std::chrono::seconds(262));
+    REQUIRE(cache.lookup("FOUND", now + std::chrono::seconds(263)) == NegativeCache::Match::None);
+    REQUIRE(cache.lookup("FOUND", now + std::chrono::seconds(400)) == NegativeCache::Match::None);
+}
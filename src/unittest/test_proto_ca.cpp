@@ -0,0 +1,65 @@
+#include "catch.hpp"
+
+#include "proto_ca.hpp"
+
+#include <arpa/inet.h>
+
+TEST_CASE("Search requests are packed up to the max packet size") {
+    ChannelAccess ca;
+    Protocol::Bytes packet;
+    packet.reserve(1472);
+
+    ca.initSearchRequest(packet);
+    REQUIRE(packet.size() == 16);
+
+    // 16 bytes header + 8 bytes aligned name per PV
+    size_t nPvs = 0;
+    while (ca.addSearchRequest(packet, static_cast<uint32_t>(nPvs), "PV" + std::to_string(nPvs % 10), 1472)) {
+        nPvs++;
+    }
+    REQUIRE(nPvs == (1472 - 16) / 24);
+    REQUIRE(packet.size() == 16 + nPvs * 24);
+    REQUIRE(packet.capacity() >= 1472);
+
+    auto pvs = ca.parseSearchRequest(packet);
+    REQUIRE(pvs.size() == nPvs);
+    REQUIRE(pvs.front().first == 0);
+    REQUIRE(pvs.front().second == "PV0");
+    REQUIRE(pvs.back().first == nPvs - 1);
+    REQUIRE(pvs.back().second == "PV" + std::to_string((nPvs - 1) % 10));
+
+    // Starting a new packet reuses the buffer
+    auto data = packet.data();
+    ca.initSearchRequest(packet);
+    REQUIRE(packet.size() == 16);
+    REQUIRE(packet.data() == data);
+}
+
+TEST_CASE("Search request doesn't fit") {
+    ChannelAccess ca;
+    Protocol::Bytes packet;
+
+    ca.initSearchRequest(packet);
+    REQUIRE(ca.addSearchRequest(packet, 1, "A_VERY_LONG_PV_NAME", 40) == false);
+    REQUIRE(packet.size() == 16);
+    REQUIRE(ca.addSearchRequest(packet, 1, "SHORT", 40) == true);
+    REQUIRE(packet.size() == 40);
+}
+
+TEST_CASE("Beacons are parsed with IOC address") {
+    ChannelAccess ca;
+    uint16_t beacon[16] = {0};
+    beacon[0] = htons(13);          // CA_PROTO_RSRV_IS_UP
+    beacon[3] = htons(5064);        // server port
+    reinterpret_cast<uint32_t*>(beacon)[2] = htonl(42); // beacon ID
+    beacon[8] = htons(13);
+    beacon[11] = htons(5070);
+    reinterpret_cast<uint32_t*>(beacon)[6] = htonl(7);
+    inet_aton("10.1.2.3", reinterpret_cast<in_addr*>(&reinterpret_cast<uint32_t*>(beacon)[7]));
+
+    auto data = reinterpret_cast<const unsigned char*>(beacon);
+    auto beacons = ca.parseBeacons("192.168.0.1", {data, data + sizeof(beacon)});
+    REQUIRE(beacons.size() == 2);
+    REQUIRE(beacons[0] == std::make_tuple(std::string("192.168.0.1"), 5064, 42));
+    REQUIRE(beacons[1] == std::make_tuple(std::string("10.1.2.3"), 5070, 7));
+}
@@ -0,0 +1,234 @@
+#include "catch.hpp"
+
+#include "pvcache.hpp"
+
+#include <atomic>
+#include <set>
+#include <thread>
+#include <vector>
+
+TEST_CASE("PV cache finds, adds and removes PVs") {
+    PvCache cache;
+    REQUIRE(cache.find("TEST1") == nullptr);
+    REQUIRE(cache.erase("TEST1") == false);
+
+    auto& pv = cache.insert("TEST1");
+    pv.unverified = true;
+    REQUIRE(cache.size() == 1);
+    REQUIRE(&cache.insert("TEST1") == &pv);
+    REQUIRE(cache.size() == 1);
+
+    // Lookups record their time, adding doesn't
+    REQUIRE(pv.lastLookup == 0);
+    auto found = cache.find("TEST1");
+    REQUIRE(found == &pv);
+    REQUIRE(found->pvname == "TEST1");
+    REQUIRE(found->unverified == true);
+    REQUIRE(found->lastLookup >= PvCache::lookupTime() - 1);
+
+    REQUIRE(cache.erase("TEST1") == true);
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.find("TEST1") == nullptr);
+
+    // Removed PV doesn't leave anything behind
+    auto& again = cache.insert("TEST1");
+    REQUIRE(again.unverified == false);
+    REQUIRE(again.ioc == PvCache::NO_IOC);
+    REQUIRE(again.lastLookup == 0);
+}
+
+TEST_CASE("PV cache keeps IOC records while needed") {
+    PvCache cache;
+    auto ioc1 = cache.addIoc(nullptr);
+    auto ioc2 = cache.addIoc(nullptr);
+    REQUIRE(ioc1 != ioc2);
+    REQUIRE(cache.iocCount() == 2);
+    cache.getIoc(ioc1).reply = {1, 2, 3};
+
+    auto& pv1 = cache.insert("TEST1");
+    auto& pv2 = cache.insert("TEST2");
+    cache.setIoc(pv1, ioc1);
+    cache.setIoc(pv2, ioc1);
+    REQUIRE(cache.getIoc(ioc1).nPvs == 2);
+    REQUIRE(cache.getIoc(pv1.ioc).reply == Protocol::Bytes{1, 2, 3});
+
+    // PV moves to another IOC
+    cache.setIoc(pv2, ioc2);
+    REQUIRE(cache.getIoc(ioc1).nPvs == 1);
+    REQUIRE(cache.getIoc(ioc2).nPvs == 1);
+
+    // Unlisted IOC is kept while PVs refer to it
+    cache.unlistIoc(ioc1);
+    REQUIRE(cache.iocCount() == 2);
+    REQUIRE(cache.getIoc(ioc1).reply == Protocol::Bytes{1, 2, 3});
+    cache.erase("TEST1");
+    REQUIRE(cache.iocCount() == 1);
+
+    // Listed IOC is kept without PVs, released id is reused
+    cache.erase("TEST2");
+    REQUIRE(cache.iocCount() == 1);
+    REQUIRE(cache.getIoc(ioc2).used == true);
+    auto ioc3 = cache.addIoc(nullptr);
+    REQUIRE(ioc3 == ioc1);
+    REQUIRE(cache.getIoc(ioc3).reply.empty());
+    REQUIRE(cache.getIoc(ioc3).nPvs == 0);
+}
+
+TEST_CASE("PV cache survives growing and churn") {
+    PvCache cache;
+    for (int i = 0; i < 10000; i++) {
+        cache.insert("TEST" + std::to_string(i));
+    }
+    REQUIRE(cache.size() == 10000);
+
+    // Entries don't move when the index grows
+    auto first = cache.find("TEST0");
+    for (int i = 10000; i < 20000; i++) {
+        cache.insert("TEST" + std::to_string(i));
+    }
+    REQUIRE(cache.find("TEST0") == first);
+
+    // Lots of removals and additions, tombstones get cleaned up
+    for (int round = 0; round < 10; round++) {
+        for (int i = round; i < 20000; i += 10) {
+            REQUIRE(cache.erase("TEST" + std::to_string(i)) == true);
+            cache.insert("OTHER" + std::to_string(round) + ":" + std::to_string(i));
+        }
+    }
+    REQUIRE(cache.size() == 20000);
+    for (int i = 0; i < 20000; i++) {
+        REQUIRE(cache.find("TEST" + std::to_string(i)) == nullptr);
+        auto pv = cache.find("OTHER" + std::to_string(i % 10) + ":" + std::to_string(i));
+        REQUIRE(pv != nullptr);
+        REQUIRE(pv->pvname == "OTHER" + std::to_string(i % 10) + ":" + std::to_string(i));
+    }
+
+    std::set<std::string> names;
+    cache.forEach([&names](const PvCache::Entry& pv) {
+        names.insert(pv.pvname);
+    });
+    REQUIRE(names.size() == 20000);
+}
+
+TEST_CASE("PV cache removes all PVs of an IOC") {
+    PvCache cache;
+    auto ioc1 = cache.addIoc(nullptr);
+    auto ioc2 = cache.addIoc(nullptr);
+    for (int i = 0; i < 100; i++) {
+        cache.setIoc(cache.insert("TEST" + std::to_string(i)), (i % 3 == 0 ? ioc1 : ioc2));
+    }
+    REQUIRE(cache.getIoc(ioc1).nPvs == 34);
+    REQUIRE(cache.getIoc(ioc2).nPvs == 66);
+
+    // Unlink some from the middle and both ends of the list
+    cache.erase("TEST0");
+    cache.erase("TEST51");
+    cache.erase("TEST99");
+    cache.setIoc(*cache.find("TEST3"), ioc2);
+    REQUIRE(cache.getIoc(ioc1).nPvs == 30);
+    REQUIRE(cache.getIoc(ioc2).nPvs == 67);
+
+    // PVs of an IOC are modified in place
+    size_t nVisited = 0;
+    cache.forEachOnIoc(ioc1, [&nVisited](PvCache::Entry& pv) {
+        pv.unverified = true;
+        nVisited++;
+    });
+    REQUIRE(nVisited == 30);
+    REQUIRE(cache.find("TEST6")->unverified);
+    REQUIRE(cache.find("TEST3")->unverified == false);
+
+    std::set<std::string> names;
+    auto nErased = cache.eraseIoc(ioc1, [&names](const PvCache::Entry& pv) {
+        names.insert(pv.pvname);
+    });
+    REQUIRE(nErased == 30);
+    REQUIRE(names.size() == 30);
+    REQUIRE(cache.size() == 67);
+    REQUIRE(cache.getIoc(ioc1).nPvs == 0);
+    for (int i = 0; i < 100; i++) {
+        auto pvname = "TEST" + std::to_string(i);
+        bool onIoc1 = (i % 3 == 0 && i != 0 && i != 51 && i != 99 && i != 3);
+        REQUIRE((names.count(pvname) == 1) == onIoc1);
+        REQUIRE((cache.find(pvname) == nullptr) == (onIoc1 || i == 0 || i == 51 || i == 99));
+    }
+
+    // Unlisted IOC is released with its PVs
+    cache.unlistIoc(ioc2);
+    REQUIRE(cache.iocCount() == 2);
+    REQUIRE(cache.eraseIoc(ioc2, [](const PvCache::Entry&) {}) == 67);
+    REQUIRE(cache.size() == 0);
+    REQUIRE(cache.iocCount() == 1);
+}
+
+TEST_CASE("Full PV cache evicts PVs not looked up") {
+    PvCache cache;
+    std::set<std::string> evicted;
+    cache.setCapacity(100, [&evicted](const PvCache::Entry& pv) {
+        evicted.insert(pv.pvname);
+    });
+
+    for (int i = 0; i < 100; i++) {
+        cache.insert("TEST" + std::to_string(i));
+    }
+    // Clients keep asking for some PVs
+    for (int i = 0; i < 100; i += 10) {
+        REQUIRE(cache.find("TEST" + std::to_string(i)) != nullptr);
+    }
+    REQUIRE(cache.find("OTHER") == nullptr);
+    REQUIRE(cache.getStats().hits == 10);
+    REQUIRE(cache.getStats().misses == 1);
+
+    for (int i = 0; i < 90; i++) {
+        cache.insert("SCAN" + std::to_string(i));
+    }
+    REQUIRE(cache.size() == 100);
+    REQUIRE(cache.getStats().evictions == 90);
+    REQUIRE(evicted.size() == 90);
+    for (int i = 0; i < 100; i++) {
+        auto pvname = "TEST" + std::to_string(i);
+        REQUIRE((evicted.count(pvname) == 0) == (i % 10 == 0));
+    }
+    for (int i = 0; i < 100; i += 10) {
+        REQUIRE(cache.find("TEST" + std::to_string(i)) != nullptr);
+    }
+
+    // Lowering the capacity evicts right away
+    cache.setCapacity(50, nullptr);
+    REQUIRE(cache.size() == 50);
+    REQUIRE(cache.getStats().evictions == 140);
+}
+
+TEST_CASE("Concurrent PV lookups mark PVs as used") {
+    PvCache cache;
+    cache.setCapacity(100, nullptr);
+    for (int i = 0; i < 100; i++) {
+        cache.insert("TEST" + std::to_string(i));
+    }
+
+    // Readers don't update stats, but protect PVs from eviction like find().
+    // Assertions are not thread safe, only count the results.
+    std::atomic<int> nFound{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&cache, &nFound, t]() {
+            for (int i = t; i < 100; i += 20) {
+                nFound += (cache.peek("TEST" + std::to_string(i)) != nullptr);
+            }
+            nFound += (cache.peek("OTHER") != nullptr);
+        });
+    }
+    for (auto& reader: readers) {
+        reader.join();
+    }
+    REQUIRE(nFound == 20);
+    REQUIRE(cache.getStats().hits == 0);
+    REQUIRE(cache.getStats().misses == 0);
+
+    for (int i = 0; i < 80; i++) {
+        cache.insert("SCAN" + std::to_string(i));
+    }
+    for (int i = 0; i < 100; i++) {
+        REQUIRE((cache.peek("TEST" + std::to_string(i)) != nullptr) == (i % 20 < 4));
+    }
+}
@@ -4,64 +4,387 @@
 #include "proto_ca.hpp"
 #include "searcher.hpp"
 
+#include <map>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
 class TestSearcher : public Searcher {
     private:
-        Searcher::PvFoundCb _cb = [](const std::string &, const std::string &, uint16_t, const Protocol::Bytes &) {};
+        static inline Searcher::PvFoundCb _cb = [](const std::string &, const std::string &, uint16_t, uint16_t, const Protocol::Bytes &) {};
     public:
         TestSearcher()
-        : Searcher("0.0.0.0", 5053, {1,5, 10}, std::shared_ptr<ChannelAccess>(), _cb)
+        : Searcher({{"0.0.0.0", 5053, 1500}}, {1,5, 10}, std::shared_ptr<ChannelAccess>(), _cb)
+        {}
+
+        TestSearcher(const std::shared_ptr<Protocol>& protocol)
+        : Searcher({{"127.0.0.1", 5053, 1500}}, {1,5, 10}, protocol, _cb)
         {}
 
-        using Searcher::scheduleNextSearch;
+        using Searcher::findChanId;
+        using Searcher::search;
 
-        std::list<SearchedPV>& getSearchedPvs()
+        std::deque<SearchedPV>& getSearchedPvs()
         {
             return m_searchedPvs;
         }
+
+        PvIndex& getPvIndex()
+        {
+            return m_pvIndex;
+        }
+
+        TimerWheel& getSchedule()
+        {
+            return m_schedule;
+        }
+
+        size_t countPvs()
+        {
+            size_t n = 0;
+            for (auto& pv: m_searchedPvs) {
+                n += (pv.used ? 1 : 0);
+            }
+            return n;
+        }
 };
 
-TEST_CASE("Analyze scheduleNextSearch() function") {
+TEST_CASE("Analyze addPV() and removePV() functions") {
+    TestSearcher searcher;
+    auto& slots = searcher.getSearchedPvs();
+    auto& index = searcher.getPvIndex();
+    auto& schedule = searcher.getSchedule();
+
+    REQUIRE(searcher.addPV("TEST1") == true);
+    REQUIRE(searcher.addPV("TEST2") == true);
+    REQUIRE(searcher.addPV("TEST3") == true);
+    REQUIRE(searcher.addPV("TEST2") == false);
+
+    REQUIRE(searcher.size() == 3);
+    REQUIRE(searcher.countPvs() == 3);
+    REQUIRE(schedule.size() == 3);
+
+    for (auto& [name, slot]: index) {
+        REQUIRE(name == slots[slot].pvname);
+        REQUIRE(schedule.getExpires(slot) == schedule.now() + 1);
+    }
+
+    searcher.removePV("TEST2");
+    REQUIRE(searcher.size() == 2);
+    REQUIRE(searcher.countPvs() == 2);
+    REQUIRE(schedule.size() == 2);
+    REQUIRE(index.find("TEST2") == index.end());
+
+    searcher.removePV("TEST2");
+    REQUIRE(searcher.size() == 2);
+
+    REQUIRE(searcher.addPV("TEST2") == true);
+    REQUIRE(searcher.size() == 3);
+    REQUIRE(slots.size() == 3);
+}
+
+TEST_CASE("Purge rebalancing keeps PVs scheduled") {
+    TestSearcher searcher(std::make_shared<ChannelAccess>());
+    auto& slots = searcher.getSearchedPvs();
+    auto& index = searcher.getPvIndex();
+    auto& schedule = searcher.getSchedule();
+
+    for (int i = 0; i < 1000; i++) {
+        searcher.addPV("TEST" + std::to_string(i));
+    }
+    // Get PVs into the longest interval, all due at the same tick
+    for (TimerWheel::Tick tick = 1; tick < 20; tick++) {
+        searcher.search(tick);
+    }
+    searcher.addPV("NEW");
+
+    auto [nPurged, nRemain] = searcher.purgePVs(600);
+    REQUIRE(nPurged == 0);
+    REQUIRE(nRemain == 1001);
+    REQUIRE(searcher.size() == 1001);
+    REQUIRE(schedule.size() == 1001);
+
+    // New PV keeps its first search
+    REQUIRE(slots[index.at("NEW")].interval == 0);
+    REQUIRE(schedule.getExpires(index.at("NEW")) == 20);
+
+    // 1000 PVs spread over 100 ticks, the longest interval, within half of it from the
+    // due time unless that's in the past
+    std::map<TimerWheel::Tick, size_t> ticks;
+    for (auto& [name, slot]: index) {
+        REQUIRE(slots[slot].pvname == name);
+        if (name != "NEW") {
+            REQUIRE(slots[slot].interval == 4);
+            ticks[schedule.getExpires(slot)]++;
+        }
+    }
+    REQUIRE(ticks.size() == 100);
+    REQUIRE(ticks.begin()->first >= 20);
+    REQUIRE(ticks.rbegin()->first < 20 + 100);
+    for (auto& [tick, n]: ticks) {
+        REQUIRE(n == 10);
+    }
+
+    // Balanced schedule doesn't change any more
+    std::vector<TimerWheel::Tick> expires;
+    for (uint32_t slot = 0; slot < 1000; slot++) {
+        expires.push_back(schedule.getExpires(slot));
+    }
+    searcher.purgePVs(600);
+    for (uint32_t slot = 0; slot < 1000; slot++) {
+        REQUIRE(schedule.getExpires(slot) == expires[slot]);
+    }
+
+    for (int i = 0; i < 1000; i += 2) {
+        searcher.removePV("TEST" + std::to_string(i));
+    }
+    REQUIRE(searcher.size() == 501);
+    REQUIRE(searcher.countPvs() == 501);
+    REQUIRE(schedule.size() == 501);
+}
+
+TEST_CASE("Purging is done in limited steps") {
+    TestSearcher searcher;
+    auto& slots = searcher.getSearchedPvs();
+
+    for (int i = 0; i < 250; i++) {
+        searcher.addPV("TEST" + std::to_string(i));
+    }
+    // Every other PV not requested for a long time
+    auto longAgo = std::chrono::steady_clock::now() - std::chrono::seconds(1000);
+    for (uint32_t slot = 0; slot < 250; slot += 2) {
+        slots[slot].lastSearched = longAgo;
+    }
+
+    REQUIRE(searcher.purgeStep(600, 100) == false);
+    REQUIRE(searcher.size() == 200);
+    REQUIRE(searcher.purgeStep(600, 100) == false);
+    REQUIRE(searcher.size() == 150);
+    REQUIRE(searcher.purgeStep(600, 100) == true);
+    REQUIRE(searcher.size() == 125);
+    REQUIRE(searcher.getPurgeResult() == std::make_pair(125u, 125u));
+
+    // Next pass starts from the beginning
+    REQUIRE(searcher.purgeStep(600, 1000) == true);
+    REQUIRE(searcher.getPurgeResult() == std::make_pair(0u, 125u));
+}
+
+TEST_CASE("Full search list drops PVs not requested again") {
+    TestSearcher searcher;
+    searcher.setCapacity(100);
+
+    for (int i = 0; i < 100; i++) {
+        searcher.addPV("TEST" + std::to_string(i));
+    }
+    // Clients keep asking for some PVs while others are scanned
+    for (int i = 0; i < 200; i++) {
+        if ((i % 50) == 0) {
+            for (int j = 0; j < 100; j += 10) {
+                REQUIRE(searcher.addPV("TEST" + std::to_string(j)) == false);
+            }
+        }
+        REQUIRE(searcher.addPV("SCAN" + std::to_string(i)) == true);
+    }
+    REQUIRE(searcher.size() == 100);
+    REQUIRE(searcher.countPvs() == 100);
+    REQUIRE(searcher.getSchedule().size() == 100);
+    REQUIRE(searcher.getEvictions() == 200);
+    for (int i = 0; i < 100; i += 10) {
+        REQUIRE(searcher.getPvIndex().count("TEST" + std::to_string(i)) == 1);
+    }
+}
+
+TEST_CASE("Channel ids of recycled slots don't match stale replies") {
     TestSearcher searcher;
-    auto& pvs = searcher.getSearchedPvs();
+    auto& index = searcher.getPvIndex();
 
     searcher.addPV("TEST1");
     searcher.addPV("TEST2");
+    auto& slots = searcher.getSearchedPvs();
+    auto chanId1 = slots[index.at("TEST1")].chanId;
+    auto chanId2 = slots[index.at("TEST2")].chanId;
+    REQUIRE(chanId1 != chanId2);
+
+    auto pv = searcher.findChanId(chanId1);
+    REQUIRE(pv != nullptr);
+    REQUIRE(pv->pvname == "TEST1");
+
+    searcher.removePV("TEST1");
+    REQUIRE(searcher.findChanId(chanId1) == nullptr);
+    REQUIRE(searcher.findChanId(chanId2) != nullptr);
+
+    // Released slot gets reused with a new generation
     searcher.addPV("TEST3");
+    auto chanId3 = slots[index.at("TEST3")].chanId;
+    REQUIRE(chanId3 != chanId1);
+    REQUIRE(searcher.findChanId(chanId1) == nullptr);
+    REQUIRE(searcher.findChanId(chanId3)->pvname == "TEST3");
+
+    // Unknown slots are rejected too
+    REQUIRE(searcher.findChanId(12345) == nullptr);
+}
+
+TEST_CASE("Search budget defers retries behind first searches") {
+    TestSearcher searcher(std::make_shared<ChannelAccess>());
+    auto& slots = searcher.getSearchedPvs();
+    auto& index = searcher.getPvIndex();
+
+    // Long names so that only a few fit in a packet
+    std::string prefix(100, 'X');
+    for (int i = 0; i < 100; i++) {
+        searcher.addPV(prefix + "OLD" + std::to_string(i));
+    }
+    searcher.search(1);
+    REQUIRE(searcher.getBacklog() == 0);
+    REQUIRE(searcher.getTotalStats().searches == 100);
+
+    // Budget of a single packet per tick, retries are due at the same tick as new PVs
+    searcher.setRateLimit(10, 0);
+    for (int i = 0; i < 5; i++) {
+        searcher.addPV(prefix + "NEW" + std::to_string(i));
+    }
+    searcher.search(2);
+
+    auto& stats = searcher.getTickStats();
+    REQUIRE(stats.packets == 1);
+    REQUIRE(stats.searches > 5);
+    REQUIRE(stats.searches < 105);
+    REQUIRE(stats.deferred == 105 - stats.searches);
+    REQUIRE(searcher.getBacklog() == stats.deferred);
+    for (int i = 0; i < 5; i++) {
+        auto& pv = slots[index.at(prefix + "NEW" + std::to_string(i))];
+        REQUIRE(pv.queued == false);
+        REQUIRE(pv.interval == 1);
+    }
+
+    // Removed PVs leave the backlog, the rest stays scheduled
+    auto& pv = slots[index.at(prefix + "OLD99")];
+    REQUIRE(pv.queued == true);
+    searcher.removePV(prefix + "OLD99");
+    REQUIRE(searcher.getBacklog() == stats.deferred - 1);
+    REQUIRE(searcher.getSchedule().size() + searcher.getBacklog() == searcher.size());
+}
+
+TEST_CASE("Expedited search pulls PVs forward keeping their backoff") {
+    TestSearcher searcher(std::make_shared<ChannelAccess>());
+    auto& slots = searcher.getSearchedPvs();
+    auto& schedule = searcher.getSchedule();
+
+    for (int i = 0; i < 100; i++) {
+        searcher.addPV("OLD" + std::to_string(i));
+    }
+    // Get PVs into the longest interval
+    for (TimerWheel::Tick tick = 1; tick < 20; tick++) {
+        searcher.search(tick);
+    }
+    for (uint32_t slot = 0; slot < 100; slot++) {
+        REQUIRE(slots[slot].interval == 4);
+        REQUIRE(schedule.getExpires(slot) == 64);
+    }
+
+    // More PVs than pulled forward at once, in shorter intervals
+    for (int i = 0; i < 1500; i++) {
+        searcher.addPV("NEW" + std::to_string(i));
+    }
+    for (TimerWheel::Tick tick = 20; tick < 25; tick++) {
+        searcher.search(tick);
+    }
+    std::vector<TimerWheel::Tick> expires;
+    for (uint32_t slot = 0; slot < 1600; slot++) {
+        expires.push_back(schedule.getExpires(slot));
+        if (slot >= 100) {
+            REQUIRE(slots[slot].interval == 3);
+            REQUIRE(expires[slot] > 30);
+        }
+    }
+
+    // Limited number of PVs searched sooner, spread over a second, longest interval left alone
+    searcher.setExpediteHoldoff(10);
+    searcher.expedite();
+    searcher.search(25);
+    size_t nPulled = 0;
+    for (uint32_t slot = 0; slot < 1600; slot++) {
+        // Some were due right away and are already waiting for the next interval
+        if (schedule.getExpires(slot) != expires[slot]) {
+            REQUIRE(slot >= 100);
+            REQUIRE((schedule.getExpires(slot) < expires[slot] || slots[slot].interval == 4));
+            nPulled++;
+        }
+        expires[slot] = schedule.getExpires(slot);
+    }
+    REQUIRE(nPulled == 1000);
+    for (uint32_t slot = 0; slot < 100; slot++) {
+        REQUIRE(expires[slot] == 64);
+    }
+
+    // Further requests wait for the holdoff period
+    searcher.expedite();
+    searcher.search(26);
+    for (uint32_t slot = 0; slot < 1600; slot++) {
+        REQUIRE((schedule.getExpires(slot) == expires[slot] || expires[slot] == 26));
+    }
+}
+
+TEST_CASE("Probe last known IOC before searching everywhere") {
+    TestSearcher searcher(std::make_shared<ChannelAccess>());
+    auto& slots = searcher.getSearchedPvs();
+    auto& index = searcher.getPvIndex();
+    auto& schedule = searcher.getSchedule();
+
+    // Fake IOC
+    int sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    REQUIRE(::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0);
+    REQUIRE(::getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &addrLen) == 0);
+
+    REQUIRE(searcher.addPV("PROBED1", "127.0.0.1", ::ntohs(addr.sin_port)) == true);
+    REQUIRE(searcher.addPV("PROBED2", "127.0.0.1", ::ntohs(addr.sin_port)) == true);
+    REQUIRE(searcher.addPV("PROBED2", "127.0.0.1", ::ntohs(addr.sin_port)) == false);
+    searcher.search(1);
+
+    auto& stats = searcher.getTotalStats();
+    REQUIRE(stats.probes == 2);
+    REQUIRE(stats.searches == 0);
+    REQUIRE(schedule.getExpires(index.at("PROBED1")) == 6);
+
+    // Both probes in a single packet
+    unsigned char buffer[1500];
+    auto recvd = ::recv(sock, buffer, sizeof(buffer), MSG_DONTWAIT);
+    REQUIRE(recvd > 0);
+    auto pvs = ChannelAccess().parseSearchRequest({buffer, buffer + recvd});
+    REQUIRE(pvs.size() == 2);
+    REQUIRE(pvs[0].first == slots[index.at(pvs[0].second)].chanId);
+    ::close(sock);
+
+    // No response, regular schedule continues with the first search
+    searcher.search(6);
+    REQUIRE(stats.probes == 2);
+    REQUIRE(stats.searches == 2);
+    auto& pv = slots[index.at("PROBED1")];
+    REQUIRE(pv.probeIp == 0);
+    REQUIRE(pv.interval == 1);
+}
+
+TEST_CASE("PVs not found in a full schedule skip the initial searches") {
+    TestSearcher searcher(std::make_shared<ChannelAccess>());
+    auto& slots = searcher.getSearchedPvs();
+    auto& index = searcher.getPvIndex();
+    searcher.setNegativeCache(100, 3600);
+
+    searcher.addPV("MISSING");
+    for (TimerWheel::Tick tick = 1; tick < 20; tick++) {
+        searcher.search(tick);
+    }
+    REQUIRE(slots[index.at("MISSING")].interval == 4);
+    REQUIRE(searcher.getNegativeCache().size() == 1);
 
-    REQUIRE(pvs.size() == 3);
-
-    auto it = pvs.begin();
-    REQUIRE(it->pvname == "TEST3"); it++;
-    REQUIRE(it->pvname == "TEST2"); it++;
-    REQUIRE(it->pvname == "TEST1");
-
-    searcher.scheduleNextSearch("TEST3", 10);
-    it = pvs.begin();
-    REQUIRE(it->pvname == "TEST2"); it++;
-    REQUIRE(it->pvname == "TEST1"); it++;
-    REQUIRE(it->pvname == "TEST3");
-
-    searcher.scheduleNextSearch("TEST3", 10);
-    it = pvs.begin();
-    REQUIRE(it->pvname == "TEST2"); it++;
-    REQUIRE(it->pvname == "TEST1"); it++;
-    REQUIRE(it->pvname == "TEST3");
-
-    searcher.scheduleNextSearch("TEST1", 30);
-    it = pvs.begin();
-    REQUIRE(it->pvname == "TEST2"); it++;
-    REQUIRE(it->pvname == "TEST3"); it++;
-    REQUIRE(it->pvname == "TEST1");
-
-    searcher.scheduleNextSearch("TEST2", 40);
-    it = pvs.begin();
-    REQUIRE(it->pvname == "TEST3"); it++;
-    REQUIRE(it->pvname == "TEST1"); it++;
-    REQUIRE(it->pvname == "TEST2");
-
-    searcher.scheduleNextSearch("TEST3", 1);
-    it = pvs.begin();
-    REQUIRE(it->pvname == "TEST3"); it++;
-    REQUIRE(it->pvname == "TEST1"); it++;
-    REQUIRE(it->pvname == "TEST2");
-}
\ No newline at end of file
+    searcher.removePV("MISSING");
+    searcher.addPV("MISSING");
+    searcher.addPV("NEW");
+    REQUIRE(slots[index.at("MISSING")].interval == 4);
+    REQUIRE(slots[index.at("NEW")].interval == 0);
+    REQUIRE(searcher.getNegativeCache().getStats().hits == 1);
+}
@@ -0,0 +1,81 @@
+#include "catch.hpp"
+
+#include "timerwheel.hpp"
+
+#include <map>
+#include <vector>
+
+TEST_CASE("Timers expire at their tick") {
+    TimerWheel wheel;
+    std::vector<std::pair<uint32_t, TimerWheel::Tick>> expired;
+    auto cb = [&](uint32_t id) { expired.emplace_back(id, wheel.now()); };
+
+    wheel.schedule(0, 1);
+    wheel.schedule(1, 63);
+    wheel.schedule(2, 64);
+    wheel.schedule(3, 65);
+    wheel.schedule(4, 5000);
+    wheel.schedule(5, 300000);
+    REQUIRE(wheel.size() == 6);
+
+    wheel.advance(64, cb);
+    REQUIRE(expired.size() == 3);
+    REQUIRE(expired[0] == std::make_pair(0u, TimerWheel::Tick(1)));
+    REQUIRE(expired[1] == std::make_pair(1u, TimerWheel::Tick(63)));
+    REQUIRE(expired[2] == std::make_pair(2u, TimerWheel::Tick(64)));
+
+    wheel.advance(10000000, cb);
+    REQUIRE(expired.size() == 6);
+    REQUIRE(expired[3] == std::make_pair(3u, TimerWheel::Tick(65)));
+    REQUIRE(expired[4] == std::make_pair(4u, TimerWheel::Tick(5000)));
+    REQUIRE(expired[5] == std::make_pair(5u, TimerWheel::Tick(300000)));
+    REQUIRE(wheel.size() == 0);
+}
+
+TEST_CASE("Timers can be cancelled and rescheduled") {
+    TimerWheel wheel;
+    std::vector<uint32_t> expired;
+    auto cb = [&](uint32_t id) { expired.push_back(id); };
+
+    wheel.schedule(0, 10);
+    wheel.schedule(1, 10);
+    wheel.schedule(2, 10);
+    wheel.cancel(1);
+    wheel.cancel(7);
+    REQUIRE(wheel.isScheduled(1) == false);
+    REQUIRE(wheel.size() == 2);
+
+    wheel.schedule(2, 20);
+    wheel.advance(10, cb);
+    REQUIRE(expired == std::vector<uint32_t>{0});
+
+    // Timers in the past expire on the next tick
+    wheel.schedule(1, 3);
+    REQUIRE(wheel.getExpires(1) == 11);
+    wheel.advance(20, cb);
+    REQUIRE(expired == std::vector<uint32_t>{0, 1, 2});
+}
+
+TEST_CASE("Timers rescheduled from callback with random delays") {
+    TimerWheel wheel;
+    std::map<uint32_t, TimerWheel::Tick> due;
+    uint32_t seed = 17;
+    auto random = [&seed]() { seed = seed * 1103515245 + 12345; return (seed >> 8); };
+
+    for (uint32_t id = 0; id < 1000; id++) {
+        due[id] = 1 + random() % 100000;
+        wheel.schedule(id, due[id]);
+    }
+
+    size_t nExpired = 0;
+    for (TimerWheel::Tick now = 0; now < 500000; now += 1 + random() % 1000) {
+        wheel.advance(now, [&](uint32_t id) {
+            REQUIRE(due[id] == wheel.now());
+            due[id] = wheel.now() + 1 + random() % 100000;
+            wheel.schedule(id, due[id]);
+            nExpired++;
+        });
+    }
+    REQUIRE(nExpired > 1000);
+    REQUIRE(wheel.size() == 1000);
+}
@@ -0,0 +1,65 @@
+#include "catch.hpp"
+
+#include "udpbatch.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <string>
+
+static int createSocket(sockaddr_in& addr)
+{
+    int sock = ::socket(AF_INET, SOCK_DGRAM, 0);
+    ::fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+    addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = ::htonl(INADDR_LOOPBACK);
+    ::bind(sock, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    socklen_t len = sizeof(addr);
+    ::getsockname(sock, reinterpret_cast<sockaddr*>(&addr), &len);
+    return sock;
+}
+
+static void sendAndReceive(size_t batchSize)
+{
+    UdpBatch::setBatchSize(batchSize);
+    UdpBatch tx(64, 64);
+    UdpBatch rx(64, 64);
+
+    sockaddr_in txAddr, rxAddr;
+    int txSock = createSocket(txAddr);
+    int rxSock = createSocket(rxAddr);
+
+    // Datagrams that can't be sent don't hold back the rest
+    sockaddr_in badAddr = rxAddr;
+    badAddr.sin_port = 0;
+    for (int i = 0; i < 100; i++) {
+        auto msg = std::to_string(i);
+        tx.send(txSock, msg.data(), msg.size(), (i % 10 == 5 ? badAddr : rxAddr));
+    }
+    tx.flush(txSock);
+
+    int next = 0;
+    int nReceived = 0;
+    rx.receive(rxSock, [&](const unsigned char* data, size_t len, const sockaddr_in& remoteAddr) {
+        if (next % 10 == 5) {
+            next++;
+        }
+        REQUIRE(std::string(reinterpret_cast<const char*>(data), len) == std::to_string(next++));
+        REQUIRE(remoteAddr.sin_port == txAddr.sin_port);
+        nReceived++;
+    });
+    REQUIRE(nReceived == 90);
+
+    ::close(txSock);
+    ::close(rxSock);
+    UdpBatch::setBatchSize(32);
+}
+
+TEST_CASE("Datagrams are sent and received in batches") {
+    sendAndReceive(32);
+}
+
+TEST_CASE("Datagrams are sent and received one by one when batching is disabled") {
+    sendAndReceive(0);
+}